@@ -3,6 +3,7 @@
 #include "application.h"
 #include "util/log.h"
 #include "util/list.h"
+#include "util/workerpool.h"
 
 #include "render/font.h"
 
@@ -39,6 +40,8 @@ bool Application::Initialize()
     }
     INIT(interrupts)
     INIT(timer)
+    // Without the other cores, everything is simply drawn on this one
+    WorkerPool::Instance().Initialize();
     INIT(screenManager)
     screenManager.DrawString(screenManager.GetSize()/2-Vector<s16>(80,0), "Loading MultiKobo...", 20, Font::GetDefault());
     screenManager.Present();
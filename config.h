@@ -11,8 +11,8 @@
 
 // The memset provided by Circle is a trivial implementation that sets a single byte
 // at a time. Setting CONFIG_OWN_MEMSET will use our own implementation that will
-// set 8 bytes at a time when possible (the count is larger than 8 and aligned with
-// 64 bit integers.)
+// use vector stores, or set 8 bytes at a time when CONFIG_SIMD_RENDER is 0.
+// See Simd::Fill in util/simd.h.
 #ifndef CONFIG_OWN_MEMSET
 #   define CONFIG_OWN_MEMSET 1
 #endif
@@ -24,47 +24,128 @@
 #   define CONFIG_USE_ITEM_POOL 1
 #endif
 
-// Set CONFIG_GPU_PAGE_FLIPPING to 1 to allocate both the active and visible
-// frame buffers in GPU memory. The GPU will be used to page between them.
-// If set to 0 rendering will be to a temporary buffer in CPU ram and
-// page flipping will be implemented by memcpy-ing the contents to GPU ram.
-// Due to CPU memory being cached and GPU not, the latter is actually
-// around 3 times faster than the former despite the final memcpy.
-#ifndef CONFIG_GPU_PAGE_FLIPPING
-#   define CONFIG_GPU_PAGE_FLIPPING 0
+// Set CONFIG_USE_ACTOR_POOL to 0 to use the standard memory allocator for actors.
+// When set to 1, actors are allocated from per type slabs that reuse the memory of
+// destroyed actors, and all actor memory is reclaimed at once when a level is cleared.
+#ifndef CONFIG_USE_ACTOR_POOL
+#   define CONFIG_USE_ACTOR_POOL 1
 #endif
 
-// If CONFIG_DMA_FRAME_COPY is set (and CONFIG_GPU_PAGE_FLIPPING is not set)
-// the final memory copy from CPU to GPU ram is done using a DMA transfer instead
-// of using the CPU. This is approximately 5 times slower thant the CPU methhod,
-// but further refinements could be done to allow non-rendering code to run
-// in parallel with the copying.
-#ifndef CONFIG_DMA_FRAME_COPY
-#   define CONFIG_DMA_FRAME_COPY 0
+// The number of bytes reserved inside Callback objects for storing functors.
+// Lambdas with captures that fit are stored without allocating memory, while larger
+// ones are copied to the heap. Set to 0 to always allocate the functors on the heap.
+#ifndef CONFIG_CALLBACK_INLINE_SIZE
+#   define CONFIG_CALLBACK_INLINE_SIZE 16
 #endif
 
-// CONFIG_DMA_PARALLELL will allow the main loop to start running non-rendering updates
-// while the DMA operation is still copying frame data to the GPU.
-// It will not block until just before starting rendering the next frame.
-#ifndef CONFIG_DMA_PARALLEL
-#   define CONFIG_DMA_PARALLEL CONFIG_DMA_FRAME_COPY
+// The name of the present strategy used at startup, which decides how frames get to
+// the display. "memcpy" draws to a buffer in cached CPU ram and copies the changed areas
+// to GPU ram after each vertical sync. "dma1" does the copy with a DMA transfer, and
+// "dma2" lets the game update while the transfer runs. "pageflip" draws directly to
+// one of two pages of GPU ram and has the GPU switch between them. Due to CPU memory
+// being cached and GPU not, copying is usually faster than page flipping despite the
+// copy. The strategy can be changed at runtime with ScreenManager::SetPresentStrategy.
+// See render/presentstrategy.h.
+#ifndef CONFIG_PRESENT_STRATEGY
+#   define CONFIG_PRESENT_STRATEGY "memcpy"
 #endif
 
-// If set to 1, the ScreenManager class will use neon intrinsics to copy 16 pixels
-// at a time to the destination using NEON intrinsics.
-#ifndef CONFIG_NEON_RENDER
-#   define CONFIG_NEON_RENDER 1
+// If set to 1, the render kernels in util/simd.h use vector instructions: NEON on
+// the Raspberry Pi, and SSE2 or AVX2 when built for a PC. They handle 16 or 32 pixels
+// at a time. If set to 0, or the target has none of them, scalar code is used.
+#ifndef CONFIG_SIMD_RENDER
+#   define CONFIG_SIMD_RENDER 1
 #endif
 
-// Sanity checks
-#if CONFIG_GPU_PAGE_FLIPPING && CONFIG_DMA_FRAME_COPY
-#   error "CONFIG_GPU_PAGE_FLIPPING and CONFIG_DMA_FRAME_COPY are mutually exclusive"
+// If set to 1, the ImageSheet class precomputes the runs of opaque pixels in each row
+// of its images. Images are then drawn by copying only the opaque runs, skipping the
+// transparent pixels entirely instead of comparing each one against the transparent color.
+#ifndef CONFIG_SPAN_SPRITES
+#   define CONFIG_SPAN_SPRITES 1
 #endif
 
-#if CONFIG_NEON_RENDER && CONFIG_DMA_FRAME_COPY
-#   error "CONFIG_NEON_RENDER and CONFIG_DMA_FRAME_COPY are currently not compatible with each other"
+// If set to 1, the ImageSheet class copies the pixels of each image into a separate
+// 16 byte aligned block followed by its spans, so drawing a sprite reads adjacent cache
+// lines instead of one line of the full sheet for each row. If set to 0, the images
+// refer directly to the rows of the sheet.
+#ifndef CONFIG_PACKED_SPRITES
+#   define CONFIG_PACKED_SPRITES 1
 #endif
 
-#if CONFIG_DMA_PARALLEL && !CONFIG_DMA_FRAME_COPY
-#   error "CONFIG_DMA_PARALLEL requires CONFIG_DMA_FRAME_COPY"
+// If set to 1, the ScreenManager class draws images that are entirely inside the clip
+// rectangle with blitters specialized at compile time for their size, which are fully
+// unrolled. Partially clipped images are drawn with the generic blitter.
+#ifndef CONFIG_FIXED_BLITTERS
+#   define CONFIG_FIXED_BLITTERS 1
+#endif
+
+// The initial height in rows of the bands the world view is drawn in. When non-zero,
+// the draw calls of a frame are collected and sorted into horizontal bands, and each
+// band is drawn from start to finish while it stays in the cache. Set to 0 to draw
+// directly. Can be changed at runtime with ScreenManager::SetBandHeight.
+#ifndef CONFIG_RENDER_BAND_HEIGHT
+#   define CONFIG_RENDER_BAND_HEIGHT 0
+#endif
+
+// If set to 1, the Background class keeps the fortress tiles around the view composited
+// into a cached layer, which is drawn with a single large copy instead of drawing each
+// visible cell every frame. The layer is updated as the view scrolls and cells change.
+#ifndef CONFIG_BACKGROUND_CACHE
+#   define CONFIG_BACKGROUND_CACHE 1
+#endif
+
+// If set to 1, ScreenManager::DrawString renders each string into an image the first
+// time it is drawn and keeps the most recently used ones in a TextCache, so drawing
+// the same text again is a single blit. Can be changed at runtime with
+// ScreenManager::SetTextCache.
+#ifndef CONFIG_TEXT_CACHE
+#   define CONFIG_TEXT_CACHE 1
+#endif
+
+// The number of times per second the game simulation advances. MainLoop runs as many
+// simulation ticks per displayed frame as the time elapsed calls for, so the game
+// runs at the same speed when frames are missed or on displays with another refresh
+// rate, and actors are drawn interpolated between the last two ticks. Set to 0 to
+// run exactly one tick per displayed frame. Can be changed at runtime with
+// MainLoop::SetTickRate.
+#ifndef CONFIG_TICK_RATE
+#   define CONFIG_TICK_RATE 60
+#endif
+
+// The largest number of simulation ticks run for a single displayed frame. When
+// frames take longer than this many ticks, the time exceeding it is dropped and the
+// game slows down rather than spending ever longer catching up.
+#ifndef CONFIG_MAX_CATCHUP_TICKS
+#   define CONFIG_MAX_CATCHUP_TICKS 4
+#endif
+
+// If set to 1, MainLoop lowers the quality of optional work, such as the density of
+// the star field and how often the mini map and text are redrawn, step by step when
+// frames get close to missing their vertical sync, and raises it again when there is
+// time to spare. See ui/qualitygovernor.h. Can be changed at runtime with
+// QualityGovernor::SetEnabled.
+#ifndef CONFIG_QUALITY_GOVERNOR
+#   define CONFIG_QUALITY_GOVERNOR 1
+#endif
+
+// If set to 1, MainLoop runs the simulation of single player games for the next frame
+// on another core while the current frame is rendered, handing the finished view over
+// between frames. This shows each frame one frame later. Can be changed at runtime with
+// MainLoop::SetPipelined. Needs a WorkerPool with at least two workers to overlap.
+#ifndef CONFIG_PIPELINED_MAIN_LOOP
+#   define CONFIG_PIPELINED_MAIN_LOOP 0
+#endif
+
+// The measurement the performance test from the game menu runs. Each run covers one of
+// them, so that it finishes in reasonable time. The sweeps run a one minute test on the
+// empty level, then one per variant for each count of 2000 up to 14000 actors:
+//  "actors"       uniform spawns, grid partitioning and direct rendering, about 8 minutes.
+//  "partitioning" uniform and clustered spawns, each with grid and adaptive partitioning.
+//  "workers"      direct rendering, then bands drawn by one up to all workers of the pool.
+//  "present"      the minute split between all present strategies.
+//  "governor"     only 14000 actors, without and then with the quality governor.
+// "spawn", "blit", "fixedblit", "simd", "spritelayout" and "background" instead run
+// the microbenchmark of that name once and end the run.
+#ifndef CONFIG_PERF_TEST
+#   define CONFIG_PERF_TEST "actors"
 #endif
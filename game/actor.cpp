@@ -1,29 +1,38 @@
 #include "game/actor.h"
 #include "game/gameserver.h"
 #include "game/stage.h"
+#include "game/actorpool.h"
 
 using namespace hfh3;
 
 Actor::Actor(GameServer& inWorld, CollisionMask inCollisionTargetMask, CollisionMask inCollisionSourceMask)
     : world(inWorld)
     , stage(inWorld.GetStage())
-    , shouldDestruct(false)
-    , positionDirty(true)
+    , partition(nullptr)
+    , slot(-1)
     , killer(-1)
-    , collisionTargetMask(inCollisionTargetMask)
-    , collisionSourceMask(inCollisionSourceMask)
-{}
+    , id(inWorld.AllocateActorId())
+{
+    // New actors are kept in a separate partition until the world
+    // assigns them to the one matching their position.
+    inWorld.GetSpawnPartition().Add(this, id, inCollisionTargetMask, inCollisionSourceMask);
+}
+
+Actor::~Actor()
+{
+    world.FreeActorId(id);
+}
 
 void Actor::SetPosition(const Vector<s16>& newPosition)
 {
-    position = stage.WrapCoordinate(newPosition);
-    positionDirty = true;
+    partition->Position(slot) = stage.WrapCoordinate(newPosition);
+    partition->Flags(slot) |= Partition::PositionDirty;
 }
 
 bool Actor::CollisionCheck(class Actor* other)
 {
-    return this != other && !shouldDestruct && 
-           (collisionSourceMask & other->collisionTargetMask) &&
+    return this != other && !IsDestroyed() && 
+           (GetCollisionSourceMask() & other->GetCollisionTargetMask()) &&
            GetBounds().OverlapsMod(other->GetBounds(), stage.GetSize());
 }
 
@@ -33,5 +42,5 @@ void Actor::Destroy()
     {
         destructionHandler();
     }
-    shouldDestruct = true;
+    partition->Flags(slot) |= Partition::Destroyed;
 }
@@ -6,6 +6,14 @@
 #include "util/callback.h"
 #include "game/partition.h"
 #include "game/collisionmask.h"
+#include "game/actorpool.h"
+
+/** Declares the operator new and delete of an actor class, which allocate its objects
+  * from a slab of its own in the ActorPool. Used in the public section of the class.
+  */
+#define ACTOR_POOL_ALLOCATED(Type) \
+    static void* operator new(size_t size) { return ActorPool::Instance().Allocate<Type>(size); } \
+    static void operator delete(void* memory, size_t size) { ActorPool::Instance().Free<Type>(memory, size); }
 
 namespace hfh3
 {
@@ -20,23 +28,24 @@ namespace hfh3
               CollisionMask inCollisionSourceMask = CollisionMask::None);
 
         /** Since we're using virtual methods, the destructor needs to be virtual.
+          * Releases the id of the actor so it can be given to a new one.
         */
-        virtual ~Actor() = default;
+        virtual ~Actor();
 
         /** Update is called on each actor once per frame. */
         virtual void Update() = 0;
 
-        /** After updating all actors, each will get a chance to render itself to screen */
-        virtual void Draw(class CommandList& commands) = 0;
-
         /** Return the bounding rectangle of the actor */
-        virtual Rect<s16> GetBounds() = 0;
+        Rect<s16> GetBounds()
+        {
+            return partition->GetBounds(slot);
+        }
 
         /** Performs a collision check with the passed in actor object.
           * The collision source mask has to match bits in the other object's target mask 
           * before the objects' bounds are checked for an overlap.
           */
-        virtual bool CollisionCheck(class Actor* other);
+        bool CollisionCheck(class Actor* other);
 
         /** Called when a hit test identifies an overlap beween two actors.
           */
@@ -53,12 +62,13 @@ namespace hfh3
 
         bool IsDestroyed()
         {
-            return shouldDestruct;
+            return partition->Flags(slot) & Partition::Destroyed;
         }
 
-        const Vector<s16>& GetPosition() const
+        // Returned by value as the partition arrays may be reallocated when actors are spawned.
+        Vector<s16> GetPosition() const
         {
-            return position;
+            return partition->Position(slot);
         }
 
         void SetPosition(const Vector<s16>& newPosition);
@@ -87,43 +97,76 @@ namespace hfh3
             return 0;
         }
 
+        /** Actors are allocated from a slab per class in the ActorPool. Every class
+          * that is instantiated declares its own operator new and delete with
+          * ACTOR_POOL_ALLOCATED, so allocating one that does not fails to compile.
+          */
+        static void* operator new(size_t size) = delete;
+
         template<typename T>
         void SetDestructionHandler(T callable)
         {
             destructionHandler = callable;
         }
 
+        CollisionMask GetCollisionTargetMask() const
+        {
+            return partition->TargetMask(slot);
+        }
+
+        CollisionMask GetCollisionSourceMask() const
+        {
+            return partition->SourceMask(slot);
+        }
+
     protected:
-        class GameServer& world;
-        class Stage& stage;
+        /** Sets the bounding rectangle relative to the position of the actor.
+          */
+        void SetShape(const Rect<s8>& shape)
+        {
+            partition->Shape(slot) = shape;
+        }
 
-    private:
-        Vector<s16> position;
-        // Store the current partition iterator for easy removal
-        // should only be modified by the World class
-        Partition::Iterator partitionIterator;
+        /** Actors flagged as hidden are skipped when building the command buffer.
+          */
+        void SetHidden(bool hidden)
+        {
+            u8& flags = partition->Flags(slot);
+            flags = hidden ? (flags | Partition::Hidden) : (flags & ~Partition::Hidden);
+        }
 
-        // This flag is used by the World class to schedule destruction of actors
-        bool shouldDestruct;
+        // The packed image of the actor. The image group is stored in the high nibble
+        // and the index within the group in the low one.
+        u8 GetImage() const
+        {
+            return partition->Image(slot);
+        }
 
-        // This flag is set whenever an actor has changed its position.
-        // used to indicate to the World main loop that it needs to check
-        // whether the actor needs to be moved to another partition.
-        bool positionDirty;
+        void SetImage(u8 image)
+        {
+            partition->Image(slot) = image;
+        }
+
+        class GameServer& world;
+        class Stage& stage;
 
+        // The partition holding the state of this actor and the slot it occupies in it.
+        // Only modified by the Partition class when the actor is added, moved or removed.
+        Partition* partition;
+        int slot;
+
+    private:
         // The index of the player that should be awarded points for destroying this object.
         // May be -1 if no player caused the destruction or if the object has not been destroyed.
         int killer;
 
-        // Specifies which collision layers this object can be the target of.
-        // Set this to 0 to make the object immune to collisions from other objects.
-        const CollisionMask collisionTargetMask;
-
-        // Specifies which layers this object can generate a collision events with.
-        const CollisionMask collisionSourceMask;
+        // Kept here as well as in the partition, as the actor may already have been
+        // removed from its partition when it is destructed.
+        u16 id;
 
         Callback<void()> destructionHandler;
         friend class GameServer;
         friend class PerfTester;
+        friend class Partition;
     };
 }
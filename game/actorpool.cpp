@@ -0,0 +1,94 @@
+#include "game/actorpool.h"
+
+#include <assert.h>
+
+using namespace hfh3;
+
+ActorPool::ActorPool()
+    : arena(blockSize)
+    , slabCount(0)
+#if !CONFIG_USE_ACTOR_POOL
+    , heapStatistics {0, 0, 0}
+#endif
+{
+}
+
+ActorPool& ActorPool::Instance()
+{
+    return instance;
+}
+
+int ActorPool::AddSlab(size_t size)
+{
+    assert(slabCount < maxSlabCount);
+    slabs[slabCount].Init(size, &arena);
+    return slabCount++;
+}
+
+#if CONFIG_USE_ACTOR_POOL
+
+void* ActorPool::Allocate(int slab, size_t size)
+{
+    // A class derived from one using ACTOR_POOL_ALLOCATED has to use it as well
+    assert(int(size) <= slabs[slab].GetObjectSize());
+    return slabs[slab].Allocate();
+}
+
+void ActorPool::Free(void* memory, int slab, size_t size)
+{
+    if(memory)
+    {
+        slabs[slab].Free(memory);
+    }
+}
+
+void ActorPool::Reset()
+{
+    for(int i = 0; i < slabCount; i++)
+    {
+        slabs[i].Reset();
+    }
+    arena.Reset();
+}
+
+ActorPool::Statistics ActorPool::GetStatistics() const
+{
+    Statistics result {0, 0, arena.GetBlockAllocations()};
+    for(int i = 0; i < slabCount; i++)
+    {
+        result.allocations += slabs[i].GetAllocations();
+        result.frees += slabs[i].GetFrees();
+    }
+    return result;
+}
+
+#else
+
+void* ActorPool::Allocate(int slab, size_t size)
+{
+    heapStatistics.allocations++;
+    heapStatistics.heapAllocations++;
+    return ::operator new(size);
+}
+
+void ActorPool::Free(void* memory, int slab, size_t size)
+{
+    if(memory)
+    {
+        heapStatistics.frees++;
+        ::operator delete(memory);
+    }
+}
+
+void ActorPool::Reset()
+{
+}
+
+ActorPool::Statistics ActorPool::GetStatistics() const
+{
+    return heapStatistics;
+}
+
+#endif
+
+ActorPool ActorPool::instance;
@@ -0,0 +1,94 @@
+#pragma once
+#include <circle/types.h>
+
+#include "util/arena.h"
+#include "util/slab.h"
+#include "config.h"
+
+namespace hfh3
+{
+    /** Provides the memory for all actors in a level.
+      * Each actor class gets its own slab, set up the first time an object of the class
+      * is allocated, so objects destroyed during a frame are reused by objects of the
+      * same class spawned later. Classes of the same size do not share slabs.
+      * See ACTOR_POOL_ALLOCATED in game/actor.h.
+      * All slabs share a per-level arena, which lets the memory of the whole
+      * level be reclaimed in constant time when the level is cleared.
+      * When CONFIG_USE_ACTOR_POOL is 0, allocations are forwarded to the default
+      * allocator, but are still counted.
+      */
+    class ActorPool
+    {
+    public:
+        static const int maxSlabCount = 8;
+        static const int blockSize = 32 * 1024;
+
+        struct Statistics
+        {
+            unsigned allocations;     // Actors allocated
+            unsigned frees;           // Actors freed individually
+            unsigned heapAllocations; // Allocations that had to go to the heap
+        };
+
+        static ActorPool& Instance();
+
+        /** Allocates and frees objects of the actor class T, whose size is passed in.
+          */
+        template<typename T>
+        void* Allocate(size_t size)
+        {
+            return Allocate(GetSlabIndex<T>(), size);
+        }
+
+        template<typename T>
+        void Free(void* memory, size_t size)
+        {
+            Free(memory, GetSlabIndex<T>(), size);
+        }
+
+        /** Reclaims the memory of all actors without calling Free on them.
+          * All actors have to be destructed before calling this.
+          */
+        void Reset();
+
+        /** Returns the counters accumulated since startup. Take the difference
+          * between two calls to get the allocation churn over a period.
+          */
+        Statistics GetStatistics() const;
+
+    private:
+        ActorPool();
+
+        // Returns the index of the slab of the actor class T, setting it up on first use
+        template<typename T>
+        int GetSlabIndex()
+        {
+            if(slabIndex<T> < 0)
+            {
+                slabIndex<T> = AddSlab(sizeof(T));
+            }
+            return slabIndex<T>;
+        }
+
+        int AddSlab(size_t size);
+        void* Allocate(int slab, size_t size);
+        void Free(void* memory, int slab, size_t size);
+
+        // The slab of each actor class, or -1 before the first object is allocated
+        template<typename T>
+        static int slabIndex;
+
+        Arena arena;
+        Slab slabs[maxSlabCount];
+        int slabCount;
+
+#if !CONFIG_USE_ACTOR_POOL
+        Statistics heapStatistics;
+#endif
+
+        static ActorPool instance;
+    };
+
+    template<typename T>
+    int ActorPool::slabIndex = -1;
+}
@@ -7,10 +7,32 @@
 
 #include "ui/minimap.h"
 
+#include "util/memops.h"
+#include "util/tmath.h"
+
 using namespace hfh3;
 
 
 static const u8 CLEAR_MAP_COLOR = 143;
+
+// The transparent color of the image sheet, used for empty cells of the cached layer
+static const u8 TRANSPARENT_COLOR = 255;
+
+// Number of cells kept around the view on each side in the cached layer, so the view
+// can move this far before any new cells have to be rendered.
+static const int CACHE_MARGIN = 2;
+
+/** Returns the smallest power of two not less than value.
+  */
+static int RoundUpToPowerOfTwo(int value)
+{
+    int result = 1;
+    while(result < value)
+    {
+        result <<= 1;
+    }
+    return result;
+}
 static const u8 GROUP_MAP_COLOR[16] = 
 {
    CLEAR_MAP_COLOR, // 0
@@ -35,6 +57,20 @@ Background::Background(World& inWorld, ImageSheet& inImageSheet, MiniMap* inMap)
     : width(inWorld.GetStage().GetWidth() / GRID_SCALE)
     , height(inWorld.GetStage().GetHeight() / GRID_SCALE)
     , grid(new Cell [width * height])
+    , cacheEnabled(CONFIG_BACKGROUND_CACHE)
+    , cacheValid(false)
+    , cacheViewSize()
+    , cacheCells()
+    , cacheWindow()
+    , cacheOrigin()
+    , cachePixels(nullptr)
+    , cacheParts {
+        Image(nullptr, 0, 0),
+        Image(nullptr, 0, 0),
+        Image(nullptr, 0, 0),
+        Image(nullptr, 0, 0),
+    }
+    , stats {0, 0}
     , starfield(inWorld)
     , imageSheet(inImageSheet)
     , map(inMap)
@@ -44,12 +80,32 @@ Background::Background(World& inWorld, ImageSheet& inImageSheet, MiniMap* inMap)
 Background::~Background()
 {
     delete [] grid;
+    delete [] cachePixels;
 }
 
 void Background::Draw(View& view)
 {
     starfield.Draw(view);
 
+    if(cacheEnabled)
+    {
+        DrawCached(view);
+    }
+    else
+    {
+        DrawCells(view);
+    }
+}
+
+void Background::SetCacheEnabled(bool enable)
+{
+    cacheEnabled = enable;
+    // The cells may have changed while the cache was not in use
+    cacheValid = false;
+}
+
+void Background::DrawCells(View& view)
+{
     Rect<s16> visible = view.GetVisibleRect();
     GridPosition start = WorldToGrid(visible.origin);
     int columCount = (visible.size.x + GRID_SCALE-1) / GRID_SCALE + 1;
@@ -64,17 +120,150 @@ void Background::Draw(View& view)
             if(GetCell(pos, group, image))
             {
                 view.DrawImage(GridToWorld(pos), imageSheet[group][image]);
+                // View::DrawImage draws the image at each of the places it can wrap to
+                stats.drawCalls += 4;
             }
         }
     }
 }
 
+void Background::DrawCached(View& view)
+{
+    Rect<s16> visible = view.GetVisibleRect();
+    const Vector<s16> stageMask(width * GRID_SCALE - 1, height * GRID_SCALE - 1);
+    visible.origin.x &= stageMask.x;
+    visible.origin.y &= stageMask.y;
+
+    // Size the layer to cover the view and the margin around it
+    Vector<s16> viewCells((visible.size.x + GRID_SCALE-1) / GRID_SCALE + 1,
+                          (visible.size.y + GRID_SCALE-1) / GRID_SCALE + 1);
+    if(cachePixels == nullptr || visible.size != cacheViewSize)
+    {
+        cacheViewSize = visible.size;
+        cacheWindow = Vector<s16>(Min(viewCells.x + 2 * CACHE_MARGIN, int(width)),
+                                  Min(viewCells.y + 2 * CACHE_MARGIN, int(height)));
+        cacheCells = Vector<s16>(RoundUpToPowerOfTwo(cacheWindow.x), RoundUpToPowerOfTwo(cacheWindow.y));
+        delete [] cachePixels;
+        cachePixels = new u8[cacheCells.x * cacheCells.y * GRID_SCALE * GRID_SCALE];
+        cacheValid = false;
+    }
+
+    // Move the layer when the view is no longer inside its window, leaving an
+    // equal margin on all sides.
+    GridPosition start = WorldToGrid(visible.origin);
+    int offsetX = (start.x - cacheOrigin.x) & (width - 1);
+    int offsetY = (start.y - cacheOrigin.y) & (height - 1);
+    if(!cacheValid || offsetX + viewCells.x > cacheWindow.x || offsetY + viewCells.y > cacheWindow.y)
+    {
+        MoveCache(GridPosition((start.x - (cacheWindow.x - viewCells.x) / 2) & (width - 1),
+                               (start.y - (cacheWindow.y - viewCells.y) / 2) & (height - 1)));
+    }
+
+    // The view starts at the same offset within the layer as within the stage. It is split
+    // into up to four parts where it crosses the edges of the layer.
+    const int layerWidth = cacheCells.x * GRID_SCALE;
+    const int layerHeight = cacheCells.y * GRID_SCALE;
+    const int left = visible.origin.x & (layerWidth - 1);
+    const int top = visible.origin.y & (layerHeight - 1);
+    const int widths[2] = { Min(int(visible.size.x), layerWidth - left), 0 };
+    const int heights[2] = { Min(int(visible.size.y), layerHeight - top), 0 };
+    const int lefts[2] = { left, 0 };
+    const int tops[2] = { top, 0 };
+    const int rightWidth = visible.size.x - widths[0];
+    const int bottomHeight = visible.size.y - heights[0];
+
+    ScreenManager& screen = view.GetScreen();
+    const Vector<s16> screenOrigin = screen.GetClip().origin;
+    int partCount = 0;
+    for(int row = 0; row < 2; row++)
+    {
+        int partHeight = row ? bottomHeight : heights[0];
+        for(int column = 0; column < 2; column++)
+        {
+            int partWidth = column ? rightWidth : widths[0];
+            if(partWidth <= 0 || partHeight <= 0)
+            {
+                continue;
+            }
+
+            // The parts are kept in members, as band rendering draws them after this returns
+            Image& part = cacheParts[partCount++];
+            part = Image(&cachePixels[tops[row] * layerWidth + lefts[column]], partWidth, partHeight, TRANSPARENT_COLOR, layerWidth);
+            screen.DrawImage(screenOrigin + Vector<s16>(column ? widths[0] : 0, row ? heights[0] : 0), part);
+        }
+    }
+    stats.drawCalls += partCount;
+}
+
+void Background::MoveCache(GridPosition origin)
+{
+    // Signed distance moved along each axis, taking the shortest way around the stage
+    int deltaX = ((origin.x - cacheOrigin.x + width / 2) & (width - 1)) - width / 2;
+    int deltaY = ((origin.y - cacheOrigin.y + height / 2) & (height - 1)) - height / 2;
+    bool keep = cacheValid && Abs(deltaX) < cacheWindow.x && Abs(deltaY) < cacheWindow.y;
+
+    for(int y = 0; y < cacheWindow.y; y++)
+    {
+        for(int x = 0; x < cacheWindow.x; x++)
+        {
+            // Only render the cells outside the previous window
+            int previousX = x + deltaX;
+            int previousY = y + deltaY;
+            if(keep && previousX >= 0 && previousX < cacheWindow.x && previousY >= 0 && previousY < cacheWindow.y)
+            {
+                continue;
+            }
+            RenderCacheCell((origin.x + x) & (width - 1), (origin.y + y) & (height - 1));
+        }
+    }
+    cacheOrigin = origin;
+    cacheValid = true;
+}
+
+void Background::RenderCacheCell(int x, int y)
+{
+    const int layerWidth = cacheCells.x * GRID_SCALE;
+    u8* dest = &cachePixels[((y & (cacheCells.y - 1)) * layerWidth + (x & (cacheCells.x - 1))) * GRID_SCALE];
+    const Cell& cell = grid[y * width + x];
+    if(cell.valid)
+    {
+        const Image& image = imageSheet[cell.imageGroup][cell.imageIndex];
+        for(int row = 0; row < GRID_SCALE; row++, dest += layerWidth)
+        {
+            memcpy(dest, image.GetPixelAddress(0, row), GRID_SCALE);
+        }
+    }
+    else
+    {
+        for(int row = 0; row < GRID_SCALE; row++, dest += layerWidth)
+        {
+            memset(dest, TRANSPARENT_COLOR, GRID_SCALE);
+        }
+    }
+    stats.cellsRendered++;
+}
+
+void Background::UpdateCacheCell(const GridPosition& pos)
+{
+    if(!cacheValid)
+    {
+        return;
+    }
+    int offsetX = (pos.x - cacheOrigin.x) & (width - 1);
+    int offsetY = (pos.y - cacheOrigin.y) & (height - 1);
+    if(offsetX < cacheWindow.x && offsetY < cacheWindow.y)
+    {
+        RenderCacheCell(pos.x, pos.y);
+    }
+}
+
 void Background::Clear()
 {
     for(Cell* item = grid; item < grid + (width*height); item++)
     {
         item->valid = false;
     }
+    cacheValid = false;
     if (map)
     {
         map->Clear(CLEAR_MAP_COLOR);
@@ -85,6 +274,7 @@ void Background::ClearCell(GridPosition pos)
 {
     int cell = GetCellIndex(pos);
     grid[cell].valid = false;
+    UpdateCacheCell(pos);
     map->Plot(pos, CLEAR_MAP_COLOR);
 }
 
@@ -92,6 +282,7 @@ void Background::SetCell(GridPosition pos, u8 group, u8 index)
 {
     int cell = GetCellIndex(pos);
     grid[cell] = {true, group, index};
+    UpdateCacheCell(pos);
     map->Plot(pos, GROUP_MAP_COLOR[group]);
 }
 
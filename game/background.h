@@ -2,6 +2,8 @@
 #include "game/starfield.h"
 #include "util/vector.h"
 #include "util/rect.h"
+#include "render/image.h"
+#include "config.h"
 
 namespace hfh3
 {
@@ -37,6 +39,27 @@ namespace hfh3
 
         void Draw(class View& view);
 
+        /** Draws only the given percentage of the stars of the star field. */
+        void SetStarDensity(int percent) { starfield.SetDensity(percent); }
+
+        /** Selects whether the grid is drawn from a cached layer, or by drawing each
+          * visible cell every frame. See CONFIG_BACKGROUND_CACHE.
+          */
+        void SetCacheEnabled(bool enable);
+        bool IsCacheEnabled() const { return cacheEnabled; }
+
+        /** Work done drawing the grid since the last call to ClearStatistics,
+          * not counting the star field.
+          */
+        struct Statistics
+        {
+            int drawCalls;     // Calls made to ScreenManager::DrawImage
+            int cellsRendered; // Cells copied into the cached layer
+        };
+
+        const Statistics& GetStatistics() const { return stats; }
+        void ClearStatistics() { stats = {0, 0}; }
+
         void Clear();
         void ClearCell(GridPosition pos);
         void SetCell(GridPosition pos, u8 group, u8 index);
@@ -59,6 +82,28 @@ namespace hfh3
 
     private:
 
+        /** Draws each visible cell to the screen.
+          */
+        void DrawCells(class View& view);
+
+        /** Draws the visible part of the cached layer, after moving it to cover the view.
+          */
+        void DrawCached(class View& view);
+
+        /** Moves the cached layer to start at the grid position passed in, and renders
+          * the cells that were not covered by it before.
+          */
+        void MoveCache(GridPosition origin);
+
+        /** Copies a cell into its place in the cached layer. The position must be
+          * within the grid.
+          */
+        void RenderCacheCell(int x, int y);
+
+        /** Re-renders a cell of the cached layer if the layer covers it.
+          */
+        void UpdateCacheCell(const GridPosition& pos);
+
         int GetCellIndex(GridPosition& pos) const
         {
             pos.x %= width;
@@ -81,6 +126,22 @@ namespace hfh3
 
         s16 width, height;
         Cell* grid;
+
+        // The cached layer is a ring buffer of cacheCells cells, indexed by the grid
+        // position modulo its size. As the sizes of the grid and the layer are both
+        // powers of two, the cells on both sides of the wrap around edge of the stage
+        // have separate places in it. Only the cells within the window starting at
+        // cacheOrigin and covering cacheWindow cells are up to date.
+        bool cacheEnabled;
+        bool cacheValid;
+        Vector<s16> cacheViewSize; // The size of the view the layer was sized for
+        Vector<s16> cacheCells;
+        Vector<s16> cacheWindow;
+        GridPosition cacheOrigin;
+        u8* cachePixels;
+        Image cacheParts[4];       // The parts of the layer drawn in the current frame
+        Statistics stats;
+
         Starfield starfield;
         class ImageSheet& imageSheet;
         class MiniMap* map;
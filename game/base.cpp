@@ -32,6 +32,10 @@ Base::Base(GameServer& inWorld, Vector<s16> position, bool inCore) :
     delay(60)
 {
     SetPosition(position);
+
+    // The drawing of bases is handled by the background class
+    SetHidden(true);
+    UpdateBounds();
 }
 
 void Base::Update() 
@@ -133,7 +137,7 @@ void Base::Spawn(Action type)
         }
     }
 
-    delay = (Rand()%240)+30;
+    delay = ((Rand()%240)+30) * world.GetSimulationQuality().spawnDelayScale;
     delayAction = type;
 }
 
@@ -167,7 +171,7 @@ void Base::Destroy(Action type)
         needsUpdate.Push(west);
         neigbourMask |= 8;
     }
-    world.SpawnExplosion(GetPosition(), MaskToDirection(neigbourMask), 2);
+    world.SpawnEffectExplosion(GetPosition(), MaskToDirection(neigbourMask), 2);
 
     for(Base* base : needsUpdate)
     {
@@ -182,6 +186,7 @@ void Base::Destroy(Action type)
         {
             base->UpdateShape();
         }
+        base->UpdateBounds();
     }
 }
 
@@ -210,6 +215,7 @@ void Base::UpdateShape()
     {
         delayAction = SpawnShot;
     }
+    UpdateBounds();
 }
 
 
@@ -280,6 +286,8 @@ Base* Base::CreateNeighbor(Direction dir)
         default:
             assert(1); // Invalid direction
     }
+    UpdateBounds();
+    other->UpdateBounds();
     world.AddBase(other);
     return other;
 }
@@ -358,21 +366,15 @@ void Base::CreateFort(GameServer& server, const Rect<s16>& area)
 
 }
 
-/** The drawing of bases is handled by the background class
- */
-void Base::Draw(class CommandList&)
-{
-
-}
-
 // The bounds of a base object are determined by the number of connections
-// and whether it is destructible.
-Rect<s16> Base::GetBounds()
+// and whether it is destructible. Called whenever either of them changes.
+void Base::UpdateBounds()
 {
-    Rect<s16> result {GetPosition(), {16,16}};
+    Rect<s8> result {0, 0, 16, 16};
     if(destructible)
     {
-        return result;
+        SetShape(result);
+        return;
     }
 
     if( !east )
@@ -396,5 +398,5 @@ Rect<s16> Base::GetBounds()
         result.origin.y += 1;
         result.size.y   -= 1;
     }
-    return result;
+    SetShape(result);
 }
@@ -9,12 +9,12 @@ namespace hfh3
     class Base : public Actor
     {
     public:
+        ACTOR_POOL_ALLOCATED(Base)
+
         Base(class GameServer& inWorld, Vector<s16> position, bool inCore = true);
 
 
         virtual void Update() override;
-        virtual void Draw(class CommandList& commands) override;
-        virtual Rect<s16> GetBounds() override;
 
         virtual int GetScore() const override
         {
@@ -35,6 +35,7 @@ namespace hfh3
         void Destroy(Action type);
         void Spawn(Action type);
         void UpdateShape();
+        void UpdateBounds();
         int EdgeCount();
         Direction MaskToDirection(u8 mask);
         Base* CreateNeighbor(Direction dir);
@@ -0,0 +1,124 @@
+#include "game/broadphase.h"
+#include "game/actor.h"
+
+#include <circle/util.h>
+#include <assert.h>
+
+using namespace hfh3;
+
+Broadphase::Broadphase(const Vector<s16>& inStageSize, int inMaxActorSize)
+    : stageSize(inStageSize)
+    , maxActorSize(inMaxActorSize)
+    , cellSize(inMaxActorSize * 2)
+    , cellCount(inStageSize / cellSize)
+    , cellMask(cellCount.x - 1, cellCount.y - 1)
+{
+    // The cell lookups rely on the cell count being a power of two and the query
+    // range of a source never reaching the same cell twice.
+    assert(cellCount.x >= 2 && (cellCount.x & cellMask.x) == 0);
+    assert(cellCount.y >= 2 && (cellCount.y & cellMask.y) == 0);
+
+    cellStart.Grow(cellCount.x * cellCount.y + 1);
+}
+
+void Broadphase::Clear()
+{
+    sources.ClearFast();
+    targets.ClearFast();
+    targetCells.ClearFast();
+}
+
+void Broadphase::AddTarget(Actor* actor, const Rect<s16>& bounds, CollisionMask mask)
+{
+    assert(bounds.size.x <= maxActorSize && bounds.size.y <= maxActorSize);
+    targets.Append(Entry {bounds, mask, actor});
+    targetCells.Append(CellY(bounds.origin.y) * cellCount.x + CellX(bounds.origin.x));
+}
+
+void Broadphase::AddSource(Actor* actor, const Rect<s16>& bounds, CollisionMask mask)
+{
+    sources.Append(Entry {bounds, mask, actor});
+}
+
+void Broadphase::SortTargets()
+{
+    int numCells = cellCount.x * cellCount.y;
+    int numTargets = targets.Size();
+    int* start = cellStart;
+    const int* cells = targetCells;
+
+    // Count the targets in each cell and turn the counts into the index one
+    // past the last target of the cell.
+    memset(start, 0, sizeof(int) * (numCells + 1));
+    for(int i = 0; i < numTargets; i++)
+    {
+        start[cells[i]]++;
+    }
+    for(int cell = 1; cell <= numCells; cell++)
+    {
+        start[cell] += start[cell-1];
+    }
+
+    // Place the targets walking backwards, which leaves each entry in
+    // cellStart pointing at the first target of the cell.
+    sortedTargets.ClearFast();
+    Entry* sorted = sortedTargets.Grow(numTargets);
+    const Entry* unsorted = targets;
+    for(int i = numTargets - 1; i >= 0; i--)
+    {
+        sorted[--start[cells[i]]] = unsorted[i];
+    }
+}
+
+const Array<Broadphase::Pair>& Broadphase::FindPairs()
+{
+    SortTargets();
+
+    const int* start = cellStart;
+    const Entry* sorted = sortedTargets;
+    const Entry* source = sources;
+    int numSources = sources.Size();
+
+    // Collect candidates from all cells that can contain the origin of a target
+    // overlapping the source, only looking at the collision masks.
+    candidates.ClearFast();
+    for(int s = 0; s < numSources; s++, source++)
+    {
+        const Rect<s16>& bounds = source->bounds;
+        int x1 = CellX(bounds.Left() - maxActorSize + 1);
+        int y1 = CellY(bounds.Top() - maxActorSize + 1);
+        int columns = ((CellX(bounds.Right() - 1) - x1) & cellMask.x) + 1;
+        int rows = ((CellY(bounds.Bottom() - 1) - y1) & cellMask.y) + 1;
+
+        for(int row = 0; row < rows; row++)
+        {
+            int rowStart = ((y1 + row) & cellMask.y) * cellCount.x;
+            for(int column = 0; column < columns; column++)
+            {
+                int cell = rowStart + ((x1 + column) & cellMask.x);
+                for(int t = start[cell]; t < start[cell+1]; t++)
+                {
+                    if(source->mask & sorted[t].mask)
+                    {
+                        candidates.Append(Candidate {s, t});
+                    }
+                }
+            }
+        }
+    }
+
+    // Test the bounds of all candidates.
+    pairs.ClearFast();
+    Entry* sourceEntries = sources;
+    Entry* targetEntries = sortedTargets;
+    for(const Candidate& candidate : candidates)
+    {
+        Entry& a = sourceEntries[candidate.source];
+        const Entry& b = targetEntries[candidate.target];
+        if(a.actor != b.actor && a.bounds.OverlapsMod(b.bounds, stageSize))
+        {
+            pairs.Append(Pair {a.actor, b.actor});
+        }
+    }
+    return pairs;
+}
@@ -0,0 +1,90 @@
+#pragma once
+#include <circle/types.h>
+
+#include "util/array.h"
+#include "util/rect.h"
+#include "util/vector.h"
+#include "game/collisionmask.h"
+
+namespace hfh3
+{
+    /** Finds pairs of actors that may collide during a frame.
+      * Collision targets are binned into a grid of cells twice the size of the
+      * largest actor, so each source only needs to visit the 2x2 cells its bounds
+      * can reach. The grid wraps around the edges of the stage like actor positions do.
+      * The targets are sorted into their cells with a counting sort each frame, so
+      * there are no per cell lists to maintain as actors move around.
+      */
+    class Broadphase
+    {
+    public:
+        struct Pair
+        {
+            class Actor* source;
+            class Actor* target;
+        };
+
+        Broadphase(const Vector<s16>& inStageSize, int inMaxActorSize);
+
+        /** Removes the sources and targets added for the previous frame.
+          */
+        void Clear();
+
+        /** Adds an actor that other actors can collide with.
+          * The width and height of the bounds must not exceed the max actor size.
+          */
+        void AddTarget(class Actor* actor, const Rect<s16>& bounds, CollisionMask mask);
+
+        /** Adds an actor that generates collision events with targets.
+          */
+        void AddSource(class Actor* actor, const Rect<s16>& bounds, CollisionMask mask);
+
+        /** Returns all pairs of sources and targets with matching collision masks and
+          * overlapping bounds. The pairs are grouped by source in the order they were added.
+          * First a batch of candidates is collected by testing the collision masks of
+          * the sources against the targets in the nearby cells. Then the bounds of all the
+          * candidates are tested in a separate pass.
+          */
+        const Array<Pair>& FindPairs();
+
+        // Statistics from the last call to FindPairs
+        int GetCandidateCount() const { return candidates.Size(); }
+        int GetPairCount() const { return pairs.Size(); }
+
+    private:
+        struct Entry
+        {
+            Rect<s16> bounds;
+            CollisionMask mask;
+            class Actor* actor;
+        };
+
+        struct Candidate
+        {
+            int source;
+            int target;
+        };
+
+        // Returns the cell coordinate of a stage coordinate. Handles coordinates
+        // up to one stage size outside the stage.
+        int CellX(int x) const { return ((x + stageSize.x) / cellSize) & cellMask.x; }
+        int CellY(int y) const { return ((y + stageSize.y) / cellSize) & cellMask.y; }
+
+        void SortTargets();
+
+        const Vector<s16> stageSize;
+        const int maxActorSize;
+        const int cellSize;
+        const Vector<s16> cellCount;
+        const Vector<s16> cellMask;
+
+        Array<Entry> sources;
+        Array<Entry> targets;       // Targets in the order they were added
+        Array<int>   targetCells;   // The cell index of each entry in targets
+        Array<Entry> sortedTargets; // Targets ordered by cell index
+        Array<int>   cellStart;     // Index of the first sorted target in each cell, plus one past the last cell
+
+        Array<Candidate> candidates;
+        Array<Pair> pairs;
+    };
+}
@@ -14,56 +14,6 @@
 
 namespace hfh3 {
 
-struct CommandContext 
-{
-    ImageSheet& imageSheet;
-    View& view;
-    Background& backround;
-    MessageOverlay* overlay;
-    MiniMap* map;
-};
-
-// Representation of game coordinates, which can be packed into
-// 12 bits per component, or 3 bytes.
-class VectorU12 
-    : public Vector<s16>
-    , public ISerializable
-{
-public:
-    template<typename T>
-    VectorU12(const Vector<T>& other)
-        : Vector<s16>(other)
-    {}
-
-    VectorU12()
-    {}
-
-    template<typename T>
-    operator Vector<T>()
-    {
-        return Vector<T>(static_cast<Vector<s16>>(*this));
-    }
-
-    virtual void Serialize(ISerializer& serializer) override 
-    {
-        u8 tmp[3];
-        if (serializer.GetDirection() == ISerializer::Output)
-        {
-            tmp[0] = x & 0xff;
-            tmp[1] = (x >> 4) & 0xf0;
-            tmp[1] |= y & 0x0f;
-            tmp[2] = (y >> 4) & 0xff;
-        }
-
-        serializer.Serialize(tmp, 3);
-        if (serializer.GetDirection() == ISerializer::Input)
-        {
-            x = tmp[0] | ((tmp[1] & 0xf0) << 4);
-            y = (tmp[1] & 0x0f) | (tmp[2] << 4);
-        }
-    }
-};
-
 enum class Opcode : u8
 {
     SetViewOffset,
@@ -74,508 +24,538 @@ enum class Opcode : u8
     ClearBackgroundCell,
     SetPlayerStat,
     SetMessage,
+    ClearSprites,
+    CreateSprite,
+    MoveSprite,
+    SetSpritePosition,
+    SetSpriteImage,
+    DestroySprite,
+    DrawSprites,
+    OpcodeCount,
     FrameStart = 0xff
 };
 
-struct Command : public ISerializable
+// The number of argument bytes following each opcode in the buffer.
+static const int argumentSize[int(Opcode::OpcodeCount)] =
 {
-    Command(Opcode inOp)
-        : opcode(inOp)
-    {}
-
-    virtual ~Command()
-    {}
-
-    virtual void Run(CommandContext& context) = 0;
-    virtual void Serialize(ISerializer& serializer) override 
-    {
-        if(serializer.GetDirection() == ISerializer::Output)
-        {
-            Opcode tmp = opcode;
-            hfh3::Serialize(serializer, tmp);
-        }
-        // We assume when deserializing that the opcode has already been read from the 
-        // stream.
-    }
-
-    static Command* Parse(ArrayReader&);
-
-    const Opcode opcode;
+    3, // SetViewOffset:       VectorU12 position
+    0, // DrawBackground
+    4, // DrawSprite:          VectorU12 position, u8 image
+    6, // SetPlayerPositions:  VectorU12 player0, VectorU12 player1
+    3, // SetBackgroundCell:   u8 x, u8 y, u8 image
+    2, // ClearBackgroundCell: u8 x, u8 y
+    5, // SetPlayerStat:       u8 stat, s32 value
+    5, // SetMessage:          u8 message, s16 level, s16 timeout
+    0, // ClearSprites
+    6, // CreateSprite:        u16 id, VectorU12 position, u8 image
+    3, // MoveSprite:          u16 id, s4 dx, s4 dy
+    5, // SetSpritePosition:   u16 id, VectorU12 position
+    3, // SetSpriteImage:      u16 id, u8 image
+    2, // DestroySprite:       u16 id
+    0, // DrawSprites
 };
 
-struct FrameStart : public Command
-{
-    FrameStart(s32 inSize = -1)
-        : Command(Opcode::FrameStart)
-        , size(inSize)
-    {}
-
-    virtual void Run(CommandContext& context) override
-    {
-        assert(0);
-    }
+// The frame header consists of the FrameStart opcode and the s32 byte size of the frame.
+static const int frameHeaderSize = 1 + sizeof(s32);
 
-    virtual void Serialize(ISerializer& serializer) override 
-    {
-        Command::Serialize(serializer);
-        hfh3::Serialize(serializer, size);
-    }
-
-    void PatchSize(Array<u8>& array, s32 newSize)
-    {
-
-        // Read the existing value. Will assert if the array does not start with a 
-        // FrameStart object.
-        FrameStart existing;
-        Opcode op;
-        ArrayReader reader(array);
-        hfh3::Serialize(reader, op);
-        assert(op == Opcode::FrameStart);
-        existing.Serialize(reader);
-
-        // Assert we are modifying our own value
-        assert(existing.size == size);
-
-        // Update the value in the local copy and serialize it to a temporary array
-        size = newSize;
-        Array<u8> tmp;
-        ArrayWriter writer(tmp);
-        Serialize(writer);
-
-        // Overwrite the header with the updated value
-        memcpy((u8*)array, (u8*)tmp, tmp.Size());
-
-    }
-
-    s32 size;
-};
-
-struct SetViewOffset : public Command
+enum PlayerStat
 {
-    SetViewOffset()
-        : Command(Opcode::SetViewOffset)
-    {}
-
-    SetViewOffset(const Vector<s16>& inPosition)
-        : Command(Opcode::SetViewOffset)
-        , position(inPosition)
-    {}
-
-    virtual void Run(CommandContext& context) override
-    {
-        context.view.SetOffset(position);
-    }
-
-    virtual void Serialize(ISerializer& serializer) override 
-    {
-        Command::Serialize(serializer);
-        hfh3::Serialize(serializer, position);
-    }
-
-    // We use VectorU12 as view offset coordinates can be packed into 12 bits per component
-    VectorU12 position; 
+    Score = 0,
+    Lives = 16,
 };
 
-void CommandList::SetViewOffset(const Vector<s16>& position)
+// Game coordinates can be packed into 12 bits per component, or 3 bytes.
+static inline u8* EncodeU12(u8* dest, const Vector<s16>& v)
 {
-    commands.Append(new hfh3::SetViewOffset(position));
+    dest[0] = v.x & 0xff;
+    dest[1] = ((v.x >> 4) & 0xf0) | (v.y & 0x0f);
+    dest[2] = (v.y >> 4) & 0xff;
+    return dest + 3;
 }
 
-struct DrawBackground : public Command
+static inline const u8* DecodeU12(const u8* src, Vector<s16>& v)
 {
-    DrawBackground()
-        : Command(Opcode::DrawBackground)
-    {}
-
-    virtual void Run(CommandContext& context) override
-    {
-        context.backround.Draw(context.view);
-    }
-};
+    v.x = src[0] | ((src[1] & 0xf0) << 4);
+    v.y = (src[1] & 0x0f) | (src[2] << 4);
+    return src + 3;
+}
 
-void CommandList::DrawBackground()
+// Small offsets are packed into a signed nibble per component.
+static inline u8 EncodeS4(const Vector<s16>& v)
 {
-    commands.Append(new hfh3::DrawBackground());
+    assert(v.x >= -8 && v.x < 8 && v.y >= -8 && v.y < 8);
+    return ((v.x & 0xf) << 4) | (v.y & 0xf);
 }
 
+static inline Vector<s16> DecodeS4(u8 packed)
+{
+    // Shifting the nibble to the top of a signed byte and back sign extends it
+    return Vector<s16>(s8(packed) >> 4, s8(packed << 4) >> 4);
+}
 
-struct DrawSprite : public Command
+static inline u8 PackImage(u8 imageGroup, u8 subImage)
 {
-    DrawSprite()
-        : Command(Opcode::DrawSprite)
-    {}
+    return (imageGroup<<4) | (subImage&0xF);
+}
 
-    DrawSprite(const Vector<s16>& inPosition, u8 imageGroup, u8 subImage)
-        : Command(Opcode::DrawSprite)
-        , position(inPosition)
-        , image((imageGroup<<4) | (subImage&0xF))
-    {}
+CommandList::CommandList(ImageSheet& inImageSheet)
+    : imageSheet(inImageSheet)
+    , received(receiveBufferSize)
+    , acquired(0)
+    , droppedFrames(0)
+    , repeatedFrames(0)
+{
+    Clear();
+}
 
-    virtual void Run(CommandContext& context) override
-    {
-        context.view.DrawImage(position, context.imageSheet[image >> 4][image & 0xF]);
-    }
+u8* CommandList::Append(Opcode op)
+{
+    u8* dest = buffer.Grow(1 + argumentSize[int(op)]);
+    *dest = u8(op);
+    return dest + 1;
+}
 
-    virtual void Serialize(ISerializer& serializer) override 
-    {
-        Command::Serialize(serializer);
-        hfh3::Serialize(serializer, position);
-        hfh3::Serialize(serializer, image);
-    }
+void CommandList::SetViewOffset(const Vector<s16>& position)
+{
+    EncodeU12(Append(Opcode::SetViewOffset), position);
+}
 
-    // We use VectorU12 as view offset coordinates can be packed into 12 bits per component
-    VectorU12 position;
-    u8 image;
-};
+void CommandList::DrawBackground()
+{
+    Append(Opcode::DrawBackground);
+}
 
 void CommandList::DrawSprite(const Vector<s16>& position, u8 imageGroup, u8 subImage)
 {
-    commands.Append(new hfh3::DrawSprite(position, imageGroup, subImage));
+    u8* dest = EncodeU12(Append(Opcode::DrawSprite), position);
+    *dest = PackImage(imageGroup, subImage);
 }
 
-struct SetPlayerPositions : public Command
+void CommandList::DrawSprite(const Vector<s16>& position, u8 packedImage)
 {
-    SetPlayerPositions()
-        : Command(Opcode::SetPlayerPositions)
-    {}
-
-    SetPlayerPositions(const Vector<s16>& p0, const Vector<s16>& p1)
-        : Command(Opcode::SetPlayerPositions)
-        , player0(p0)
-        , player1(p1)
-    {}
-
-    virtual void Run(CommandContext& context) override
-    {
-        context.map->SetPlayerPosition(0, player0);
-        context.map->SetPlayerPosition(1, player1);
-    }
-
-    virtual void Serialize(ISerializer& serializer) override 
-    {
-        Command::Serialize(serializer);
-        hfh3::Serialize(serializer, player0);
-        hfh3::Serialize(serializer, player1);
-    }
-
-    // We use VectorU12 as game pixel coordinates can be packed into 12 bits per component
-    VectorU12 player0;
-    VectorU12 player1;
-};
+    u8* dest = EncodeU12(Append(Opcode::DrawSprite), position);
+    *dest = packedImage;
+}
 
 void CommandList::SetPlayerPositions(const Vector<s16>& p0, const Vector<s16>& p1)
 {
-    commands.Append(new hfh3::SetPlayerPositions(p0, p1));
+    EncodeU12(EncodeU12(Append(Opcode::SetPlayerPositions), p0), p1);
 }
 
-struct SetBackgroundCell : public Command
+void CommandList::SetBackgroundCell(const Vector<u8>& pos, u8 imageGroup, u8 subImage)
 {
-    SetBackgroundCell()
-        : Command(Opcode::SetBackgroundCell)
-    {}
-
-    SetBackgroundCell(const Vector<u8>& inPosition, u8 imageGroup, u8 subImage)
-        : Command(Opcode::SetBackgroundCell)
-        , position(inPosition)
-        , image((imageGroup<<4) | (subImage&0xF))
-    {}
+    u8* dest = Append(Opcode::SetBackgroundCell);
+    dest[0] = pos.x;
+    dest[1] = pos.y;
+    dest[2] = PackImage(imageGroup, subImage);
+}
 
-    virtual void Run(CommandContext& context) override
-    {
-        context.backround.SetCell(position, image >> 4, image & 0xF);
-    }
+void CommandList::ClearBackgroundCell(const Vector<u8>& pos)
+{
+    u8* dest = Append(Opcode::ClearBackgroundCell);
+    dest[0] = pos.x;
+    dest[1] = pos.y;
+}
 
-    virtual void Serialize(ISerializer& serializer) override 
-    {
-        Command::Serialize(serializer);
-        hfh3::Serialize(serializer, position);
-        hfh3::Serialize(serializer, image);
-    }
+void CommandList::SetPlayerScore(u8 player, s32 score)
+{
+    u8* dest = Append(Opcode::SetPlayerStat);
+    *dest = Score | player;
+    Encode(dest + 1, score);
+}
 
-    Vector<u8> position;
-    u8 image;
-};
+void CommandList::SetPlayerLives(u8 player, s32 lives)
+{
+    u8* dest = Append(Opcode::SetPlayerStat);
+    *dest = Lives | player;
+    Encode(dest + 1, lives);
+}
 
-void CommandList::SetBackgroundCell(const Vector<u8>& pos, u8 imageGroup, u8 subImage)
+void CommandList::SetMessage(Message message, s16 level, s16 timeout)
 {
-    commands.Append(new hfh3::SetBackgroundCell(pos, imageGroup, subImage));
+    Encode(Encode(Encode(Append(Opcode::SetMessage), message), level), timeout);
 }
 
-struct ClearBackgroundCell : public Command
+void CommandList::ClearSprites()
 {
-    ClearBackgroundCell()
-        : Command(Opcode::ClearBackgroundCell)
-    {}
+    Append(Opcode::ClearSprites);
+}
 
-    ClearBackgroundCell(const Vector<u8>& inPosition)
-        : Command(Opcode::ClearBackgroundCell)
-        , position(inPosition)
-    {}
+void CommandList::CreateSprite(u16 id, const Vector<s16>& position, u8 packedImage)
+{
+    u8* dest = EncodeU12(Encode(Append(Opcode::CreateSprite), id), position);
+    *dest = packedImage;
+}
 
-    virtual void Run(CommandContext& context) override
-    {
-        context.backround.ClearCell(position);
-    }
+void CommandList::MoveSprite(u16 id, const Vector<s16>& delta)
+{
+    u8* dest = Encode(Append(Opcode::MoveSprite), id);
+    *dest = EncodeS4(delta);
+}
 
-    virtual void Serialize(ISerializer& serializer) override 
-    {
-        Command::Serialize(serializer);
-        hfh3::Serialize(serializer, position);
-    }
+void CommandList::SetSpritePosition(u16 id, const Vector<s16>& position)
+{
+    EncodeU12(Encode(Append(Opcode::SetSpritePosition), id), position);
+}
 
-    Vector<u8> position;
-};
+void CommandList::SetSpriteImage(u16 id, u8 packedImage)
+{
+    u8* dest = Encode(Append(Opcode::SetSpriteImage), id);
+    *dest = packedImage;
+}
 
+void CommandList::DestroySprite(u16 id)
+{
+    Encode(Append(Opcode::DestroySprite), id);
+}
 
-void CommandList::ClearBackgroundCell(const Vector<u8>& pos)
+void CommandList::DrawSprites()
 {
-    commands.Append(new hfh3::ClearBackgroundCell(pos));
+    Append(Opcode::DrawSprites);
 }
 
-struct SetPlayerStat : public Command
+CommandList::Sprite* CommandList::FindSprite(u16 id)
 {
-    enum PlayerStat
+    if(id >= sprites.Size() || sprites[id].index < 0)
     {
-        Score = 0,
-        Lives = 16,
-    };
-
-    SetPlayerStat()
-        : Command(Opcode::SetPlayerStat)
-    {}
-
-    SetPlayerStat(u8 player, PlayerStat which, s32 inValue)
-        : Command(Opcode::SetPlayerStat)
-        , stat(which | player)
-        , value(inValue)
-    {}
+        ERROR("Unknown sprite id %u", id);
+        return nullptr;
+    }
+    return &sprites[id];
+}
 
-    virtual void Run(CommandContext& context) override
+void CommandList::Run(class View& view, Background& background,
+                      MessageOverlay* overlay, MiniMap* map)
+{
+    unsigned newest = received.Acquire();
+    if(newest == 0)
     {
-        switch (stat & 0xf0)
-        {
-            case Score:
-            context.map->SetPlayerScore(stat &0x0f, value);
-            break;
-            case Lives:
-            context.map->SetPlayerLives(stat &0x0f, value);
-            break;
-            default:
-            assert(!"Unknown Stat");
-            break;
-        }
+        // Nothing has been received, so run the locally built frame
+        const u8* start = buffer;
+        Execute(start + frameHeaderSize, start + buffer.Size(), view, background, overlay, map, true);
+        return;
     }
 
-    virtual void Serialize(ISerializer& serializer) override 
+    int size;
+    const u8* frame;
+    bool redraw = newest == acquired;
+    if(redraw)
     {
-        Command::Serialize(serializer);
-        hfh3::Serialize(serializer, stat);
-        hfh3::Serialize(serializer, value);
+        repeatedFrames++;
+    }
+    else
+    {
+        // Each frame redraws the whole view, so only the newest one needs to be drawn.
+        // The ones skipped may still contain background and status updates.
+        for(unsigned sequence = acquired; sequence != newest - 1; sequence++)
+        {
+            frame = received.GetFrame(sequence, size);
+            Execute(frame + frameHeaderSize, frame + size, view, background, overlay, map, false);
+            droppedFrames++;
+        }
+        received.Release(newest - 1);
+        acquired = newest;
     }
 
-    u8 stat;
-    s32 value;
-};
-
-void CommandList::SetPlayerScore(u8 player, s32 score)
-{
-    commands.Append(new hfh3::SetPlayerStat(player, SetPlayerStat::Score, score));
+    frame = received.GetFrame(newest - 1, size);
+    Execute(frame + frameHeaderSize, frame + size, view, background, overlay, map, true, redraw);
 }
 
-void CommandList::SetPlayerLives(u8 player, s32 lives)
+void CommandList::Execute(const u8* read, const u8* end, class View& view, Background& background,
+                          MessageOverlay* overlay, MiniMap* map, bool draw, bool redraw)
 {
-    commands.Append(new hfh3::SetPlayerStat(player, SetPlayerStat::Lives, lives));
-}
+    while(read < end)
+    {
+        Opcode op = Opcode(*read++);
+        if(op >= Opcode::OpcodeCount || read + argumentSize[int(op)] > end)
+        {
+            ERROR("Invalid command index %x", (u8)op);
+            break;
+        }
 
-struct SetMessage : public Command
-{
-    SetMessage()
-        : Command(Opcode::SetMessage)
-    {}
+        // Runs of DrawSprite commands are collected and drawn together
+        if(op != Opcode::DrawSprite && blits.Size() > 0)
+        {
+            FlushBlits(view);
+        }
 
-    SetMessage(Message inMessage, s16 inLevel, s16 inTimeout)
-        : Command(Opcode::SetMessage)
-        , message(inMessage)
-        , level(inLevel)
-        , timeout(inTimeout)
-    {}
+        switch(op)
+        {
+            case Opcode::SetViewOffset:
+            {
+                Vector<s16> position;
+                read = DecodeU12(read, position);
+                if(draw)
+                {
+                    view.SetOffset(position);
+                }
+                break;
+            }
+            case Opcode::DrawBackground:
+            {
+                if(draw)
+                {
+                    background.Draw(view);
+                }
+                break;
+            }
+            case Opcode::DrawSprite:
+            {
+                Vector<s16> position;
+                read = DecodeU12(read, position);
+                u8 image = *read++;
+                if(draw)
+                {
+                    blits.Append(View::Blit {position, &imageSheet[image >> 4][image & 0xF]});
+                }
+                break;
+            }
+            case Opcode::SetPlayerPositions:
+            {
+                Vector<s16> player0, player1;
+                read = DecodeU12(DecodeU12(read, player0), player1);
+                map->SetPlayerPosition(0, player0);
+                map->SetPlayerPosition(1, player1);
+                break;
+            }
+            case Opcode::SetBackgroundCell:
+            {
+                Vector<u8> position(read[0], read[1]);
+                u8 image = read[2];
+                read += 3;
+                background.SetCell(position, image >> 4, image & 0xF);
+                break;
+            }
+            case Opcode::ClearBackgroundCell:
+            {
+                Vector<u8> position(read[0], read[1]);
+                read += 2;
+                background.ClearCell(position);
+                break;
+            }
+            case Opcode::SetPlayerStat:
+            {
+                u8 stat = *read++;
+                s32 value;
+                read = Decode(read, value);
+                switch (stat & 0xf0)
+                {
+                    case Score:
+                    map->SetPlayerScore(stat &0x0f, value);
+                    break;
+                    case Lives:
+                    map->SetPlayerLives(stat &0x0f, value);
+                    break;
+                    default:
+                    assert(!"Unknown Stat");
+                    break;
+                }
+                break;
+            }
+            case Opcode::SetMessage:
+            {
+                Message message;
+                s16 level, timeout;
+                read = Decode(Decode(Decode(read, message), level), timeout);
+                overlay->SetMessage(message, level, timeout);
+                break;
+            }
+            case Opcode::ClearSprites:
+            {
+                if(!redraw)
+                {
+                    for(u16 id : liveSprites)
+                    {
+                        sprites[id].index = -1;
+                    }
+                    liveSprites.ClearFast();
+                }
+                break;
+            }
+            case Opcode::CreateSprite:
+            {
+                u16 id;
+                Vector<s16> position;
+                read = DecodeU12(Decode(read, id), position);
+                u8 image = *read++;
+                if(redraw)
+                {
+                    break;
+                }
 
-    virtual void Run(CommandContext& context) override
-    {
-        context.overlay->SetMessage(message, level, timeout);
+                if(id >= sprites.Size())
+                {
+                    int oldSize = sprites.Size();
+                    Sprite* added = sprites.Grow(id + 1 - oldSize);
+                    for(int i = oldSize; i <= id; i++, added++)
+                    {
+                        added->index = -1;
+                    }
+                }
+                Sprite& sprite = sprites[id];
+                if(sprite.index < 0)
+                {
+                    sprite.index = liveSprites.Size();
+                    liveSprites.Append(id);
+                }
+                sprite.position = position;
+                sprite.image = image;
+                break;
+            }
+            case Opcode::MoveSprite:
+            {
+                u16 id;
+                read = Decode(read, id);
+                Vector<s16> delta = DecodeS4(*read++);
+                Sprite* sprite = redraw ? nullptr : FindSprite(id);
+                if(sprite)
+                {
+                    sprite->position += delta;
+                }
+                break;
+            }
+            case Opcode::SetSpritePosition:
+            {
+                u16 id;
+                Vector<s16> position;
+                read = DecodeU12(Decode(read, id), position);
+                Sprite* sprite = redraw ? nullptr : FindSprite(id);
+                if(sprite)
+                {
+                    sprite->position = position;
+                }
+                break;
+            }
+            case Opcode::SetSpriteImage:
+            {
+                u16 id;
+                read = Decode(read, id);
+                u8 image = *read++;
+                Sprite* sprite = redraw ? nullptr : FindSprite(id);
+                if(sprite)
+                {
+                    sprite->image = image;
+                }
+                break;
+            }
+            case Opcode::DestroySprite:
+            {
+                u16 id;
+                read = Decode(read, id);
+                Sprite* sprite = redraw ? nullptr : FindSprite(id);
+                if(sprite)
+                {
+                    // Move the last live sprite into the freed entry
+                    u16 last = liveSprites.Pop();
+                    if(last != id)
+                    {
+                        liveSprites[sprite->index] = last;
+                        sprites[last].index = sprite->index;
+                    }
+                    sprite->index = -1;
+                }
+                break;
+            }
+            case Opcode::DrawSprites:
+            {
+                if(draw)
+                {
+                    View::Blit* blit = blits.Grow(liveSprites.Size());
+                    for(u16 id : liveSprites)
+                    {
+                        const Sprite& sprite = sprites[id];
+                        *blit++ = View::Blit {sprite.position, &imageSheet[sprite.image >> 4][sprite.image & 0xF]};
+                    }
+                    FlushBlits(view);
+                }
+                break;
+            }
+            default:
+                assert(!"Unhandled opcode");
+                break;
+        }
     }
 
-    virtual void Serialize(ISerializer& serializer) override 
+    if(blits.Size() > 0)
     {
-        Command::Serialize(serializer);
-        hfh3::Serialize(serializer, message);
-        hfh3::Serialize(serializer, level);
-        hfh3::Serialize(serializer, timeout);
+        FlushBlits(view);
     }
-
-    Message message;
-    s16 level;
-    s16 timeout;
-};
-
-void CommandList::SetMessage(Message message, s16 level, s16 timeout)
-{
-    commands.Append(new hfh3::SetMessage(message, level, timeout));
 }
 
-Command* Command::Parse(ArrayReader& reader)
+void CommandList::FlushBlits(View& view)
 {
-    Opcode op;
-    Command* result;
-    hfh3::Serialize(reader, op);
-    switch(op)
-    {
-        case Opcode::SetViewOffset:
-            result = new SetViewOffset;
-        break;
-        case Opcode::DrawBackground:
-            result = new DrawBackground;
-        break;
-        case Opcode::DrawSprite:
-            result = new DrawSprite;
-        break;
-        case Opcode::SetPlayerPositions:
-            result = new SetPlayerPositions;
-        break;
-        case Opcode::SetBackgroundCell:
-            result = new SetBackgroundCell;
-        break;
-        case Opcode::ClearBackgroundCell:
-            result = new ClearBackgroundCell;
-        break;
-        case Opcode::SetPlayerStat:
-            result = new SetPlayerStat;
-        break;
-        case Opcode::SetMessage:
-            result = new SetMessage;
-        break;
-        case Opcode::FrameStart:
-            result = new FrameStart;
-        break;
-        default:
-        {
-            ERROR("Invalid command index %x", (u8)op);
-            return nullptr;
-        }    
-    }
-    result->Serialize(reader);
-    return result;
+    view.DrawImages(blits, blits.Size());
+    blits.ClearFast();
 }
 
-
-void CommandList::Run(class View& view, Background& background, 
-                      MessageOverlay* overlay, MiniMap* map)
+void CommandList::FinishFrame()
 {
-    CommandContext context {imageSheet, view, background, overlay, map};
-    for(Command* command : commands)
-    {
-        command->Run(context);
-    }
-    hasBeenRun = true;
+    Encode(&buffer[1], s32(buffer.Size()));
 }
 
 void CommandList::Send (CSocket* stream, bool wait)
 {
-    hfh3::FrameStart header;
-    serialized.ClearFast();
-    readOffset=0;
-
-    ArrayWriter writer(serialized);
-    header.Serialize(writer); // Reserve space for the frame header
-    // Serialize the actual commands
-    for(Command* command : commands)
-    {
-        command->Serialize(writer);
-    }
-
-    // Write the correct byte size into the frame header
-    header.PatchSize(serialized, serialized.Size());
+    FinishFrame();
 
     // Send the finished packet to the client.
-    stream->Send(serialized, serialized.Size(), wait?0:MSG_DONTWAIT);
+    stream->Send(buffer, buffer.Size(), wait?0:MSG_DONTWAIT);
 }
 
 void CommandList::Clear ()
 {
-    // Commands are stored as pointers, so we need to free them
-    for(Command*& command: commands)
-    {
-        delete command;
-
-        // Save a null pointer back to the list item
-        command = nullptr;
-    }
-    commands.ClearFast();
-    hasBeenRun = false;    
+    // Reset the buffer to only contain space for the frame header,
+    // keeping the allocated memory around for the next frame.
+    buffer.ClearFast();
+    u8* header = buffer.Grow(frameHeaderSize);
+    Encode(Encode(header, Opcode::FrameStart), s32(frameHeaderSize));
 }
 
 bool CommandList::Receive (CSocket* stream)
 {
-    u8 tmp[FRAME_BUFFER_SIZE];
-
-    int count = stream->Receive(tmp, FRAME_BUFFER_SIZE, MSG_DONTWAIT);
-    CompilerBarrier();
-
-    if (count > 0)
+    // The socket needs room for a whole network frame, otherwise data may be lost.
+    // If the ring is full, try again once the renderer has released some frames.
+    int count = 0;
+    int space;
+    u8* dest = received.GetWriteSpace(FRAME_BUFFER_SIZE, space);
+    if (dest != nullptr)
     {
-        if (serialized.Size() == 0)
+        count = stream->Receive(dest, space, MSG_DONTWAIT);
+        if (count > 0)
         {
-            assert(tmp[0] == u8(Opcode::FrameStart));
+            received.CommitWrite(count);
         }
-        serialized.AppendRaw(tmp, count);
+    }
 
-        if(serialized.Size() < 5)
+    // Publish all complete frames so they can be run where they were received.
+    // Frames left over when the queue was full are published here as well.
+    int pendingSize;
+    const u8* frame = received.GetPending(pendingSize);
+    while(pendingSize >= frameHeaderSize)
+    {
+        if (frame[0] != u8(Opcode::FrameStart))
         {
-            return true;
+            ERROR("Missing frame header");
+            return false;
         }
 
-        Command* command;
-        ArrayReader reader(serialized, readOffset);
-        for(int remaining = reader.GetRemaining(); remaining > 0; remaining = reader.GetRemaining())
+        s32 frameSize;
+        Decode(frame + 1, frameSize);
+        if (frameSize < frameHeaderSize || frameSize > maxFrameSize)
         {
-            // Save the current offset
-            readOffset = reader.GetOffset();
-
-            // Read the current command from the stream
-            command = Command::Parse(reader);
-
-            // If it's a frame start header, verify that we have enough data
-            if (command->opcode == Opcode::FrameStart)
-            {
-                // Verify frame header
-                auto header = reinterpret_cast<hfh3::FrameStart*>(command);
-                
-                // Stop parsing commands if we haven't received the entire frame yet.
-                if (header->size > remaining)
-                {
-                    return true;
-                }
-                // If previously parsed frames have been executed, clear the command list
-                else if (hasBeenRun)
-                {
-                    Clear();
-                }
-            }
-            // Append all other command objects to the command list
-            else
-            {
-                commands.Append(command);
-            }
+            ERROR("Invalid frame size %d", frameSize);
+            return false;
         }
 
-        // If we have parsed the entire read buffer, clear it
-        serialized.ClearFast();
-        readOffset = 0;
+        // Stop if we haven't received the entire frame yet, or the renderer hasn't caught up.
+        if (frameSize > pendingSize || !received.Publish(frameSize))
+        {
+            break;
+        }
+        frame = received.GetPending(pendingSize);
     }
- 
+
     return count >= 0;
 }
 
 
 }
-
@@ -5,37 +5,32 @@
 #include "util/vector.h"
 #include "util/rect.h"
 #include "util/array.h"
-#include "util/list.h"
 #include "ui/minimap.h"
 #include "ui/messageoverlay.h"
+#include "game/framering.h"
+#include "game/view.h"
 
 
 namespace hfh3
 {
+    enum class Opcode : u8;
+
     /** A simple class for storing a sequence of actions to be run at a later time.
-      * Commands are represented by virtual subclasses that are pushed to the end of a 
-      * list. They can either be executed in turn or serialized and later restored 
-      * from a byte array
+      * Commands are appended to a single contiguous byte buffer using the same
+      * encoding as is used on the wire. The buffer can be executed in place, sent
+      * to a client without further encoding or filled with frames received from
+      * the server.
       */
     class CommandList
     {
     public:
-        CommandList(class ImageSheet& inImageSheet) 
-            : imageSheet(inImageSheet)
-            , readOffset(0)
-            , hasBeenRun(false)
-        {
-        }
-
-        ~CommandList()
-        {
-            Clear();
-        }
+        CommandList(class ImageSheet& inImageSheet);
 
         // Methods for building the command buffer
         void SetViewOffset(const Vector<s16>& position);
         void DrawBackground();
         void DrawSprite(const Vector<s16>& position, u8 imageGroup, u8 subImage);
+        void DrawSprite(const Vector<s16>& position, u8 packedImage);
         void SetPlayerPositions(const Vector<s16>& p0, const Vector<s16>& p1);
         void SetBackgroundCell(const Vector<u8>& pos, u8 imageGroup, u8 subImage);
         void ClearBackgroundCell(const Vector<u8>& pos);
@@ -44,21 +39,104 @@ namespace hfh3
         void SetMessage(Message message, s16 level, s16 timeout);
         void Clear();
 
-        // This method will execute the buffered commands
-        void Run(class View& view, class Background& backround, 
+        /** Exchanges the locally built frame with the one of another list, so one list
+          * can be filled while the other is being run. Frames received from the server
+          * and the sprite tables stay where they are.
+          */
+        void SwapFrame(CommandList& other) { buffer.Swap(other.buffer); }
+
+        /** Methods for maintaining a table of sprites on the client, keyed by actor id.
+          * Used to send only the changes since the previous frame instead of drawing
+          * every visible sprite. MoveSprite takes offsets in the range -8 to 7.
+          */
+        void ClearSprites();
+        void CreateSprite(u16 id, const Vector<s16>& position, u8 packedImage);
+        void MoveSprite(u16 id, const Vector<s16>& delta);
+        void SetSpritePosition(u16 id, const Vector<s16>& position);
+        void SetSpriteImage(u16 id, u8 packedImage);
+        void DestroySprite(u16 id);
+        void DrawSprites();
+
+        /** Executes the buffered commands.
+          * On clients, the newest frame received from the server is executed in place and
+          * redrawn until a newer one arrives. Frames that arrived in between are dropped, only
+          * applying the commands that change state outside the view.
+          */
+        void Run(class View& view, class Background& backround,
                  MessageOverlay* overlay, MiniMap* map);
 
+        /** Writes the final byte size into the frame header.
+          * Called by Send before passing the buffer to the socket.
+          */
+        void FinishFrame();
+
         // Utility methods for sending and receiving command buffers
         void Send (CSocket* stream, bool wait=false);
         bool Receive (CSocket* stream);
-        int Size() const { return commands.Size(); }
-       
+
+        /** Returns the size of the encoded frame in bytes, including the header */
+        int GetByteSize() const { return buffer.Size(); }
+
+        // Statistics for frames received from the server
+        unsigned GetReceivedFrames() const { return acquired; }
+        unsigned GetDroppedFrames() const { return droppedFrames; }
+        unsigned GetRepeatedFrames() const { return repeatedFrames; }
+
     private:
+        // Size of the ring buffer frames from the server are received into.
+        static const int receiveBufferSize = 128 * 1024;
+
+        // Larger frames are rejected, to make sure the ring always has room for
+        // the frame being drawn while receiving the next one.
+        static const int maxFrameSize = receiveBufferSize / 4;
+
+        /** Appends an opcode to the buffer and reserves space for its arguments.
+          * Returns a pointer to where the arguments should be written.
+          */
+        u8* Append(Opcode op);
+
+        /** Executes the encoded commands in the range from read to end.
+          * If draw is false, only the commands that update state outside the view are run.
+          * Changes to the sprite table are skipped when redrawing a frame that has already
+          * been run, as they are relative to the previous frame.
+          */
+        void Execute(const u8* read, const u8* end, class View& view, class Background& background,
+                     MessageOverlay* overlay, MiniMap* map, bool draw, bool redraw=false);
+
         class ImageSheet& imageSheet;
-        List<class Command*> commands;
-        Array<u8> serialized;
-        int readOffset;
-        volatile bool hasBeenRun;
+
+        // The current frame. Always starts with a FrameStart header.
+        Array<u8> buffer;
+
+        // Frames received from the server.
+        FrameRing received;
+
+        /** The sprite table built from sprite commands, indexed by id.
+          * The ids of the sprites currently in the table are kept in a separate
+          * array, which is what DrawSprites iterates over.
+          */
+        struct Sprite
+        {
+            Vector<s16> position;
+            u8 image;
+            int index; // Index in liveSprites, or -1 if the id is not in use
+        };
+        Array<Sprite> sprites;
+        Array<u16> liveSprites;
+
+        // Returns the sprite with the given id, or nullptr if it has not been created.
+        Sprite* FindSprite(u16 id);
+
+        /** Draws the sprites collected from a run of DrawSprite commands or by DrawSprites
+          * in one batch, and empties the batch.
+          */
+        void FlushBlits(class View& view);
+        Array<View::Blit> blits;
+
+        // Sequence number following the newest frame acquired by Run
+        unsigned acquired;
+        unsigned droppedFrames;
+        unsigned repeatedFrames;
     };
 
 }
\ No newline at end of file
@@ -20,7 +20,8 @@ Enemy::Enemy(GameServer& inWorld, ImageSheet& imageSheet) :
           imageSheet.GetGroupSize(),
           static_cast<Direction>(Rand() % 8), 1,
           CollisionMask::Enemy, CollisionMask::None),
-    relaxed(Rand() % 50 + 10)
+    relaxed(Rand() % 50 + 10),
+    state(Roaming)
 {
 }
 
@@ -83,7 +84,7 @@ void Enemy::OnCollision(class Actor* other)
 {
     SetKiller(other->GetOwner());
     Destroy();
-    world.SpawnExplosion(GetPosition(), GetDirection(), GetSpeed());
+    world.SpawnEffectExplosion(GetPosition(), GetDirection(), GetSpeed());
 }
 
 void Enemy::OnBaseDestroyed(int basesRemaining)
@@ -7,6 +7,8 @@ namespace hfh3
     class Enemy : public Mover
     {
     public:
+        ACTOR_POOL_ALLOCATED(Enemy)
+
         Enemy(class GameServer& inWorld, class ImageSheet& imageSheet);
 
         virtual void Update() override;
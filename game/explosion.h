@@ -7,6 +7,8 @@ namespace hfh3
     class Explosion : public Mover
     {
     public:
+        ACTOR_POOL_ALLOCATED(Explosion)
+
         Explosion(class GameServer& inWorld, class ImageSheet& imageSheet, const Vector<s16>& position, Direction inDir = Direction::Stopped, int inSpeed = 1);
 
         virtual void Update() override;
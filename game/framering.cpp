@@ -0,0 +1,105 @@
+#include "game/framering.h"
+
+#include <circle/alloc.h>
+#include <circle/synchronize.h>
+#include <circle/util.h>
+#include <assert.h>
+
+using namespace hfh3;
+
+FrameRing::FrameRing(int inCapacity)
+    : capacity(inCapacity)
+    , data(nullptr)
+    , pendingStart(0)
+    , head(0)
+    , published(0)
+    , released(0)
+{
+}
+
+FrameRing::~FrameRing()
+{
+    if(data)
+    {
+        free(data);
+    }
+}
+
+u8* FrameRing::GetWriteSpace(int minSize, int& size)
+{
+    // Most instances never receive anything, so the memory is only allocated when needed.
+    if(!data)
+    {
+        data = static_cast<u8*>(malloc(capacity));
+    }
+
+    // Read the renderer's counter before looking at the memory it has released.
+    unsigned oldest = released;
+    DataMemBarrier();
+    bool inUse = oldest != published;
+    int tail = inUse ? frames[oldest & (maxFrames - 1)].offset : 0;
+
+    // The frames in use are always located before the pending data, unless
+    // the pending data has been wrapped around to the start of the ring.
+    if(inUse && tail > pendingStart)
+    {
+        size = tail - head;
+        return size >= minSize ? data + head : nullptr;
+    }
+
+    if(capacity - head < minSize)
+    {
+        // Move the partial frame to the start of the ring, if there is room for it
+        // in front of the oldest frame in use.
+        int partial = head - pendingStart;
+        int limit = inUse ? tail : capacity;
+        if(limit - partial < minSize)
+        {
+            return nullptr;
+        }
+
+        // There is no memmove, but the regions can't overlap as long as the
+        // partial frame is smaller than the distance it is moved.
+        assert(partial <= pendingStart);
+        memcpy(data, data + pendingStart, partial);
+        pendingStart = 0;
+        head = partial;
+        size = limit - head;
+        return data + head;
+    }
+
+    size = capacity - head;
+    return data + head;
+}
+
+bool FrameRing::Publish(int size)
+{
+    if(published - released == maxFrames)
+    {
+        return false;
+    }
+
+    frames[published & (maxFrames - 1)] = Frame {pendingStart, size};
+    pendingStart += size;
+
+    // Make sure the frame is visible before the renderer sees the new count.
+    DataMemBarrier();
+    published = published + 1;
+    return true;
+}
+
+unsigned FrameRing::Acquire()
+{
+    unsigned newest = published;
+    DataMemBarrier();
+    return newest;
+}
+
+void FrameRing::Release(unsigned sequence)
+{
+    assert(sequence - released <= published - released);
+
+    // Finish reading the frames before handing them back to the reader.
+    DataMemBarrier();
+    released = sequence;
+}
@@ -0,0 +1,93 @@
+#pragma once
+#include <circle/types.h>
+
+namespace hfh3
+{
+    /** Ring buffer receiving a stream of frames directly from a socket.
+      * Data is read straight into the ring, and once a complete frame has arrived
+      * it stays where it was received until it is released, so frames can be
+      * executed in place.
+      * The bytes of the frame currently being received are always kept contiguous.
+      * When there is not enough room left before the end of the ring, the partial frame
+      * is moved to the start of the ring, which is the only time any data gets copied.
+      *
+      * Complete frames are handed from the network reader to the renderer through a
+      * queue of frame descriptors. The reader publishes frames, and the renderer
+      * acquires all frames published so far and releases the ones it no longer needs.
+      * Frames are identified by their sequence number, counting from zero.
+      * Each side only writes its own counter, so the queue needs no locking.
+      */
+    class FrameRing
+    {
+    public:
+        static const unsigned maxFrames = 8; // Must be a power of two
+
+        FrameRing(int inCapacity);
+        ~FrameRing();
+
+        // Methods used by the reader
+
+        /** Returns a pointer to at least minSize bytes of contiguous free space
+          * and stores the total space available in size. Returns nullptr if the
+          * ring is too full to receive more data until frames have been released.
+          */
+        u8* GetWriteSpace(int minSize, int& size);
+
+        /** Adds count bytes written to the space returned by GetWriteSpace
+          * to the data of the frame being received.
+          */
+        void CommitWrite(int count)
+        {
+            head += count;
+        }
+
+        /** Returns the received data that has not been published as a frame yet.
+          */
+        const u8* GetPending(int& size) const
+        {
+            size = head - pendingStart;
+            return data + pendingStart;
+        }
+
+        /** Publishes the first size bytes of pending data as a complete frame.
+          * Returns false if the queue is full, in which case the frame stays pending.
+          */
+        bool Publish(int size);
+
+        // Methods used by the renderer
+
+        /** Returns the sequence number following the newest published frame.
+          * The frames up to it can be accessed until they are released.
+          */
+        unsigned Acquire();
+
+        /** Returns an acquired frame that has not been released.
+          */
+        const u8* GetFrame(unsigned sequence, int& size) const
+        {
+            const Frame& frame = frames[sequence & (maxFrames - 1)];
+            size = frame.size;
+            return data + frame.offset;
+        }
+
+        /** Hands the memory of all frames before sequence back to the reader.
+          */
+        void Release(unsigned sequence);
+
+    private:
+        struct Frame
+        {
+            int offset;
+            int size;
+        };
+
+        const int capacity;
+        u8* data;
+        int pendingStart; // Start of the frame being received
+        int head;         // End of the received data
+        Frame frames[maxFrames];
+
+        volatile unsigned published; // Number of frames published, only written by the reader
+        volatile unsigned released;  // Number of frames released, only written by the renderer
+    };
+}
@@ -36,6 +36,9 @@ GameClient::GameClient(MainLoop& inMainLoop, class Input& inInput, Network& inNe
 
 GameClient::~GameClient()
 {
+    INFO("Frames received: %u, dropped: %u, repeated: %u",
+        commands.GetReceivedFrames(), commands.GetDroppedFrames(), commands.GetRepeatedFrames());
+
     if (active)
     {
         if(readerTask)
@@ -5,12 +5,14 @@
 #include "util/vector.h"
 #include "util/log.h"
 #include "util/random.h"
+#include "util/tmath.h"
 
 #include "render/imagesheet.h"
 #include "render/image.h"
 #include "render/font.h"
 
 #include "game/actor.h"
+#include "game/actorpool.h"
 #include "game/base.h"
 #include "game/enemy.h"
 #include "game/explosion.h"
@@ -28,12 +30,27 @@ using namespace hfh3;
 GameServer::GameServer(MainLoop& inMainLoop, class Input& inInput, Network& inNetwork)
     : World(inMainLoop, inInput, inNetwork)
     , partitionSize(stage.GetSize() / partitionGridCount)
+    , partitionTree(stage.GetSize(), maxActorSize)
+    , partitionMode(PartitionMode::Grid)
+    , actorIdCount(0)
+    , broadphase(stage.GetSize(), maxActorSize)
     , player({stage.GetSize()/2, stage.GetSize()/2})
     , baseCount(0)
+    , multiplayer(false)
+    , localPlayer(0)
+    , sentBytes(0)
+    , sentFrames(0)
+    , finishedCommands(imageSheet)
+    , viewport(GetBounds())
     , client(nullptr)
     , clientCommands(imageSheet)
+    , frameEncoding(FrameEncoding::Delta)
+    , readerTask(nullptr)
     , currentLevel(-1)
+    , effectExplosions(0)
 {
+    pipelineUpdate = true;
+
     // Initial partitioning: partition the GameServer into 8x8 partitions:
     Rect<s16> bounds ({0,0}, partitionSize);
     for(int y = 0; y < partitionGridCount; y++,  bounds.origin.y += partitionSize.y)
@@ -42,6 +59,7 @@ GameServer::GameServer(MainLoop& inMainLoop, class Input& inInput, Network& inNe
         for(int x = 0; x < partitionGridCount; x++, bounds.origin.x += partitionSize.x)
         {
             GetPartition(x,y).SetBounds(bounds);
+            gridPartitions.Append(&GetPartition(x,y));
         }
     }
 }
@@ -49,6 +67,7 @@ GameServer::GameServer(MainLoop& inMainLoop, class Input& inInput, Network& inNe
 GameServer::PlayerInfo::PlayerInfo(const Vector<s16>& initialCamera)
     : actor(nullptr)
     , camera(initialCamera)
+    , previousCamera(initialCamera)
     , score(0)
     , lives(10)
 {
@@ -56,21 +75,15 @@ GameServer::PlayerInfo::PlayerInfo(const Vector<s16>& initialCamera)
 
 GameServer::~GameServer()
 {
-    for(Partition& partition : partitions)
+    if(sentFrames > 0)
     {
-        for(auto iter = partition.begin(); iter != partition.end(); ++iter)
-        {
-            Actor* actor = *iter;
-            if(actor == nullptr)
-            {
-                continue;
-            }
-            *iter = nullptr;
-
-            delete actor;
-        }
+        INFO("Sent %u bytes in %u frames to the other player, %u bytes per frame (%s encoding)",
+            sentBytes, sentFrames, sentBytes / sentFrames,
+            frameEncoding == FrameEncoding::Delta ? "delta" : "full");
     }
 
+    ClearLevel();
+
     if(readerTask)
     {
         readerTask->active = false;
@@ -94,10 +107,29 @@ GameServer::NetworkReader::~NetworkReader()
     }
 }
 
-#ifdef DEBUG_GAMESERVER
+void GameServer::PrepareFrame()
+{
+    BuildCommandBuffer(player[localPlayer], player[1-localPlayer], viewport, commands, nullptr, mainLoop.GetTickFraction());
+}
+
+void GameServer::Swap()
+{
+    finishedCommands.SwapFrame(commands);
+    commands.Clear();
+    viewport = GetBounds();
+}
+
 void GameServer::Render()
 {
-    World::Render();
+    RenderCommands(finishedCommands);
+#ifdef DEBUG_GAMESERVER
+    RenderDebug();
+#endif
+}
+
+#ifdef DEBUG_GAMESERVER
+void GameServer::RenderDebug()
+{
     const Rect<s16> player.actorBounds = player.actor->GetBounds();
     View view = View(stage, screen);
     view.SetCenterOffset(player.actorBounds.origin+player.actorBounds.size/2);
@@ -127,11 +159,11 @@ void GameServer::Render()
         {
             Partition& part = GetPartition(x,y);
 
-            for (auto i : part)
+            for (int slot = 0; slot < part.Size(); slot++)
             {
-                auto abounds = i->GetBounds();
+                auto abounds = part.GetBounds(slot);
                 view.DrawRect(abounds.Inflate(-5), 170);
-                bool collides = player.actor->CollisionCheck(i);
+                bool collides = player.actor->CollisionCheck(part.GetActor(slot));
                 if (collides)
                 {
                     view.DrawRect(player.actorBounds & abounds, 57);
@@ -145,54 +177,117 @@ void GameServer::Render()
 
 void GameServer::Update()
 {
-    commands.Clear();
+    if(!RunFrame())
+    {
+        mainLoop.DestroyClient(this);
+        return;
+    }
+
+    if(client)
+    {
+        BuildCommandBuffer(player[1], player[0], viewport, clientCommands,
+                           frameEncoding == FrameEncoding::Delta ? &clientSprites : nullptr);
+        clientCommands.Send(client);
+        sentBytes += clientCommands.GetByteSize();
+        sentFrames++;
+        clientCommands.Clear();
+    }
+}
+
+bool GameServer::RunFrame()
+{
+    // Changes to the background, scores and messages are collected in the command
+    // buffer over all the ticks until the next frame is rendered.
     if(baseCount == 0 && loadLevelDelay-- == 0)
     {
         LoadLevel();
     }
 
     // Exit the game if no players are left
-    if(player[0].lives == 0 && (!client || player[1].lives == 0) && loadLevelDelay-- == 0)
+    if(player[0].lives == 0 && (!multiplayer || player[1].lives == 0) && loadLevelDelay-- == 0)
     {
-        mainLoop.DestroyClient(this);
-        return;
+        return false;
+    }
+
+    UpdateActors();
+    AssignPartitions();
+    PerformCollisionCheck();
+    PerformPendingDeletes();
+
+    for(PlayerInfo& p : player)
+    {
+        UpdateCamera(p);
+    }
+    return true;
+}
+
+static inline u32 HashCombine(u32 hash, u32 value)
+{
+    // FNV-1a applied to whole words instead of single bytes
+    return (hash ^ value) * 16777619u;
+}
+
+u32 GameServer::ComputeStateHash()
+{
+    u32 hash = 2166136261u;
+    for(Partition* partition : GetAllPartitions())
+    {
+        int count = partition->Size();
+        for(int slot = 0; slot < count; slot++)
+        {
+            const Vector<s16>& position = partition->Position(slot);
+            hash = HashCombine(hash, u16(position.x) | (u32(u16(position.y)) << 16));
+            hash = HashCombine(hash, partition->Image(slot) | (partition->Flags(slot) << 8) |
+                                     (partition->Heading(slot) << 16) | (u8(partition->Speed(slot)) << 24));
+        }
     }
 
-    for(Partition& partition : partitions)
+    for(PlayerInfo& p : player)
+    {
+        hash = HashCombine(hash, p.score);
+        hash = HashCombine(hash, p.lives);
+    }
+    hash = HashCombine(hash, baseCount);
+    hash = HashCombine(hash, currentLevel);
+
+    // Diverging calls to Rand are caught immediately by including the generator state
+    u64 seed = Random::Instance().GetSeed();
+    hash = HashCombine(hash, u32(seed));
+    return HashCombine(hash, u32(seed >> 32));
+}
+
+void GameServer::UpdateActors()
+{
+    // Actors only spawn into the spawn partition and are never moved or
+    // removed while updating, so the partition sizes are constant here.
+    for(Partition* partition : GetAllPartitions())
     {
-        Rect<s16> bounds = partition.GetBounds();
-        for(Actor* actor : partition.Reverse())
+        partition->StorePreviousPositions();
+        int count = partition->Size();
+        for(int slot = 0; slot < count; slot++)
         {
-            assert(actor);
-            actor->Update();
+            partition->GetActor(slot)->Update();
+        }
 
-            if( actor->IsDestroyed())
+        const Rect<s16>& bounds = partition->GetBounds();
+        for(int slot = 0; slot < count; slot++)
+        {
+            u8& flags = partition->Flags(slot);
+            if(flags & Partition::Destroyed)
             {
-                pendingDelete.Append(actor);
+                pendingDelete.Append(partition->GetActor(slot));
             }
             // Check if item has moved out of the partition
-            else if(actor->positionDirty)
+            else if(flags & Partition::PositionDirty)
             {
-                actor->positionDirty = false;
-                if(!bounds.Contains(actor->position) )
+                flags &= ~Partition::PositionDirty;
+                if(!bounds.Contains(partition->Position(slot)))
                 {
-                    needsNewPartition.Append(actor);
+                    needsNewPartition.Append(partition->GetActor(slot));
                 }
             }
         }
     }
-
-    AssignPartitions();
-    PerformCollisionCheck();
-    PerformPendingDeletes();
-
-    BuildCommandBuffer(player[0], player[1], commands);
-    if(client)
-    {
-        BuildCommandBuffer(player[1], player[0], clientCommands);
-        clientCommands.Send(client);
-        clientCommands.Clear();
-    }
 }
 
 void GameServer::SetMessage(int playerIndex, Message message, s16 level, s16 duration)
@@ -213,127 +308,165 @@ void GameServer::SetMessage(int playerIndex, Message message, s16 level, s16 dur
             duration = -1;
         }
 
-        (playerIndex==0?commands:clientCommands).SetMessage(message, level, duration);
+        if (playerIndex == localPlayer)
+        {
+            commands.SetMessage(message, level, duration);
+        }
+        else if (client)
+        {
+            clientCommands.SetMessage(message, level, duration);
+        }
     }
 }
 
 
-int GameServer::BuildCommandBuffer(PlayerInfo& thisPlayer, PlayerInfo& otherPlayer, CommandList& commandList)
+void GameServer::UpdateCamera(PlayerInfo& thisPlayer)
 {
-    
-    const Vector<s16>& stageSize = stage.GetSize();
-    View view = View(stage, screen);
-
+    thisPlayer.previousCamera = thisPlayer.camera;
     if (thisPlayer.actor)
     {
         // Update the viewpoint of the current player.
         // Don't snap it directly to the player's position, but have it lag slightly
         // based on the distance to the previous wiew point.
-        Rect<s16> playerBounds = thisPlayer.actor->GetBounds();
-        Vector<s16> targetCamera = playerBounds.Center();
-        Vector<s16> diff = targetCamera - thisPlayer.camera;
+        Vector<s16> targetCamera = thisPlayer.actor->GetBounds().Center();
 
         // Take wrapping around the stage into account
-        if (diff.x > stageSize.x / 2 )
-        {
-            diff.x = diff.x - stageSize.x;
-        }
-        else if ( diff.x < -stageSize.x / 2)
-        {
-            diff.x += stageSize.x;
-        }
-
-        if (diff.y > stageSize.y / 2)
-        {
-            diff.y = diff.y - stageSize.y;
-        }
-        else if (diff.y < -stageSize.y / 2)
-        {
-            diff.y += stageSize.y;
-        }
+        Vector<s16> diff = stage.WrapDelta(targetCamera - thisPlayer.camera);
 
         static const int cameraLag = 20;
         Vector<s16> moveDelta = Vector<s16>((Vector<s32>(diff) * (cameraLag-1)) / cameraLag);
         thisPlayer.camera = stage.WrapCoordinate(targetCamera-moveDelta);
+    }
+}
+
+Vector<s16> GameServer::Interpolate(const Vector<s16>& previous, const Vector<s16>& position, unsigned fraction)
+{
+    // Anything moving further than this in a single tick has been placed somewhere
+    // else rather than moved there, and is drawn at its new position right away.
+    static const int maxTickDistance = maxActorSize;
+
+    Vector<s16> delta = stage.WrapDelta(position - previous);
+    if (fraction >= MainLoop::TICK_FRACTION_ONE ||
+        Abs(delta.x) > maxTickDistance || Abs(delta.y) > maxTickDistance)
+    {
+        return position;
+    }
+    return stage.WrapCoordinate(previous + (delta * s16(fraction)) / s16(MainLoop::TICK_FRACTION_ONE));
+}
+
+int GameServer::BuildCommandBuffer(const PlayerInfo& thisPlayer, const PlayerInfo& otherPlayer,
+                                   const Rect<s16>& viewport, CommandList& commandList,
+                                   SpriteDeltaEncoder* spriteEncoder, unsigned fraction)
+{
+    if (thisPlayer.actor)
+    {
+        Rect<s16> playerBounds = thisPlayer.actor->GetBounds();
         Vector<s16> otherPlayerPos = (otherPlayer.actor ? otherPlayer.actor->GetPosition() : Vector<s16>(-1,-1));
         commandList.SetPlayerPositions(playerBounds.origin, otherPlayerPos);
     }
  
-    view.SetCenterOffset(thisPlayer.camera);
-
-    commandList.SetViewOffset(view.GetOffset());
+    // Placed the same way as View::SetCenterOffset, but from the viewport instead of
+    // the screen clip, which belongs to the core drawing the frames.
+    const Vector<s16> camera = Interpolate(thisPlayer.previousCamera, thisPlayer.camera, fraction);
+    const Vector<s16> offset = stage.WrapCoordinate(camera - viewport.Center());
+    Rect<s16> visibleRect = viewport;
+    visibleRect.origin += offset;
+
+    commandList.SetViewOffset(offset);
     commandList.DrawBackground();
 
     int visible_actors = 0;
     // Loop trhough all partitions and call render on actors in partitions that
     // extend into the visible area.
-    int x_min,x_max,y_min,y_max;
-    GetPartitionRange(view.GetVisibleRect(),x_min,x_max,y_min,y_max);
-    for (int y = y_min; y < y_max; y++)
+    visiblePartitions.ClearFast();
+    GetPartitions(visibleRect, visiblePartitions);
+    if(spriteEncoder)
     {
-        for (int x=x_min; x < x_max; x++)
+        spriteEncoder->BeginFrame(commandList);
+    }
+    for (Partition* partition : visiblePartitions)
+    {
+        int count = partition->Size();
+        for(int slot = 0; slot < count; slot++)
         {
-            for(Actor* actor : GetPartition(x,y))
+            if(!(partition->Flags(slot) & Partition::Hidden) && visibleRect.OverlapsMod(partition->GetBounds(slot), stage.GetSize()))
             {
-                if(view.IsVisible(actor->GetBounds()))
+                Vector<s16> position = Interpolate(partition->PreviousPosition(slot), partition->Position(slot), fraction);
+                if(spriteEncoder)
+                {
+                    spriteEncoder->AddSprite(partition->Id(slot), position, partition->Image(slot));
+                }
+                else
                 {
-                    actor->Draw(commandList);
-                    visible_actors++;
+                    commandList.DrawSprite(position, partition->Image(slot));
                 }
+                visible_actors++;
             }
-
         }
     }
+    if(spriteEncoder)
+    {
+        spriteEncoder->EndFrame();
+    }
     return visible_actors;
 }
 
 void GameServer::PerformCollisionCheck()
 {
-    int x_min,x_max,y_min,y_max;
-    Array<Actor*> found;
-
-    for(Actor* collider : collisionSources)
+    // Feed the broadphase from the partition state. Actors that are
+    // neither sources nor targets of collisions are skipped here.
+    broadphase.Clear();
+    for(Partition* partition : GetAllPartitions())
     {
-        if(collider->collisionSourceMask != CollisionMask::None)
+        int count = partition->Size();
+        for(int slot = 0; slot < count; slot++)
         {
-            const Rect<s16> bounds = collider->GetBounds();
-            GetPartitionRange(bounds, x_min, x_max, y_min, y_max);
-            for (int y = y_min; y < y_max; y++)
+            CollisionMask targetMask = partition->TargetMask(slot);
+            CollisionMask sourceMask = partition->SourceMask(slot);
+            if(targetMask != CollisionMask::None)
             {
-                for (int x=x_min; x < x_max; x++)
-                {
-                    for(Actor* other : GetPartition(x,y))
-                    {
-                        assert(other);
-                        if (collider->CollisionCheck(other))
-                        {
-                            found.Append(other);
-                        }
-                    }
-                }
+                broadphase.AddTarget(partition->GetActor(slot), partition->GetBounds(slot), targetMask);
+            }
+            if(sourceMask != CollisionMask::None && !(partition->Flags(slot) & Partition::Destroyed))
+            {
+                broadphase.AddSource(partition->GetActor(slot), partition->GetBounds(slot), sourceMask);
             }
+        }
+    }
+
+    Actor* collider = nullptr;
+    bool colliderActive = false;
+    for(const Broadphase::Pair& pair : broadphase.FindPairs())
+    {
+        // The pairs are grouped by source. Skip all pairs of a source
+        // that was destroyed by a collision earlier in the batch.
+        if(pair.source != collider)
+        {
+            collider = pair.source;
+            colliderActive = !collider->IsDestroyed();
+        }
+        if(!colliderActive)
+        {
+            continue;
+        }
 
-            for (Actor* collided : found)
+        Actor* collided = pair.target;
+        if (!collided->IsDestroyed())
+        {
+            collided->OnCollision(collider);
+            if (collided->IsDestroyed())
             {
-                if (!collided->IsDestroyed())
-                {
-                    collided->OnCollision(collider);
-                    if (collided->IsDestroyed())
-                    {
-                        pendingDelete.Append(collided);
-                    }
-                }
+                pendingDelete.Append(collided);
+            }
+        }
 
-                if (!collider->IsDestroyed())
-                {
-                    collider->OnCollision(collided);
-                    if (collider->IsDestroyed())
-                    {
-                        pendingDelete.Append(collider);
-                    }
-                }
+        if (!collider->IsDestroyed())
+        {
+            collider->OnCollision(collided);
+            if (collider->IsDestroyed())
+            {
+                pendingDelete.Append(collider);
             }
-            found.ClearFast();
         }
     }
 }
@@ -351,7 +484,6 @@ void GameServer::SpawnEnemy(const Vector<s16>& location)
     {
         UpdateScore(enemy->GetKiller(), enemy->GetScore());
     });
-    AddActor(enemy);
 }
 
 void GameServer::SpawnPlayer(int index, const Level::SpawnPoint& point)
@@ -367,8 +499,7 @@ void GameServer::SpawnPlayer(int index, const Level::SpawnPoint& point)
     {
         player[index].actor->Destroy();
     }
-    player[index].actor = new Player(*this, index, imageSheet, index==1?clientInput:input, point.location, point.heading);
-    AddActor(player[index].actor);
+    player[index].actor = new Player(*this, index, imageSheet, GetPlayerInput(index), point.location, point.heading);
     player[index].actor->SetDestructionHandler([=]()
     {
         OnPlayerDestroyed(index);
@@ -380,27 +511,26 @@ void GameServer::SpawnMissile(int playerIndex, Direction direction, int speed)
     assert(playerIndex >= 0 && playerIndex < maxPlayerCount && player[playerIndex].actor);
     
     Vector<s16> startPosition = stage.WrapCoordinate(player[playerIndex].actor->GetPosition() + direction.ToDelta(maxActorSize));
-    AddActor(new Shot(*this, imageSheet, ImageSet::Missile, startPosition, direction, speed, playerIndex));
+    new Shot(*this, imageSheet, ImageSet::Missile, startPosition, direction, speed, playerIndex);
 }
 
 void GameServer::SpawnShot(const Vector<s16>& startPosition, const Direction& direction, int speed)
 {
-    AddActor(new Shot(*this, imageSheet, ImageSet::MiniShot, startPosition, direction, speed));
+    new Shot(*this, imageSheet, ImageSet::MiniShot, startPosition, direction, speed);
 }
 
 Actor* GameServer::SpawnExplosion(const Vector<s16>& startPosition, const Direction& direction, int speed)
 {
-    return AddActor(new Explosion(*this, imageSheet, startPosition, direction, speed));
+    return new Explosion(*this, imageSheet, startPosition, direction, speed);
 }
 
-Actor* GameServer::AddActor(Actor* newActor)
+void GameServer::SpawnEffectExplosion(const Vector<s16>& startPosition, const Direction& direction, int speed)
 {
-    if(newActor->collisionSourceMask != CollisionMask::None)
+    int interval = GetSimulationQuality().explosionInterval;
+    if(interval > 0 && effectExplosions++ % interval == 0)
     {
-        collisionSources.Prepend(newActor);
+        SpawnExplosion(startPosition, direction, speed);
     }
-    needsNewPartition.Append(newActor);
-    return newActor;
 }
 
 void GameServer::PerformPendingDeletes()
@@ -408,12 +538,6 @@ void GameServer::PerformPendingDeletes()
     for(Actor* actor : pendingDelete)
     {
         assert(actor->IsDestroyed());
-        if(actor->collisionSourceMask != CollisionMask::None)
-        {
-            auto found = collisionSources.FindFirst([&actor](Actor* other){ return actor == other; });
-            assert(found);
-            found.Remove();
-        }
 
         for (PlayerInfo& p : player)
         {
@@ -423,11 +547,7 @@ void GameServer::PerformPendingDeletes()
             }
         }
 
-        if(actor->partitionIterator)
-        {
-            assert(*actor->partitionIterator == actor);
-            actor->partitionIterator.Remove();
-        }
+        actor->partition->Remove(actor->slot);
         delete actor;
     }
     pendingDelete.Clear();
@@ -436,38 +556,131 @@ void GameServer::PerformPendingDeletes()
 void GameServer::ClearLevel()
 {
     pendingDelete.Clear();
-    collisionSources.Clear();
 
     for (PlayerInfo& p : player)
     {
         p.actor = nullptr;
     }   
 
-    for(Partition& partition : partitions)
+    for(Partition* partition : GetAllPartitions())
     {
-        for(Actor* actor : partition.Reverse())
-        {
-            assert(actor);
-            delete actor;
-        }
-        partition.Clear();
+        DestroyActors(*partition);
     }
+    DestroyActors(spawnPartition);
+    needsNewPartition.ClearFast();
+
+    // The actors' memory is reclaimed all at once instead of freeing them one by one.
+    ActorPool::Instance().Reset();
+}
+
+void GameServer::DestroyActors(Partition& partition)
+{
+    for(int slot = 0; slot < partition.Size(); slot++)
+    {
+#if CONFIG_USE_ACTOR_POOL
+        // Destructors still have to run to release memory owned by the actors,
+        // such as destruction handlers too large to be stored inline.
+        partition.GetActor(slot)->~Actor();
+#else
+        delete partition.GetActor(slot);
+#endif
+    }
+    partition.Clear();
 }
 
 void GameServer::AssignPartitions()
 {
+    // Move newly spawned actors into place. Taking them from the end
+    // of the spawn partition avoids shuffling the remaining ones.
+    // They have not moved yet, so they are drawn where they are.
+    spawnPartition.StorePreviousPositions();
+    while(!spawnPartition.IsEmpty())
+    {
+        Actor* actor = spawnPartition.GetActor(spawnPartition.Size()-1);
+        GetPartition(actor->GetPosition()).Adopt(actor);
+    }
+
     for(Actor* actor : needsNewPartition)
     {
-        if (actor->partitionIterator)
+        GetPartition(actor->GetPosition()).Adopt(actor);
+    }
+    needsNewPartition.ClearFast();
+
+    if(partitionMode == PartitionMode::Adaptive)
+    {
+        partitionTree.Rebalance();
+    }
+}
+
+void GameServer::SetPartitionMode(PartitionMode mode)
+{
+    if(mode == partitionMode)
+    {
+        return;
+    }
+
+    // Move all actors to the spawn partition and let AssignPartitions place
+    // them in the partitions of the new mode.
+    for(Partition* partition : GetAllPartitions())
+    {
+        while(!partition->IsEmpty())
         {
-            assert(*actor->partitionIterator == actor);
-            actor->partitionIterator.Remove();
+            spawnPartition.Adopt(partition->GetActor(partition->Size()-1));
         }
+    }
+    needsNewPartition.ClearFast();
+
+    partitionMode = mode;
+    AssignPartitions();
+}
 
-        // Add it to the new partition and save the returned iterator
-        actor->partitionIterator = GetPartition(actor->position).Append(actor);
+void GameServer::SetFrameEncoding(FrameEncoding encoding)
+{
+    if(encoding == frameEncoding)
+    {
+        return;
+    }
+
+    // The sprite table on the client may be out of date after sending full frames
+    if(encoding == FrameEncoding::Delta)
+    {
+        clientSprites.Reset();
+    }
+    frameEncoding = encoding;
+}
+
+u16 GameServer::AllocateActorId()
+{
+    if(!freeActorIds.IsEmpty())
+    {
+        return freeActorIds.Pop();
+    }
+    assert(actorIdCount <= 0xffff);
+    return u16(actorIdCount++);
+}
+
+void GameServer::FreeActorId(u16 id)
+{
+    freeActorIds.Append(id);
+}
+
+void GameServer::GetPartitions(const Rect<s16>& rect, Array<Partition*>& result)
+{
+    if(partitionMode == PartitionMode::Adaptive)
+    {
+        partitionTree.GetPartitions(rect, result);
+        return;
+    }
+
+    int x_min,x_max,y_min,y_max;
+    GetPartitionRange(rect, x_min, x_max, y_min, y_max);
+    for (int y = y_min; y < y_max; y++)
+    {
+        for (int x=x_min; x < x_max; x++)
+        {
+            result.Append(&GetPartition(x,y));
+        }
     }
-    needsNewPartition.Clear();
 }
 
 void GameServer::GetPartitionRange(const Rect<s16>& rect, int& x1, int& x2, int& y1, int& y2)
@@ -524,7 +737,7 @@ void GameServer::UpdateScore(int playerIndex, int scoreChange)
     if (playerIndex >= 0 && playerIndex < 2 && scoreChange)
     {
         player[playerIndex].score += scoreChange;
-        minimap->SetPlayerScore(playerIndex, player[playerIndex].score);
+        commands.SetPlayerScore(playerIndex, player[playerIndex].score);
         if (client)
         {
             clientCommands.SetPlayerScore(playerIndex, player[playerIndex].score);
@@ -556,7 +769,7 @@ void GameServer::OnPlayerDestroyed(int playerIndex)
     }
 
 
-    minimap->SetPlayerLives(playerIndex, player[playerIndex].lives);
+    commands.SetPlayerLives(playerIndex, player[playerIndex].lives);
     if (client)
     {
         clientCommands.SetPlayerLives(playerIndex, player[playerIndex].lives);
@@ -568,21 +781,20 @@ void GameServer::OnBaseDestroyed(Base* base)
 {
     Background::GridPosition position = Background::WorldToGrid(base->GetPosition());
  
-    background.ClearCell(position);
+    commands.ClearBackgroundCell(position);
     if (client)
     {
         clientCommands.ClearBackgroundCell(position);
     }
     baseCount --;
 
-    for(Partition& partition : partitions)
+    for(Partition* partition : GetAllPartitions())
     {
-        for(Actor* actor : partition.Reverse())
+        for(int slot = 0; slot < partition->Size(); slot++)
         {
-            assert(actor);
-            if( !actor->IsDestroyed())
+            if(!(partition->Flags(slot) & Partition::Destroyed))
             {
-                actor->OnBaseDestroyed(baseCount);
+                partition->GetActor(slot)->OnBaseDestroyed(baseCount);
             }
         }
     }
@@ -598,7 +810,7 @@ void GameServer::OnBaseChanged(Base* base, u8 imageGroup, u8 imageIndex)
 {
     Background::GridPosition position = Background::WorldToGrid(base->GetPosition());
 
-    background.SetCell(base->GetPosition(), imageGroup, imageIndex);
+    commands.SetBackgroundCell(position, imageGroup, imageIndex);
     if(client)
     {
         clientCommands.SetBackgroundCell(position, imageGroup, imageIndex);
@@ -607,7 +819,6 @@ void GameServer::OnBaseChanged(Base* base, u8 imageGroup, u8 imageIndex)
 
 void GameServer::AddBase(Base* base)
 {
-    AddActor(base);
     baseCount++;
     base->SetDestructionHandler([=]()
     {
@@ -620,14 +831,14 @@ void GameServer::LoadLevel(int levelIndex)
     // Initialize scores and lives if this is the first level loaded
     if (currentLevel < 0)
     {
-        if (!client)
+        if (!multiplayer)
         {
             player[1].lives = -1;
         }
         for(int i = 0; i < 2; i++)
         {
-            minimap->SetPlayerLives(i, player[i].lives);
-            minimap->SetPlayerScore(i, player[i].score);
+            commands.SetPlayerLives(i, player[i].lives);
+            commands.SetPlayerScore(i, player[i].score);
             if (client)
             {
                 clientCommands.SetPlayerLives(i, player[i].lives);
@@ -661,7 +872,7 @@ void GameServer::LoadLevel(int levelIndex)
     }
 
     Array<Level::SpawnPoint> spawnPoints (level.playerStarts);
-    int playerCount = client?2:1;
+    int playerCount = multiplayer?2:1;
     for (int i = 0; i <playerCount; i++)
     {
         auto spawnPoint = spawnPoints.Pull(Rand() % spawnPoints.Size());
@@ -675,6 +886,7 @@ void GameServer::LoadLevel(int levelIndex)
         // Send updated level data to the client immediately
         // Block until the setup commands have been sent
         clientCommands.Send(client, true);
+        sentBytes += clientCommands.GetByteSize();
         clientCommands.Clear();
     }
 }
@@ -682,10 +894,12 @@ void GameServer::LoadLevel(int levelIndex)
 
 void GameServer::Bind()
 {
+    pipelineUpdate = false; // The socket can only be used from the main core
     Pause(); // If called from a different task, we have to disable updates while waiting
     client = network.WaitForClient();
     if(client)
     {
+        multiplayer = true;
         client->Send("HI!", 3, 0);
 
         DEBUG("Waiting for greeting");
@@ -1,7 +1,6 @@
 #pragma once
 #include <circle/net/socket.h>
 
-#include "util/list.h"
 #include "util/array.h"
 #include "util/vector.h"
 #include "util/rect.h"
@@ -10,7 +9,10 @@
 
 #include "game/world.h"
 #include "game/partition.h"
+#include "game/broadphase.h"
+#include "game/partitiontree.h"
 #include "game/levels.h"
+#include "game/spritedeltaencoder.h"
 
 namespace hfh3
 {
@@ -28,9 +30,20 @@ namespace hfh3
         void Bind();
 
         virtual void Update() override;
-#ifdef DEBUG_GAMESERVER
+
+        /** Builds the view of the local player between the last two simulation ticks
+          * into the command list, after the changes collected over the ticks.
+          */
+        virtual void PrepareFrame() override;
+
+        /** Hands the command list built since the previous frame over to Render,
+          * and starts a new one.
+          */
+        virtual void Swap() override;
+
+        /** Draws the command list handed over by Swap.
+          */
         virtual void Render() override;
-#endif
         
 
         virtual void LoadLevel(int level=-1);
@@ -46,13 +59,85 @@ namespace hfh3
         void SpawnPlayer(int index, const Level::SpawnPoint& point);
         void SpawnMissile(int playerIndex, Direction direction, int speed);
         Actor* SpawnExplosion(const Vector<s16>& position, const class Direction& direction , int speed);
+
+        /** Spawns an explosion that is only there to be seen. Under load, some or all
+          * of them are skipped, following GetSimulationQuality.
+          */
+        void SpawnEffectExplosion(const Vector<s16>& position, const class Direction& direction , int speed);
+
+        /** Returns the quality settings that affect the simulation, such as the rate
+          * of effect explosions and enemy spawns.
+          */
+        virtual const QualityGovernor::Quality& GetSimulationQuality() const
+        {
+            return mainLoop.GetQuality();
+        }
         void SpawnShot(const Vector<s16>& position, const class Direction& direction , int speed);
 
 
         void OnBaseChanged(class Base* base, u8 imageGroup, u8 imageIndex);
         void AddBase(class Base* base);
 
+        /** Selects how the stage is divided into partitions.
+          * Grid uses a fixed 8x8 grid, while Adaptive splits and merges
+          * partitions depending on the number of actors in them.
+          */
+        enum class PartitionMode
+        {
+            Grid,
+            Adaptive,
+        };
+
+        /** Switches the partitioning mode, moving all actors into the new partitions.
+          * Should not be called while the actors are being updated.
+          */
+        void SetPartitionMode(PartitionMode mode);
+
+        PartitionMode GetPartitionMode() const
+        {
+            return partitionMode;
+        }
+
+        /** Selects how the sprites are encoded in the frames sent to the client.
+          * Full draws every visible sprite in each frame, while Delta maintains a
+          * table of sprites on the client and only sends what changed since the
+          * previous frame.
+          */
+        enum class FrameEncoding
+        {
+            Full,
+            Delta,
+        };
+
+        void SetFrameEncoding(FrameEncoding encoding);
+
+        FrameEncoding GetFrameEncoding() const
+        {
+            return frameEncoding;
+        }
+
     protected:
+        /** Advances the game by one simulation tick.
+          * Returns false when the game is over.
+          */
+        bool RunFrame();
+
+#ifdef DEBUG_GAMESERVER
+        void RenderDebug();
+#endif
+
+        /** Returns the input controlling the player with the given index.
+          */
+        virtual class Input& GetPlayerInput(int index)
+        {
+            return index == 1 ? clientInput : input;
+        }
+
+        /** Returns a hash of the simulation state, for detecting when two
+          * simulations running the same game have diverged.
+          */
+        u32 ComputeStateHash();
+
         void SpawnFortress(const Level::FortressSpec& area);
 
         void UpdateScore(int player, int scoreChange);
@@ -63,16 +148,43 @@ namespace hfh3
         void PerformPendingDeletes();
         void ClearLevel();
 
+        // Destructs all actors in the partition and removes them from it.
+        void DestroyActors(Partition& partition);
+
         struct PlayerInfo 
         {
             PlayerInfo(const Vector<s16>& initialCamera);
             class Player* actor;
             Vector<s16> camera;
+            Vector<s16> previousCamera; // The camera position before the last tick
             int score;
             int lives;
         };
 
-        int BuildCommandBuffer(class PlayerInfo& player, class PlayerInfo& otherPlayer, CommandList& commandList);
+        /** Moves the camera of a player towards the player's actor. Called every tick.
+          */
+        void UpdateCamera(class PlayerInfo& player);
+
+        /** Returns the position the given fraction of a tick from the previous to the current
+          * position, in units of 1/MainLoop::TICK_FRACTION_ONE.
+          */
+        Vector<s16> Interpolate(const Vector<s16>& previous, const Vector<s16>& position, unsigned fraction);
+
+        /** Adds the view of a player to the command list and returns the number of visible actors.
+          * The camera is centered in the viewport, the screen area the view is drawn to.
+          * If an encoder is passed in, the sprites are encoded as changes to the previous frame.
+          * The camera and actors are placed the given fraction of the way from their state
+          * before the last tick to the current one, in units of 1/MainLoop::TICK_FRACTION_ONE.
+          */
+        int BuildCommandBuffer(const class PlayerInfo& player, const class PlayerInfo& otherPlayer,
+                               const Rect<s16>& viewport, CommandList& commandList,
+                               SpriteDeltaEncoder* spriteEncoder = nullptr,
+                               unsigned fraction = MainLoop::TICK_FRACTION_ONE);
+
+        // Ids identify actors to clients. The ids of destroyed actors are reused,
+        // keeping them small enough to index the sprite tables directly.
+        u16 AllocateActorId();
+        void FreeActorId(u16 id);
 
         class NetworkReader : public CTask
         {
@@ -100,7 +212,11 @@ namespace hfh3
         
         const Vector<s16> partitionSize;
         Partition partitions[partitionCount];
+        Array<Partition*> gridPartitions;
+        PartitionTree partitionTree;
+        PartitionMode partitionMode;
         
+        // Returns a partition of the fixed grid. Only used in the Grid partitioning mode.
         Partition& GetPartition(int x, int y)
         {
             return partitions[(y & partitionGridMask)*partitionGridCount + (x & partitionGridMask)];
@@ -108,10 +224,36 @@ namespace hfh3
 
         Partition& GetPartition(const Vector<s16>& pos)
         {
+            if(partitionMode == PartitionMode::Adaptive)
+            {
+                return partitionTree.GetPartition(pos);
+            }
             return GetPartition(pos.x / partitionSize.x, pos.y / partitionSize.y);
         }
 
-        Actor* AddActor(class Actor* newActor);
+        // Returns all partitions of the current partitioning mode.
+        Array<Partition*>& GetAllPartitions()
+        {
+            return partitionMode == PartitionMode::Adaptive ? partitionTree.GetLeaves() : gridPartitions;
+        }
+
+        // Appends the partitions that potentially contain actors overlapping
+        // the rectangle passed in to the result array.
+        void GetPartitions(const Rect<s16>& rect, Array<Partition*>& result);
+
+        // Actors are added to the spawn partition on construction and stay there until
+        // AssignPartitions moves them to the partition matching their position.
+        Partition spawnPartition;
+
+        Partition& GetSpawnPartition()
+        {
+            return spawnPartition;
+        }
+
+        /** Calls Update on all actors in the partitions and collects the actors
+          * that have been destroyed or have moved outside their partition.
+          */
+        void UpdateActors();
 
         void SetMessage(int player, Message message, s16 level, s16 duration=-1);
 
@@ -119,23 +261,47 @@ namespace hfh3
         // actors that overlap the rectangle passed in. 
         void GetPartitionRange(const Rect<s16>& rect, int& x1, int& x2, int& y1, int& y2);
 
-        // When actors are spawned or moved out of the bounding box of a partition,
+        // When actors move out of the bounding box of their partition,
         // they will be added to this list.
         Array<class Actor*> needsNewPartition;
         Array<class Actor*> pendingDelete;
-        List<class Actor*> collisionSources;
+        Array<Partition*> visiblePartitions;
+
+        Array<u16> freeActorIds;
+        int actorIdCount;
+
+        Broadphase broadphase;
 
         PlayerInfo player[maxPlayerCount];
         int baseCount;
 
+        // True when a second player takes part in the game, the index of the player
+        // controlled from this machine and the amount of data sent to the other player.
+        bool multiplayer;
+        int localPlayer;
+        unsigned sentBytes;
+        unsigned sentFrames;
+
+        // The frame drawn by Render. The simulation only adds to commands, so
+        // in pipelined mode the next frame can be built while this one is drawn.
+        CommandList finishedCommands;
+
+        // The bounds of the world view, taken on the main core by Swap, as PrepareFrame
+        // may run on another core while the screen clip is changed.
+        Rect<s16> viewport;
+
         CSocket* client;
         CommandList clientCommands;
+        FrameEncoding frameEncoding;
+        SpriteDeltaEncoder clientSprites;
         ProxyInput    clientInput;
         NetworkReader* readerTask;
         int currentLevel;
         int loadLevelDelay;
+        unsigned effectExplosions; // The number of effect explosions requested
         Levels levels;
 
+        friend class Actor;
         friend class Base;
     };
 }
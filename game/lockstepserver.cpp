@@ -0,0 +1,279 @@
+#include "game/lockstepserver.h"
+#include "network/network.h"
+#include "input/input.h"
+#include "util/log.h"
+#include "util/random.h"
+#include "util/serialization.h"
+
+#include <circle/net/in.h>
+#include <circle/sched/scheduler.h>
+#include <circle/synchronize.h>
+#include <circle/timer.h>
+#include <circle/util.h>
+
+using namespace hfh3;
+
+LockstepServer::LockstepServer(MainLoop& inMainLoop, class Input& inInput, Network& inNetwork)
+    : GameServer(inMainLoop, inInput, inNetwork)
+    , peer(nullptr)
+    , peerReader(nullptr)
+    , connected(false)
+    , seed(0)
+    , inputDelay(defaultInputDelay)
+    , frame(0)
+    , remoteFrames(0)
+    , stalledFrames(0)
+    , desyncs(0)
+{
+    // Every tick sends input to the peer, which can only be done from the main core
+    pipelineUpdate = false;
+}
+
+LockstepServer::~LockstepServer()
+{
+    INFO("Lockstep session ended after %u frames, %u stalled waiting for input, %u with diverging state",
+        frame, stalledFrames, desyncs);
+
+    if(connected)
+    {
+        if(peerReader)
+        {
+            peerReader->active = false;
+            peerReader = nullptr;
+        }
+        if(peer)
+        {
+            delete peer;
+            peer = nullptr;
+        }
+    }
+}
+
+void LockstepServer::Host()
+{
+    Pause(); // If called from a different task, we have to disable updates while waiting
+    peer = network.WaitForClient();
+    if(peer)
+    {
+        DEBUG("Waiting for greeting");
+        u8 buffer[FRAME_BUFFER_SIZE];
+        int count = peer->Receive(buffer, FRAME_BUFFER_SIZE, 0);
+        if(count == 3 && memcmp(buffer, "LS?", 3) == 0)
+        {
+            u64 newSeed = (u64(Rand()) << 32) | CTimer::Get()->GetClockTicks();
+            u8 settings[settingsSize];
+            memcpy(settings, "LS!", 3);
+            Encode(Encode(settings + 3, newSeed), u8(inputDelay));
+            peer->Send(settings, settingsSize, 0);
+            Start(newSeed, inputDelay);
+        }
+        else
+        {
+            ERROR("Peer did not request a lockstep session");
+            delete peer;
+            peer = nullptr;
+        }
+    }
+    Resume();
+}
+
+void LockstepServer::Join(ipv4_address_t address, ipv4_port_t port)
+{
+    Pause(); // Updates have to wait until the session has been set up
+    peer = network.ConnectToServer(address, port);
+    if(peer)
+    {
+        peer->Send("LS?", 3, 0);
+        DEBUG("Waiting for session settings");
+        u8 buffer[FRAME_BUFFER_SIZE];
+        int count = peer->Receive(buffer, FRAME_BUFFER_SIZE, 0);
+        if(count == settingsSize && memcmp(buffer, "LS!", 3) == 0)
+        {
+            u64 newSeed;
+            u8 newInputDelay;
+            Decode(Decode(buffer + 3, newSeed), newInputDelay);
+
+            localPlayer = 1;
+            if(overlay)
+            {
+                overlay->SetPlayerId(1);
+            }
+            Start(newSeed, newInputDelay);
+        }
+        else
+        {
+            ERROR("Invalid lockstep session settings");
+            delete peer;
+            peer = nullptr;
+        }
+    }
+    Resume();
+}
+
+void LockstepServer::Start(u64 inSeed, int inInputDelay)
+{
+    assert(inInputDelay > 0 && unsigned(inInputDelay) * 2 < historySize);
+    seed = inSeed;
+    inputDelay = inInputDelay;
+    multiplayer = true;
+
+    // Nobody has had the chance to press anything during the first frames
+    u8 neutral = Input().DumpInputState();
+    for(int i = 0; i < inputDelay; i++)
+    {
+        localInputs[i] = neutral;
+        remoteInputs[i] = neutral;
+    }
+    frame = 0;
+    remoteFrames = inputDelay;
+
+    connected = true;
+    peerReader = new PeerReader(peer, this);
+}
+
+void LockstepServer::LoadLevel(int level)
+{
+    // Both peers seed the generator just before setting up the first level
+    if(currentLevel < 0)
+    {
+        Random::Instance().Reset(seed);
+    }
+    GameServer::LoadLevel(level);
+}
+
+void LockstepServer::Update()
+{
+    if(!connected)
+    {
+        mainLoop.DestroyClient(this);
+        return;
+    }
+
+    // Wait for the input of the other peer. The command buffer of
+    // the previous frame is drawn again in the meantime.
+    if(remoteFrames <= frame)
+    {
+        stalledFrames++;
+        return;
+    }
+    DataMemBarrier();
+
+    // The hash of the other peer's state arrives together with its input, inputDelay frames later.
+    if(frame >= u32(inputDelay))
+    {
+        CheckHash(frame - inputDelay);
+    }
+
+    playerInputs[localPlayer].SetInputState(localInputs[frame % historySize]);
+    playerInputs[1-localPlayer].SetInputState(remoteInputs[frame % historySize]);
+    if(!RunFrame())
+    {
+        mainLoop.DestroyClient(this);
+        return;
+    }
+
+    u32 hash = ComputeStateHash();
+    localHashes[frame % historySize] = hash;
+
+    // Schedule the current local input for a later frame and send it to the other peer
+    u8 state = input.DumpInputState();
+    localInputs[(frame + inputDelay) % historySize] = state;
+    SendInput(frame + inputDelay, state, hash);
+    frame++;
+}
+
+void LockstepServer::SendInput(u32 inputFrame, u8 state, u32 hash)
+{
+    u8 packet[packetSize];
+    Encode(Encode(Encode(packet, inputFrame), state), hash);
+    peer->Send(packet, packetSize, MSG_DONTWAIT);
+    sentBytes += packetSize;
+    sentFrames++;
+}
+
+void LockstepServer::CheckHash(u32 hashFrame)
+{
+    if(localHashes[hashFrame % historySize] != remoteHashes[hashFrame % historySize])
+    {
+        // Only report the first frame, as the simulations will keep diverging
+        if(desyncs == 0)
+        {
+            ERROR("Lockstep simulations diverged at frame %u", hashFrame);
+        }
+        desyncs++;
+    }
+}
+
+bool LockstepServer::OnPacket(const u8* packet)
+{
+    u32 inputFrame;
+    u8 state;
+    u32 hash;
+    Decode(Decode(Decode(packet, inputFrame), state), hash);
+
+    // TCP delivers the packets in order, so each one should be for the next frame
+    if(inputFrame != remoteFrames)
+    {
+        ERROR("Expected input for frame %u, got %u", remoteFrames, inputFrame);
+        return false;
+    }
+
+    // The hash was computed after simulating the frame the sender read the input on
+    remoteInputs[inputFrame % historySize] = state;
+    remoteHashes[(inputFrame - inputDelay) % historySize] = hash;
+
+    // Make sure the input is stored before the frame count is updated
+    DataMemBarrier();
+    remoteFrames = inputFrame + 1;
+    return true;
+}
+
+bool LockstepServer::PeerReader::Receive()
+{
+    u8 buffer[FRAME_BUFFER_SIZE];
+    int count = peer->Receive(buffer, FRAME_BUFFER_SIZE, MSG_DONTWAIT);
+    if(!active) // outer may be invalid if active is false
+    {
+        return false;
+    }
+
+    // Reassemble the packets, which may be split or merged by TCP
+    for(int i = 0; i < count; )
+    {
+        int chunk = packetSize - packetFill;
+        if(chunk > count - i)
+        {
+            chunk = count - i;
+        }
+        memcpy(packet + packetFill, buffer + i, chunk);
+        packetFill += chunk;
+        i += chunk;
+
+        if(packetFill == packetSize)
+        {
+            packetFill = 0;
+            if(!outer->OnPacket(packet))
+            {
+                return false;
+            }
+        }
+    }
+    return count >= 0;
+}
+
+void LockstepServer::PeerReader::Run()
+{
+    CScheduler* scheduler = CScheduler::Get();
+    while(active && Receive())
+    {
+        scheduler->Yield();
+    }
+
+    if (active) // Signal to the outer class that we lost connection if still active
+    {
+        DEBUG("Peer disconnected");
+        delete peer;
+        outer->peer = nullptr;
+        outer->connected = false;
+    }
+}
@@ -0,0 +1,113 @@
+#pragma once
+#include <circle/net/socket.h>
+#include <circle/sched/task.h>
+
+#include "network/types.h"
+#include "input/proxyinput.h"
+#include "game/gameserver.h"
+
+namespace hfh3
+{
+    /** Multiplayer session where both machines run the full game simulation.
+      * Instead of streaming draw commands to a thin client, the peers only exchange
+      * their input state for each frame. As the simulation only depends on the inputs
+      * and a shared random seed, both machines stay in sync.
+      *
+      * Local input is applied inputDelay frames after it was read, which gives it
+      * time to reach the other peer before that frame is simulated. If the input of
+      * the other peer has not arrived in time, the simulation waits for it.
+      * Each packet also carries a hash of the sender's state, which is compared
+      * against the local one to detect diverging simulations.
+      */
+    class LockstepServer : public GameServer
+    {
+    public:
+        static const int defaultInputDelay = 3;
+
+        LockstepServer(MainLoop& inMainLoop, class Input& inInput, class Network& inNetwork);
+        virtual ~LockstepServer();
+
+        /** Waits until another peer joins and sends it the session settings.
+          * The hosting peer controls the first player.
+          */
+        void Host();
+
+        /** Connects to a peer hosting a session.
+          * The joining peer controls the second player.
+          */
+        void Join(ipv4_address_t address, ipv4_port_t port = GAME_PORT);
+
+        virtual void Update() override;
+        virtual void LoadLevel(int level=-1) override;
+
+        /** Both peers have to make the same choices in the simulation, while each
+          * governor sees a different load, so the simulation always runs at full quality.
+          */
+        virtual const QualityGovernor::Quality& GetSimulationQuality() const override
+        {
+            return QualityGovernor::FULL_QUALITY;
+        }
+
+    protected:
+        virtual class Input& GetPlayerInput(int index) override
+        {
+            return playerInputs[index];
+        }
+
+    private:
+        // The number of frames of inputs and hashes kept. Has to be larger than twice the input delay.
+        static const unsigned historySize = 32;
+
+        // Packets contain the frame number the input applies to, the input state and a state hash.
+        static const int packetSize = sizeof(u32) + sizeof(u8) + sizeof(u32);
+
+        // The session settings contain a tag, the random seed and the input delay.
+        static const int settingsSize = 3 + sizeof(u64) + sizeof(u8);
+
+        void Start(u64 inSeed, int inInputDelay);
+        void SendInput(u32 inputFrame, u8 state, u32 hash);
+        void CheckHash(u32 hashFrame);
+
+        // Called by the network reader for each packet received
+        bool OnPacket(const u8* packet);
+
+        class PeerReader : public CTask
+        {
+        public:
+            PeerReader(CSocket* inPeer, LockstepServer* inOuter)
+                : active(true)
+                , peer(inPeer)
+                , outer(inOuter)
+                , packetFill(0)
+            {}
+
+            virtual void Run() override;
+            volatile bool active;
+        private:
+            bool Receive();
+
+            CSocket* peer;
+            LockstepServer* outer;
+            u8 packet[packetSize];
+            int packetFill;
+        };
+
+        ProxyInput playerInputs[maxPlayerCount];
+        CSocket* peer;
+        PeerReader* peerReader;
+        volatile bool connected;
+
+        u64 seed;
+        int inputDelay;
+        u32 frame; // The next frame to simulate
+
+        u8 localInputs[historySize];
+        u32 localHashes[historySize];
+        u8 remoteInputs[historySize];
+        u32 remoteHashes[historySize];
+        volatile u32 remoteFrames; // The number of frames the remote input is known for
+
+        unsigned stalledFrames;
+        unsigned desyncs;
+    };
+}
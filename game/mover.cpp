@@ -7,12 +7,12 @@ Mover::Mover(class GameServer &inWorld, u8 inImageGroup, u8 inImageCount,
              Direction inDirection, int inSpeed,
              CollisionMask inCollisionTargetMask, CollisionMask inCollisionSourceMask)
     : Sprite(inWorld, inImageGroup, inImageCount, inCollisionTargetMask, inCollisionSourceMask)
-    , direction(inDirection)
-    , speed(inSpeed)
 {
-    if(static_cast<unsigned>(direction) < GetImageCount())
+    SetSpeed(inSpeed);
+    partition->Heading(slot) = static_cast<unsigned>(inDirection);
+    if(static_cast<unsigned>(inDirection) < GetImageCount())
     {
-        SetImageIndex(static_cast<unsigned>(direction));
+        SetImageIndex(static_cast<unsigned>(inDirection));
     }
     else
     {
@@ -22,7 +22,7 @@ Mover::Mover(class GameServer &inWorld, u8 inImageGroup, u8 inImageCount,
 
 void Mover::UpdatePosition()
 {
-    Vector<s16> delta = direction.ToDelta(speed);
+    Vector<s16> delta = GetDirection().ToDelta(GetSpeed());
     SetPosition(GetPosition() + delta);
 }
 
@@ -33,7 +33,7 @@ void Mover::Update()
 
 void Mover::SetDirection(const Direction& dir)
 {
-    direction = dir;
+    partition->Heading(slot) = static_cast<unsigned>(dir);
     if(static_cast<unsigned>(dir) < GetImageCount())
     {
         SetImageIndex(static_cast<unsigned>(dir));
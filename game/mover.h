@@ -19,14 +19,14 @@ namespace hfh3
           */
         virtual void Update() override;
 
-        const Direction& GetDirection() const
+        Direction GetDirection() const
         {
-            return direction;
+            return Direction(unsigned(partition->Heading(slot)));
         }
 
         int GetSpeed() const
         {
-            return speed;
+            return partition->Speed(slot);
         }
 
     protected:
@@ -38,15 +38,10 @@ namespace hfh3
 
         void SetSpeed(int s)
         {
-            speed = s;
+            partition->Speed(slot) = s;
         }
 
 
         void SetDirection(const Direction& dir);
-
-
-    private:
-        Direction direction;
-        int     speed;
     };
 }
@@ -0,0 +1,96 @@
+#include "game/partition.h"
+#include "game/actor.h"
+#include "util/direction.h"
+
+#include <circle/util.h>
+
+using namespace hfh3;
+
+void Partition::Add(Actor* actor, u16 id, CollisionMask targetMask, CollisionMask sourceMask)
+{
+    actor->partition = this;
+    actor->slot = actors.Size();
+
+    actors.Append(actor);
+    ids.Append(id);
+    positions.Append();
+    previousPositions.Append();
+    shapes.Append(0, 0, 16, 16);
+    images.Append(0);
+    flags.Append(PositionDirty);
+    headings.Append(Direction::Stopped);
+    speeds.Append(0);
+    targetMasks.Append(targetMask);
+    sourceMasks.Append(sourceMask);
+}
+
+void Partition::Adopt(Actor* actor)
+{
+    Partition* other = actor->partition;
+    int otherSlot = actor->slot;
+    if(other == this)
+    {
+        return;
+    }
+
+    actors.Append(actor);
+    ids.Append(other->ids[otherSlot]);
+    positions.Append(other->positions[otherSlot]);
+    previousPositions.Append(other->previousPositions[otherSlot]);
+    shapes.Append(other->shapes[otherSlot]);
+    images.Append(other->images[otherSlot]);
+    flags.Append(other->flags[otherSlot]);
+    headings.Append(other->headings[otherSlot]);
+    speeds.Append(other->speeds[otherSlot]);
+    targetMasks.Append(other->targetMasks[otherSlot]);
+    sourceMasks.Append(other->sourceMasks[otherSlot]);
+
+    other->Remove(otherSlot);
+    actor->partition = this;
+    actor->slot = actors.Size()-1;
+}
+
+void Partition::Remove(int slot)
+{
+    actors.Pull(slot);
+    ids.Pull(slot);
+    positions.Pull(slot);
+    previousPositions.Pull(slot);
+    shapes.Pull(slot);
+    images.Pull(slot);
+    flags.Pull(slot);
+    headings.Pull(slot);
+    speeds.Pull(slot);
+    targetMasks.Pull(slot);
+    sourceMasks.Pull(slot);
+
+    // The last actor has been moved into the freed slot
+    if(slot < actors.Size())
+    {
+        actors[slot]->slot = slot;
+    }
+}
+
+void Partition::StorePreviousPositions()
+{
+    int count = positions.Size();
+    if(count > 0)
+    {
+        memcpy(&previousPositions[0], &positions[0], count * sizeof(Vector<s16>));
+    }
+}
+
+void Partition::Clear()
+{
+    actors.ClearFast();
+    ids.ClearFast();
+    positions.ClearFast();
+    previousPositions.ClearFast();
+    shapes.ClearFast();
+    images.ClearFast();
+    flags.ClearFast();
+    headings.ClearFast();
+    speeds.ClearFast();
+    targetMasks.ClearFast();
+    sourceMasks.ClearFast();
+}
@@ -1,7 +1,10 @@
 #pragma once
+#include <circle/types.h>
+
+#include "util/array.h"
 #include "util/rect.h"
 #include "util/vector.h"
-#include "util/list.h"
+#include "game/collisionmask.h"
 
 namespace hfh3
 {
@@ -10,11 +13,24 @@ namespace hfh3
       * the amount of objects to consider when rendering or performing
       * hit tests, as one only has to consider actors in partitions
       * that overlap the area of interest.
+      *
+      * The partition also owns the frequently accessed state of its actors,
+      * stored in parallel arrays indexed by slot. This lets the main loops
+      * stream linearly through memory instead of visiting each actor object.
+      * Removing an actor moves the last actor into the vacated slot and
+      * updates its slot index, so Actor pointers remain valid handles.
       */
-    class Partition : public List<class Actor*>
+    class Partition
     {
     public:
 
+        enum Flags : u8
+        {
+            Destroyed     = 1 << 0, // The actor has been scheduled for destruction
+            PositionDirty = 1 << 1, // The actor has moved since its partition was last checked
+            Hidden        = 1 << 2, // The actor should not be drawn
+        };
+
         Partition()
             : bounds()
             , extendedBounds()
@@ -33,8 +49,68 @@ namespace hfh3
         // plus a padding to cover children that extend beyond the inner bounds
         const Rect<s16>& GetExtendedBounds() const { return extendedBounds; }
 
+        /** Returns the number of actors in the partition */
+        int Size() const { return actors.Size(); }
+
+        bool IsEmpty() const { return actors.IsEmpty(); }
+
+        /** Adds a new actor with default state to the end of the partition.
+          * The id identifies the actor to clients for as long as it exists.
+          */
+        void Add(class Actor* actor, u16 id, CollisionMask targetMask, CollisionMask sourceMask);
+
+        /** Moves an actor and its state from its current partition to this one.
+          */
+        void Adopt(class Actor* actor);
+
+        /** Removes the actor in a slot by moving the last actor into it.
+          */
+        void Remove(int slot);
+
+        /** Removes all actors from the partition without deleting them.
+          */
+        void Clear();
+
+        // Accessors for the per actor state
+        class Actor* GetActor(int slot) { return actors[slot]; }
+        u16 Id(int slot) const { return ids[slot]; }
+        Vector<s16>& Position(int slot) { return positions[slot]; }
+        const Vector<s16>& PreviousPosition(int slot) const { return previousPositions[slot]; }
+        Rect<s8>& Shape(int slot) { return shapes[slot]; }
+        u8& Image(int slot) { return images[slot]; }
+        u8& Flags(int slot) { return flags[slot]; }
+        u8& Heading(int slot) { return headings[slot]; }
+        s8& Speed(int slot) { return speeds[slot]; }
+        CollisionMask TargetMask(int slot) { return targetMasks[slot]; }
+        CollisionMask SourceMask(int slot) { return sourceMasks[slot]; }
+
+        /** Remembers the current positions of all actors as their previous ones.
+          * Called before each simulation tick, so actors can be drawn in between.
+          */
+        void StorePreviousPositions();
+
+        /** Returns the bounding rectangle of the actor in a slot in stage coordinates.
+          */
+        Rect<s16> GetBounds(int slot)
+        {
+            const Rect<s8>& shape = shapes[slot];
+            return Rect<s16>(positions[slot] + Vector<s16>(shape.origin), Vector<s16>(shape.size));
+        }
+
     private:
         Rect<s16> bounds;
         Rect<s16> extendedBounds;
+
+        Array<class Actor*> actors;
+        Array<u16> ids;                 // Stable id of the actor, unique among the live actors
+        Array<Vector<s16>> positions;   // Top left corner of the actor in stage coordinates
+        Array<Vector<s16>> previousPositions; // Position before the last simulation tick
+        Array<Rect<s8>> shapes;         // Bounding rectangle relative to the position
+        Array<u8> images;               // Image group in the high nibble and image index in the low one
+        Array<u8> flags;                // Combination of the Flags above
+        Array<u8> headings;             // Direction::Value the actor is moving in
+        Array<s8> speeds;               // Number of pixels moved per frame
+        Array<CollisionMask> targetMasks; // Collision layers the actor can be the target of
+        Array<CollisionMask> sourceMasks; // Collision layers the actor can generate collision events with
     };
 }
@@ -0,0 +1,202 @@
+#include "game/partitiontree.h"
+#include "game/actor.h"
+
+#include <assert.h>
+
+using namespace hfh3;
+
+PartitionTree::PartitionTree(const Vector<s16>& inStageSize, int inMaxActorSize)
+    : stageSize(inStageSize)
+    , maxActorSize(inMaxActorSize)
+    , changed(false)
+{
+    root.bounds = Rect<s16>({0,0}, stageSize);
+    root.children = nullptr;
+    root.partition = AllocatePartition(root.bounds);
+    leaves.Append(root.partition);
+}
+
+PartitionTree::~PartitionTree()
+{
+    DeleteChildren(&root);
+    if(root.partition)
+    {
+        delete root.partition;
+    }
+    for(Partition* partition : freePartitions)
+    {
+        delete partition;
+    }
+}
+
+void PartitionTree::DeleteChildren(Node* node)
+{
+    if(node->children)
+    {
+        for(int i = 0; i < 4; i++)
+        {
+            DeleteChildren(&node->children[i]);
+            if(node->children[i].partition)
+            {
+                delete node->children[i].partition;
+            }
+        }
+        delete[] node->children;
+        node->children = nullptr;
+    }
+}
+
+PartitionTree::Node* PartitionTree::FindLeaf(Node* node, const Vector<s16>& position)
+{
+    while(node->children)
+    {
+        // Children are ordered top left, top right, bottom left, bottom right
+        Vector<s16> center = node->bounds.origin + node->bounds.size / 2;
+        int index = (position.x >= center.x ? 1 : 0) | (position.y >= center.y ? 2 : 0);
+        node = &node->children[index];
+    }
+    return node;
+}
+
+void PartitionTree::GetPartitions(const Rect<s16>& rect, Array<Partition*>& result)
+{
+    // Actors belong to the partition containing their position, but extend up to
+    // maxActorSize to the right and below it. Grow the rectangle in the opposite
+    // directions to include partitions whose actors reach into it.
+    Vector<s16> padding(maxActorSize, maxActorSize);
+    CollectPartitions(&root, Rect<s16>(rect.origin - padding, rect.size + padding), result);
+}
+
+void PartitionTree::CollectPartitions(Node* node, const Rect<s16>& rect, Array<Partition*>& result)
+{
+    if(!node->bounds.OverlapsMod(rect, stageSize))
+    {
+        return;
+    }
+
+    if(node->children)
+    {
+        for(int i = 0; i < 4; i++)
+        {
+            CollectPartitions(&node->children[i], rect, result);
+        }
+    }
+    else
+    {
+        result.Append(node->partition);
+    }
+}
+
+void PartitionTree::CollectLeaves(Node* node)
+{
+    if(node->children)
+    {
+        for(int i = 0; i < 4; i++)
+        {
+            CollectLeaves(&node->children[i]);
+        }
+    }
+    else
+    {
+        leaves.Append(node->partition);
+    }
+}
+
+bool PartitionTree::Rebalance()
+{
+    changed = false;
+    Rebalance(&root);
+    if(changed)
+    {
+        leaves.ClearFast();
+        CollectLeaves(&root);
+    }
+    return changed;
+}
+
+// Returns the number of actors in the subtree after rebalancing it
+int PartitionTree::Rebalance(Node* node)
+{
+    if(!node->children)
+    {
+        int count = node->partition->Size();
+        if(count <= splitThreshold || node->bounds.size.x <= minNodeSize)
+        {
+            return count;
+        }
+        Split(node);
+    }
+
+    int count = 0;
+    bool childrenAreLeaves = true;
+    for(int i = 0; i < 4; i++)
+    {
+        count += Rebalance(&node->children[i]);
+        childrenAreLeaves = childrenAreLeaves && !node->children[i].children;
+    }
+
+    if(childrenAreLeaves && count < mergeThreshold)
+    {
+        Merge(node);
+    }
+    return count;
+}
+
+void PartitionTree::Split(Node* node)
+{
+    assert(!node->children && node->partition);
+    Vector<s16> half = node->bounds.size / 2;
+
+    node->children = new Node[4];
+    for(int i = 0; i < 4; i++)
+    {
+        Node& child = node->children[i];
+        Vector<s16> offset((i & 1) ? half.x : 0, (i & 2) ? half.y : 0);
+        child.bounds = Rect<s16>(node->bounds.origin + offset, half);
+        child.children = nullptr;
+        child.partition = AllocatePartition(child.bounds);
+    }
+
+    // Taking the actors from the end avoids shuffling the remaining ones
+    Partition* partition = node->partition;
+    node->partition = nullptr;
+    while(!partition->IsEmpty())
+    {
+        int last = partition->Size() - 1;
+        FindLeaf(node, partition->Position(last))->partition->Adopt(partition->GetActor(last));
+    }
+    FreePartition(partition);
+    changed = true;
+}
+
+void PartitionTree::Merge(Node* node)
+{
+    assert(node->children && !node->partition);
+    node->partition = AllocatePartition(node->bounds);
+
+    for(int i = 0; i < 4; i++)
+    {
+        Partition* partition = node->children[i].partition;
+        while(!partition->IsEmpty())
+        {
+            node->partition->Adopt(partition->GetActor(partition->Size() - 1));
+        }
+        FreePartition(partition);
+    }
+    delete[] node->children;
+    node->children = nullptr;
+    changed = true;
+}
+
+Partition* PartitionTree::AllocatePartition(const Rect<s16>& bounds)
+{
+    Partition* partition = freePartitions.IsEmpty() ? new Partition() : freePartitions.Pop();
+    partition->SetBounds(bounds);
+    return partition;
+}
+
+void PartitionTree::FreePartition(Partition* partition)
+{
+    assert(partition->IsEmpty());
+    freePartitions.Append(partition);
+}
@@ -0,0 +1,80 @@
+#pragma once
+#include <circle/types.h>
+
+#include "util/array.h"
+#include "util/rect.h"
+#include "util/vector.h"
+#include "game/partition.h"
+
+namespace hfh3
+{
+    /** Adaptive partitioning of the stage using a quadtree.
+      * Each leaf node owns a partition. When a leaf holds more than splitThreshold
+      * actors it is split into four quadrants, and four sibling leaves are merged
+      * back into their parent when they hold fewer than mergeThreshold actors in total.
+      * The gap between the thresholds keeps nodes from being split and merged
+      * repeatedly as actors move back and forth.
+      * Like the fixed partition grid, lookups wrap around the edges of the stage.
+      */
+    class PartitionTree
+    {
+    public:
+        static const int splitThreshold = 64;
+        static const int mergeThreshold = 32;
+        static const int minNodeSize = 32;
+
+        PartitionTree(const Vector<s16>& inStageSize, int inMaxActorSize);
+        ~PartitionTree();
+
+        /** Returns the leaf partition containing a position inside the stage.
+          */
+        Partition& GetPartition(const Vector<s16>& position)
+        {
+            return *FindLeaf(&root, position)->partition;
+        }
+
+        /** Appends all leaf partitions that may contain actors overlapping
+          * the rectangle to the result array.
+          */
+        void GetPartitions(const Rect<s16>& rect, Array<Partition*>& result);
+
+        /** Splits crowded leaves and merges sparse ones, moving the actors into
+          * the new partitions. Returns true if the set of leaves changed.
+          */
+        bool Rebalance();
+
+        /** Returns the partitions of all the leaf nodes.
+          */
+        Array<Partition*>& GetLeaves()
+        {
+            return leaves;
+        }
+
+    private:
+        struct Node
+        {
+            Rect<s16> bounds;
+            Node* children;       // Array of four child nodes, or nullptr for leaf nodes
+            Partition* partition; // The partition owned by a leaf node
+        };
+
+        Node* FindLeaf(Node* node, const Vector<s16>& position);
+        void CollectPartitions(Node* node, const Rect<s16>& rect, Array<Partition*>& result);
+        void CollectLeaves(Node* node);
+        int Rebalance(Node* node);
+        void Split(Node* node);
+        void Merge(Node* node);
+        void DeleteChildren(Node* node);
+
+        // Partitions are recycled to keep the memory already reserved for their arrays.
+        Partition* AllocatePartition(const Rect<s16>& bounds);
+        void FreePartition(Partition* partition);
+
+        const Vector<s16> stageSize;
+        const int maxActorSize;
+        Node root;
+        bool changed;
+        Array<Partition*> leaves;
+        Array<Partition*> freePartitions;
+    };
+}
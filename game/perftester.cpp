@@ -5,47 +5,204 @@
 #include "util/vector.h"
 #include "util/log.h"
 #include "util/random.h"
+#include "util/workerpool.h"
+#include "util/simd.h"
 #include "config.h"
 
+#include "game/actorpool.h"
+#include "game/enemy.h"
+#include "game/shot.h"
+#include "game/imagesets.h"
+#include "game/view.h"
+
+#include "render/image.h"
+#include "render/imagesheet.h"
+
 using namespace hfh3;
 
 PerfTester::PerfTester(MainLoop& inMainLoop, class Input& inInput, Network& inNetwork)
     : GameServer(inMainLoop, inInput, inNetwork)
     , frameCount(UINT_MAX)
+    , test(GetTest(CONFIG_PERF_TEST))
     , actorCount(0)
+    , variant(0)
+    , spawnPattern(Uniform)
+    , deltaCommands(imageSheet)
+    , startStrategy(screen.GetPresentStrategy())
+    , startTickRate(mainLoop.GetTickRate())
+    , startGovernor(mainLoop.GetGovernor().IsEnabled())
+    , missedStart(0)
 {
-    INFO("%%[BEGIN TEST RUN %s%s%s%s%s]",
-        CONFIG_GPU_PAGE_FLIPPING?"pageflip":CONFIG_DMA_PARALLEL?"dma2":CONFIG_DMA_FRAME_COPY?"dma1":"memcpy",
-        CONFIG_NEON_RENDER?"_neon":"",
+    // Update changes the present strategy and the worker pool, so it has to run on the main core
+    pipelineUpdate = false;
+
+    // Run exactly one update per frame, so the measurements of each frame do not
+    // depend on how many ticks had to be caught up.
+    mainLoop.SetTickRate(0);
+
+    // The sweeps measure the same work in every test, so the governor only runs in
+    // its own comparison.
+    mainLoop.GetGovernor().SetEnabled(false);
+
+    INFO("%%[BEGIN TEST RUN %s%s%s%s%s%s%s%s%s%s%s]",
+        CONFIG_PERF_TEST,
+        CONFIG_SIMD_RENDER?"_simd":"",
+        CONFIG_SPAN_SPRITES?"_spans":"",
+        CONFIG_PACKED_SPRITES?"_packed":"",
+        CONFIG_FIXED_BLITTERS?"_fixed":"",
+        CONFIG_BACKGROUND_CACHE?"_bgcache":"",
+        CONFIG_TEXT_CACHE?"_textcache":"",
         CONFIG_USE_ITEM_POOL?"_itemPool":"",
+        CONFIG_USE_ACTOR_POOL?"_actorPool":"",
         CONFIG_OWN_MEMSET?"_customMemSet":"",
         CONFIG_PRERENDER_STARFIELD?"_prerender":""
     );
-    INFO("actorCount visible update render postRender otherGameLoop present totalFrameTime updateActors updatePartition renderPrepare fps");
+    INFO("actorCount partitioning spawn rendering workers present governor partitionCount visible update render postRender otherGameLoop present presentBytes queueDepth latency totalFrameTime updateActors updatePartition collisionCheck pendingDeletes renderPrepare finishFrame deltaEncode frameBytes deltaBytes collisionPairs actorAllocs heapAllocs missed quality fps");
 }
 
 PerfTester::~PerfTester()
 {
+    WorkerPool::Instance().SetActiveWorkers(WorkerPool::Instance().GetWorkerCount());
+    screen.SetPresentStrategy(startStrategy);
+    mainLoop.SetTickRate(startTickRate);
+    mainLoop.GetGovernor().SetEnabled(startGovernor);
     INFO("%%[END OF TEST RUN]");
 }
 
 static const int FRAMES_PER_TEST = 60 * 60; // Run each test for 3600 frames or at least 60 seconds (longer if we miss frames.)
 static const int ACTOR_INCREMENT = 2000;    // Number of objects to add each test.
 static const int MAX_ACTOR_COUNT = 14000;   // The test will exit after reaching this number of actors in the level.
+static const int LAYOUT_VARIANTS = 4;       // Number of spawn pattern and partitioning combinations in the partitioning sweep.
+static const int BAND_HEIGHT = 32;          // Height of the bands in the tests using band rendering.
+static const int CLUSTER_COUNT = 6;         // Number of enemy groups in the clustered tests.
+static const int CLUSTER_RADIUS = 128;      // Max distance from the center of a group along each axis.
+static const int MISSILES_PER_FRAME = 4;    // Number of player missiles to spawn each frame to exercise the collision check.
+static const int SPAWN_BENCHMARK_ROUNDS = 100; // Number of times to spawn and destroy a batch of enemies in the spawn benchmark.
+static const int SPAWN_BENCHMARK_BATCH = 256;  // Number of enemies alive at once in the spawn benchmark.
+static const int BLIT_BENCHMARK_ROUNDS = 50;    // Number of times to draw every image of the sheet in the blit benchmark.
+static const int LAYOUT_BENCHMARK_ROUNDS = 200; // Number of batches of sprites to draw with cold caches in the layout benchmark.
+static const int LAYOUT_BENCHMARK_BATCH = 64;   // Number of random sprites drawn after evicting the caches.
+static const int EVICT_SIZE = 1024 * 1024;      // Bytes written to push the image sheets out of the L1 and L2 caches.
+static const int SIMD_BENCHMARK_ROUNDS = 100;   // Number of times to run each kernel over the buffer in the SIMD benchmark.
+static const int SIMD_BENCHMARK_ROW = 640;      // Length in bytes of each kernel call in the SIMD benchmark, a screen row.
+static const int SIMD_BENCHMARK_ROWS = 64;      // Number of rows in the buffer of the SIMD benchmark, small enough to stay in the L2 cache.
+static const int BACKGROUND_BENCHMARK_FRAMES = 600; // Number of frames of scrolling background to draw in the background benchmark.
+static const int BACKGROUND_CHANGE_INTERVAL = 8;    // Change a visible background cell every this many frames in the background benchmark.
+
+PerfTester::Test PerfTester::GetTest(const char* name)
+{
+    static const struct
+    {
+        const char* name;
+        Test test;
+    } tests[] = {
+        {"actors",       ActorSweep},
+        {"partitioning", PartitionSweep},
+        {"workers",      WorkerSweep},
+        {"present",      PresentSweep},
+        {"governor",     GovernorComparison},
+        {"spawn",        SpawnBenchmark},
+        {"blit",         BlitBenchmark},
+        {"fixedblit",    FixedBlitBenchmark},
+        {"simd",         SimdBenchmark},
+        {"spritelayout", LayoutBenchmark},
+        {"background",   BackgroundBenchmark},
+    };
+    for(const auto& entry : tests)
+    {
+        if(strcmp(entry.name, name) == 0)
+        {
+            return entry.test;
+        }
+    }
+    WARN("Unknown performance test %s, running the actor sweep", name);
+    return ActorSweep;
+}
+
+int PerfTester::GetVariantCount() const
+{
+    switch(test)
+    {
+    case PartitionSweep:
+        return LAYOUT_VARIANTS;
+    case WorkerSweep:
+        // Direct rendering followed by band rendering with one worker up to all
+        // workers of the pool, giving the scaling curve.
+        return 1 + WorkerPool::Instance().GetWorkerCount();
+    case GovernorComparison:
+        return 2;
+    default:
+        return 1;
+    }
+}
+
+void PerfTester::ApplyVariant()
+{
+    spawnPattern = (test == PartitionSweep && (variant & 1)) ? Clustered : Uniform;
+    SetPartitionMode((test == PartitionSweep && (variant & 2)) ? PartitionMode::Adaptive : PartitionMode::Grid);
+    int workers = test == WorkerSweep ? variant : 0;
+    screen.SetBandHeight(workers > 0 ? BAND_HEIGHT : 0);
+    WorkerPool::Instance().SetActiveWorkers(workers > 0 ? workers : 1);
+    // The present sweep starts each test with the first strategy, the others use the
+    // strategy the game uses.
+    screen.SetPresentStrategy(test == PresentSweep ? 0 : startStrategy);
+    mainLoop.GetGovernor().SetEnabled(test == GovernorComparison && variant == 1);
+}
+
+bool PerfTester::RunBenchmark()
+{
+    switch(test)
+    {
+    case SpawnBenchmark:
+        RunSpawnBenchmark();
+        return true;
+    case BlitBenchmark:
+        RunBlitBenchmark();
+        return true;
+    case FixedBlitBenchmark:
+        RunFixedBlitBenchmark();
+        return true;
+    case SimdBenchmark:
+        RunSimdBenchmark();
+        return true;
+    case LayoutBenchmark:
+        RunLayoutBenchmark();
+        return true;
+    case BackgroundBenchmark:
+        RunBackgroundBenchmark();
+        return true;
+    default:
+        return false;
+    }
+}
 
 void PerfTester::Update()
 {
     // Initial level load
     if (frameCount == UINT_MAX)
     {
+        if(RunBenchmark())
+        {
+            mainLoop.DestroyClient(this);
+            return;
+        }
+        ApplyVariant();
         LoadLevel();
     }
     // Update stats after running the preset amount of frames
-    else if(frameCount == FRAMES_PER_TEST)
+    else if(frameCount == (test == PresentSweep ? FRAMES_PER_TEST / unsigned(screen.GetPresentStrategyCount()) : FRAMES_PER_TEST))
     {
         LogStats();
 
-        if(actorCount >= MAX_ACTOR_COUNT)
+        // The present sweep runs each test with every present strategy in turn, logging
+        // a row for each, so they can be compared under the same load.
+        int strategy = screen.GetPresentStrategy() + 1;
+        if(test == PresentSweep && strategy < screen.GetPresentStrategyCount())
+        {
+            screen.SetPresentStrategy(strategy);
+            ClearStats();
+        }
+        else if(actorCount >= MAX_ACTOR_COUNT && variant == GetVariantCount()-1)
         {
             mainLoop.DestroyClient(this);
             return;
@@ -58,60 +215,415 @@ void PerfTester::Update()
     InitTicks();
     commands.Clear();
 
-    for(Partition& partition : partitions)
+    for(int i=0; i<MISSILES_PER_FRAME; i++)
+    {
+        SpawnTestMissile();
+    }
+
+    UpdateActors();
+    current.actorUpdate = GetTicks();
+
+    AssignPartitions();
+    current.assignPartitions = GetTicks();
+
+    PerformCollisionCheck();
+    current.collisionCheck = GetTicks();
+    current.collisionPairs = broadphase.GetPairCount();
+
+    PerformPendingDeletes();
+    current.pendingDeletes = GetTicks();
+
+    UpdateCamera(player[0]);
+    current.visibleActors = BuildCommandBuffer(player[0], player[1], viewport, commands);
+    current.buildCommandBuffer = GetTicks();
+
+    // Perform the same work as Send does before handing the buffer to a socket
+    // so the cost of preparing a frame for a client can be measured.
+    commands.FinishFrame();
+    current.finishFrame = GetTicks();
+    current.frameBytes = commands.GetByteSize();
+
+    deltaCommands.Clear();
+    BuildCommandBuffer(player[0], player[1], viewport, deltaCommands, &deltaSprites);
+    deltaCommands.FinishFrame();
+    current.deltaEncode = GetTicks();
+    current.deltaBytes = deltaCommands.GetByteSize();
+
+    UpdateStats();
+}
+
+
+void PerfTester::LoadLevel(int level)
+{
+    if(level >= 0)
     {
-        Rect<s16> bounds = partition.GetBounds();
-        for(Actor* actor : partition.Reverse())
+        // Move on to the next variant of the test, and increase the number of actors after
+        // running all of them. The governor comparison only runs the highest count.
+        if(actorCount == 0 || ++variant == GetVariantCount())
+        {
+            variant = 0;
+            actorCount = test == GovernorComparison ? MAX_ACTOR_COUNT : actorCount + ACTOR_INCREMENT;
+        }
+
+        ClearLevel();
+        ApplyVariant();
+
+        // Place the first group where the camera is, like enemies gathering around a player.
+        clusterCenters.ClearFast();
+        clusterCenters.Append(player[0].camera);
+        while(clusterCenters.Size() < CLUSTER_COUNT)
         {
-            assert(actor);
-            actor->Update();
+            clusterCenters.Append(stage.WrapCoordinate(Random::Instance().GetVector<s16>()));
+        }
+
+        for(int i=0; i<actorCount; i++)
+        {
+            SpawnTestEnemy();
+        }
+    }
+
+    // Only count the time and allocations while the test is running, not populating the level.
+    ClearStats();
+    poolStart = ActorPool::Instance().GetStatistics();
+}
+
+Vector<s16> PerfTester::GetSpawnPosition()
+{
+    if(spawnPattern == Clustered)
+    {
+        // Adding two random offsets makes the groups denser towards the center.
+        const Vector<s16>& center = clusterCenters[Rand() % clusterCenters.Size()];
+        Vector<s16> offset(Rand() % (CLUSTER_RADIUS+1) + Rand() % (CLUSTER_RADIUS+1) - CLUSTER_RADIUS,
+                           Rand() % (CLUSTER_RADIUS+1) + Rand() % (CLUSTER_RADIUS+1) - CLUSTER_RADIUS);
+        return stage.WrapCoordinate(center + offset);
+    }
+    return stage.WrapCoordinate(Random::Instance().GetVector<s16>());
+}
+
+void PerfTester::SpawnTestEnemy()
+{
+    Actor* enemy = new Enemy(*this, imageSheet);
+    enemy->SetPosition(GetSpawnPosition());
+    // Keep the number of enemies constant during a test
+    enemy->SetDestructionHandler([=]()
+    {
+        SpawnTestEnemy();
+    });
+}
+
+void PerfTester::RunSpawnBenchmark()
+{
+    Array<Actor*> batch;
+    batch.Reserve(SPAWN_BENCHMARK_BATCH);
 
-            if( actor->IsDestroyed())
+    unsigned start = GetTicks();
+    for(int round = 0; round < SPAWN_BENCHMARK_ROUNDS; round++)
+    {
+        // Spawn a batch of enemies the same way SpawnEnemy does, and destroy them
+        // again like PerformPendingDeletes would, so freed memory gets reused.
+        for(int i = 0; i < SPAWN_BENCHMARK_BATCH; i++)
+        {
+            Actor* enemy = new Enemy(*this, imageSheet);
+            enemy->SetPosition(Vector<s16>(i, round));
+            enemy->SetDestructionHandler([=]()
             {
-                pendingDelete.Append(actor);
+                UpdateScore(enemy->GetKiller(), enemy->GetScore());
+            });
+            batch.Append(enemy);
+        }
+        while(!batch.IsEmpty())
+        {
+            Actor* enemy = batch.Pop();
+            enemy->partition->Remove(enemy->slot);
+            delete enemy;
+        }
+    }
+    unsigned ticks = GetTicks() - start;
+
+    int count = SPAWN_BENCHMARK_ROUNDS * SPAWN_BENCHMARK_BATCH;
+    INFO("Spawn benchmark (callbackInlineSize=%d): %d enemies spawned and destroyed in %.2f us, %.3f us each",
+        CONFIG_CALLBACK_INLINE_SIZE,
+        count,
+        double(ticks) / CLOCKHZ * 1000000.0,
+        double(ticks) / count / CLOCKHZ * 1000000.0
+    );
+}
+
+void PerfTester::RunBlitBenchmark()
+{
+    static const ScreenManager::BlitMode modes[] = {
+        ScreenManager::BlitMode::Masked,
+        ScreenManager::BlitMode::Scalar,
+        ScreenManager::BlitMode::Spans,
+    };
+    static const char* modeNames[] = { "masked", "scalar", "spans" };
+
+    // Compare the generic blit modes only; RunFixedBlitBenchmark covers the fixed blitters
+    ScreenManager::BlitMode previousMode = screen.GetBlitMode();
+    bool previousFixed = screen.GetFixedBlitters();
+    screen.SetFixedBlitters(false);
+    int imageCount = imageSheet.GetImageCount();
+    int groupSize = imageSheet.GetGroupSize();
+    Vector<s16> range = screen.GetSize() + Vector<s16>(16, 16);
+    for(unsigned m = 0; m < sizeof(modes)/sizeof(modes[0]); m++)
+    {
+        screen.SetBlitMode(modes[m]);
+        unsigned start = GetTicks();
+        for(int round = 0; round < BLIT_BENCHMARK_ROUNDS; round++)
+        {
+            for(int i = 0; i < imageCount; i++)
+            {
+                // Spread the images over the screen, including positions where they
+                // are partially outside it, so the clipping is exercised as well.
+                Vector<s16> position((i * 37 + round * 11) % range.x - 8, (i * 23 + round * 7) % range.y - 8);
+                screen.DrawImage(position, imageSheet[i / groupSize][i % groupSize]);
             }
-            // Check if item has moved out of the partition
-            else if(actor->positionDirty)
+        }
+        unsigned ticks = GetTicks() - start;
+
+        int count = BLIT_BENCHMARK_ROUNDS * imageCount;
+        INFO("Blit benchmark (%s%s%s): %d images drawn in %.2f us, %.3f us each",
+            modeNames[m],
+            modes[m] == ScreenManager::BlitMode::Masked ? "_" : "",
+            modes[m] == ScreenManager::BlitMode::Masked ? Simd::backendName : "",
+            count,
+            double(ticks) / CLOCKHZ * 1000000.0,
+            double(ticks) / count / CLOCKHZ * 1000000.0
+        );
+    }
+    INFO("Blit benchmark: %d opaque spans in %d images", imageSheet.GetSpanCount(), imageCount);
+    screen.SetBlitMode(previousMode);
+    screen.SetFixedBlitters(previousFixed);
+}
+
+void PerfTester::RunFixedBlitBenchmark()
+{
+    bool previous = screen.GetFixedBlitters();
+    int groupSize = imageSheet.GetGroupSize();
+    Vector<s16> range = screen.GetSize() - Vector<s16>(16, 16);
+    for(int group = 0; group < imageSheet.GetGroupCount(); group++)
+    {
+        // Draw each group with both blitters, at positions where the sprites are
+        // entirely on screen, so the fixed blitters are used when enabled.
+        unsigned ticks[2];
+        for(int fixed = 0; fixed < 2; fixed++)
+        {
+            screen.SetFixedBlitters(fixed);
+            unsigned start = GetTicks();
+            for(int round = 0; round < BLIT_BENCHMARK_ROUNDS; round++)
             {
-                actor->positionDirty = false;
-                if(!bounds.Contains(actor->position) )
+                for(int i = 0; i < groupSize; i++)
                 {
-                    needsNewPartition.Append(actor);
+                    Vector<s16> position((i * 37 + round * 11) % range.x, (i * 23 + round * 7) % range.y);
+                    screen.DrawImage(position, imageSheet[group][i]);
                 }
             }
+            ticks[fixed] = GetTicks() - start;
         }
+
+        int count = BLIT_BENCHMARK_ROUNDS * groupSize;
+        INFO("Fixed blit benchmark (group %d, %s): generic %.3f us, fixed %.3f us per sprite",
+            group,
+            imageSheet[group][0].GetTransparent() < 0 ? "opaque" : "masked",
+            double(ticks[0]) / count / CLOCKHZ * 1000000.0,
+            double(ticks[1]) / count / CLOCKHZ * 1000000.0
+        );
     }
-    current.actorUpdate = GetTicks();
+    screen.SetFixedBlitters(previous);
+}
 
-    AssignPartitions();
-    current.assignPartitions = GetTicks();
+void PerfTester::RunSimdBenchmark()
+{
+    static const int size = SIMD_BENCHMARK_ROW * SIMD_BENCHMARK_ROWS;
+    u8* src = new u8[size];
+    u8* dst = new u8[size];
+    u8* table = new u8[256];
+    u8* bits = new u8[SIMD_BENCHMARK_ROWS];
 
-    current.visibleActors = BuildCommandBuffer(player[0], player[1], commands);
-    current.buildCommandBuffer = GetTicks();
+    // Sprite like source data with about a quarter of the pixels transparent
+    u32 seed = 1;
+    for(int i = 0; i < size; i++)
+    {
+        seed = seed * 1664525 + 1013904223;
+        src[i] = (seed >> 24) < 64 ? 255 : u8(seed >> 16);
+    }
+    for(int i = 0; i < 256; i++)
+    {
+        table[i] = u8(255 - i);
+    }
+    for(int i = 0; i < SIMD_BENCHMARK_ROWS; i++)
+    {
+        bits[i] = u8(i * 37);
+    }
+    Simd::Fill(dst, 0, size);
 
-    UpdateStats();
+    static const char* kernelNames[] = { "fill", "copy", "copyMasked", "expandBits", "lookup" };
+    for(unsigned kernel = 0; kernel < sizeof(kernelNames) / sizeof(kernelNames[0]); kernel++)
+    {
+        unsigned ticks[2];
+        for(int vector = 0; vector < 2; vector++)
+        {
+            unsigned start = GetTicks();
+            for(int round = 0; round < SIMD_BENCHMARK_ROUNDS; round++)
+            {
+                for(int row = 0; row < SIMD_BENCHMARK_ROWS; row++)
+                {
+                    u8* d = &dst[row * SIMD_BENCHMARK_ROW];
+                    const u8* s = &src[row * SIMD_BENCHMARK_ROW];
+                    switch(kernel)
+                    {
+                    case 0:
+                        vector ? Simd::Fill(d, u8(round), SIMD_BENCHMARK_ROW) : Simd::Scalar::Fill(d, u8(round), SIMD_BENCHMARK_ROW);
+                        break;
+                    case 1:
+                        vector ? Simd::Copy(d, s, SIMD_BENCHMARK_ROW) : Simd::Scalar::Copy(d, s, SIMD_BENCHMARK_ROW);
+                        break;
+                    case 2:
+                        vector ? Simd::CopyMasked(d, s, SIMD_BENCHMARK_ROW, 255) : Simd::Scalar::CopyMasked(d, s, SIMD_BENCHMARK_ROW, 255);
+                        break;
+                    case 3:
+                        // A row of text, one glyph row every 8 pixels
+                        for(int x = 0; x < SIMD_BENCHMARK_ROW; x += 8)
+                        {
+                            vector ? Simd::ExpandBits(d + x, bits[row], u8(round)) : Simd::Scalar::ExpandBits(d + x, bits[row], 0, 8, u8(round));
+                        }
+                        break;
+                    case 4:
+                        vector ? Simd::Lookup(d, s, SIMD_BENCHMARK_ROW, table) : Simd::Scalar::Lookup(d, s, SIMD_BENCHMARK_ROW, table);
+                        break;
+                    }
+                }
+            }
+            ticks[vector] = GetTicks() - start;
+        }
+
+        // Bytes per microsecond is the same as megabytes per second
+        double bytes = double(size) * SIMD_BENCHMARK_ROUNDS;
+        INFO("SIMD benchmark (%s, %s): scalar %.1f MB/s, vector %.1f MB/s",
+            kernelNames[kernel],
+            Simd::backendName,
+            bytes / (double(ticks[0]) / CLOCKHZ * 1000000.0),
+            bytes / (double(ticks[1]) / CLOCKHZ * 1000000.0)
+        );
+    }
+
+    delete[] bits;
+    delete[] table;
+    delete[] dst;
+    delete[] src;
 }
 
-void PerfTester::LoadLevel(int level)
+void PerfTester::RunLayoutBenchmark()
 {
-    ClearStats();
+    // Build a sheet with the other layout to compare against the one used by the game
+    ImageSheet otherSheet(sprites_pixels, sprites_width, sprites_height, 16, 16, 255, 8, !CONFIG_PACKED_SPRITES);
+    ImageSheet* sheets[] = { &imageSheet, &otherSheet };
+    const char* names[] = {
+        CONFIG_PACKED_SPRITES ? "packed" : "shared",
+        CONFIG_PACKED_SPRITES ? "shared" : "packed",
+    };
 
-    if(level >= 0)
+    u8* evict = new u8[EVICT_SIZE];
+    int imageCount = imageSheet.GetImageCount();
+    int groupSize = imageSheet.GetGroupSize();
+    for(int s = 0; s < 2; s++)
     {
-        for(int i=0; i<ACTOR_INCREMENT; i++)
+        // Use the same sequence of sprites and positions for both sheets
+        u32 seed = 1;
+        unsigned ticks = 0;
+        for(int round = 0; round < LAYOUT_BENCHMARK_ROUNDS; round++)
         {
-            SpawnEnemy(Random::Instance().GetVector<s16>());
+            memset(evict, round, EVICT_SIZE);
+
+            unsigned start = GetTicks();
+            for(int i = 0; i < LAYOUT_BENCHMARK_BATCH; i++)
+            {
+                seed = seed * 1664525 + 1013904223;
+                int image = (seed >> 8) % imageCount;
+                Vector<s16> position((seed >> 4) % (screen.GetWidth() - 16), (seed >> 20) % (screen.GetHeight() - 16));
+                screen.DrawImage(position, (*sheets[s])[image / groupSize][image % groupSize]);
+            }
+            ticks += GetTicks() - start;
         }
-        actorCount += ACTOR_INCREMENT;
+
+        int count = LAYOUT_BENCHMARK_ROUNDS * LAYOUT_BENCHMARK_BATCH;
+        INFO("Layout benchmark (%s): %d sprites drawn with cold caches in %.2f us, %.3f us each",
+            names[s],
+            count,
+            double(ticks) / CLOCKHZ * 1000000.0,
+            double(ticks) / count / CLOCKHZ * 1000000.0
+        );
     }
+    delete[] evict;
+}
+
+void PerfTester::RunBackgroundBenchmark()
+{
+    // Fill a quarter of the grid with fortress tiles in a random pattern
+    const int groupSize = imageSheet.GetGroupSize();
+    u32 seed = 1;
+    for(int y = 0; y < stage.GetHeight() / Background::GRID_SCALE; y++)
+    {
+        for(int x = 0; x < stage.GetWidth() / Background::GRID_SCALE; x++)
+        {
+            seed = seed * 1664525 + 1013904223;
+            if((seed >> 24) < 64)
+            {
+                background.SetCell(Background::GridPosition(x, y), u8(ImageSet::Fort0) + (seed >> 8) % 3, (seed >> 12) % groupSize);
+            }
+        }
+    }
+
+    View view(stage, screen);
+    bool previous = background.IsCacheEnabled();
+    for(int cached = 0; cached < 2; cached++)
+    {
+        background.SetCacheEnabled(cached);
+        background.ClearStatistics();
+        unsigned ticks = 0;
+        for(int frame = 0; frame < BACKGROUND_BENCHMARK_FRAMES; frame++)
+        {
+            unsigned start = GetTicks();
+
+            // Scroll diagonally across the stage edges, and change a visible cell
+            // now and then like a fortress being shot at.
+            view.SetOffset(stage.WrapCoordinate(Vector<s16>(frame * 5, frame * 3)));
+            if(frame % BACKGROUND_CHANGE_INTERVAL == 0)
+            {
+                Vector<s16> cell = view.GetOffset() + Vector<s16>((frame * 37) % screen.GetWidth(), (frame * 23) % screen.GetHeight());
+                background.SetCell(stage.WrapCoordinate(cell), u8(ImageSet::Fort0), frame % groupSize);
+            }
+            background.Draw(view);
+            ticks += GetTicks() - start;
+        }
+
+        const Background::Statistics& stats = background.GetStatistics();
+        INFO("Background benchmark (%s): %d frames drawn in %.2f us, %.3f us each, %.2f draw calls and %.2f cells rendered per frame",
+            cached ? "cached" : "cells",
+            BACKGROUND_BENCHMARK_FRAMES,
+            double(ticks) / CLOCKHZ * 1000000.0,
+            double(ticks) / BACKGROUND_BENCHMARK_FRAMES / CLOCKHZ * 1000000.0,
+            double(stats.drawCalls) / BACKGROUND_BENCHMARK_FRAMES,
+            double(stats.cellsRendered) / BACKGROUND_BENCHMARK_FRAMES
+        );
+    }
+    background.SetCacheEnabled(previous);
+    background.Clear();
+}
+
+void PerfTester::SpawnTestMissile()
+{
+    Vector<s16> position = stage.WrapCoordinate(Random::Instance().GetVector<s16>());
+    new Shot(*this, imageSheet, ImageSet::Missile, position, Direction(Rand() % 8), 6, 0);
 }
 
 void PerfTester::ClearStats()
 {
     screen.ClearTimers();
     mainLoop.ClearTimers();
-    sum = {0,0,0,0};
+    sum = {0,0,0,0,0,0,0,0,0,0,0};
     frameCount = 0;
+    missedStart = screen.GetMissedFrames();
 }
 
 #define UPDATE_SUM(field) sum.field += current.field
@@ -120,14 +632,25 @@ void PerfTester::UpdateStats()
 {
     // Convert current absolute time stamps to relative by subtracting the previous 
     // stamp from the next one:
-    current.buildCommandBuffer -= current.assignPartitions;
+    current.deltaEncode -= current.finishFrame;
+    current.finishFrame -= current.buildCommandBuffer;
+    current.buildCommandBuffer -= current.pendingDeletes;
+    current.pendingDeletes -= current.collisionCheck;
+    current.collisionCheck -= current.assignPartitions;
     current.assignPartitions -= current.actorUpdate;
     current.actorUpdate -= frameStart;
 
     UPDATE_SUM(actorUpdate);
     UPDATE_SUM(assignPartitions);
+    UPDATE_SUM(collisionCheck);
+    UPDATE_SUM(pendingDeletes);
     UPDATE_SUM(buildCommandBuffer);
+    UPDATE_SUM(finishFrame);
+    UPDATE_SUM(deltaEncode);
     UPDATE_SUM(visibleActors);
+    UPDATE_SUM(frameBytes);
+    UPDATE_SUM(deltaBytes);
+    UPDATE_SUM(collisionPairs);
     frameCount++;
 }
 
@@ -148,25 +671,50 @@ void PerfTester::LogStats()
 
     double avg_actorUpdate = AVG(sum.actorUpdate);
     double avg_partitions = AVG(sum.assignPartitions);
+    double avg_collision = AVG(sum.collisionCheck);
+    double avg_deletes = AVG(sum.pendingDeletes);
     double avg_build = AVG(sum.buildCommandBuffer);
+    double avg_finish = AVG(sum.finishFrame);
     double avg_update = AVG(mainLoop_sum.update);
     double avg_render = AVG(mainLoop_sum.render);
     double avg_postRender = AVG(mainLoop_sum.postRender);
     unsigned mainLoop_total = mainLoop_sum.update + mainLoop_sum.render + mainLoop_sum.postRender;
     double other_main_loop = AVG(screen_sum.gameTicks - mainLoop_total);
+    ActorPool::Statistics pool = ActorPool::Instance().GetStatistics();
 
-    INFO("%d %.2f %.2f %.2f %.2f %.2f %.2f %.2f %.2f %.2f %.2f %.2f",
+    INFO("%d %s %s %s %d %s %s %d %.2f %.2f %.2f %.2f %.2f %.2f %.2f %.2f %.2f %.2f %.2f %.2f %.2f %.2f %.2f %.2f %.2f %.2f %.2f %.2f %.2f %.2f %u %d %.2f",
         actorCount,
+        partitionMode == PartitionMode::Adaptive ? "adaptive" : "grid",
+        spawnPattern == Clustered ? "clustered" : "uniform",
+        screen.GetBandHeight() > 0 ? "banded" : "direct",
+        WorkerPool::Instance().GetActiveWorkers(),
+        screen.GetPresentStrategyName(screen.GetPresentStrategy()),
+        mainLoop.GetGovernor().IsEnabled() ? "on" : "off",
+        GetAllPartitions().Size(),
         double(sum.visibleActors) / frameCount,
         avg_update,
         avg_render,
         avg_postRender,
         other_main_loop,
         AVG(screen_sum.presentTicks),
+        double(screen_sum.presentBytes) / frameCount,
+        double(screen_sum.queueDepth) / frameCount,
+        AVG(screen_sum.latencyTicks),
         AVG(screen_sum.ticksPerFrame),
         avg_actorUpdate,
         avg_partitions,
+        avg_collision,
+        avg_deletes,
         avg_build,
+        avg_finish,
+        AVG(sum.deltaEncode),
+        double(sum.frameBytes) / frameCount,
+        double(sum.deltaBytes) / frameCount,
+        double(sum.collisionPairs) / frameCount,
+        double(pool.allocations - poolStart.allocations) / frameCount,
+        double(pool.heapAllocations - poolStart.heapAllocations) / frameCount,
+        screen.GetMissedFrames() - missedStart,
+        mainLoop.GetGovernor().GetLevel(),
         double(CLOCKHZ) / (double(screen_sum.ticksPerFrame) / frameCount)
     );
-}
\ No newline at end of file
+}
\ No newline at end of file
@@ -3,6 +3,7 @@
 #include <circle/sched/task.h>
 
 #include "game/gameserver.h"
+#include "game/actorpool.h"
 #include <climits>
 
 namespace hfh3
@@ -19,13 +20,42 @@ namespace hfh3
 
         virtual void Update() override;
         virtual void LoadLevel(int level=-1) override;
+    protected:
+        // The view is built by Update, which also measures building it.
+        virtual void PrepareFrame() override {}
     private:
 
+        // The measurements that can be selected with CONFIG_PERF_TEST.
+        enum Test
+        {
+            ActorSweep,          // Each actor count with the default settings
+            PartitionSweep,      // Each actor count with every spawn pattern and partitioning mode
+            WorkerSweep,         // Each actor count drawn directly and with 1 up to all workers
+            PresentSweep,        // Each actor count with every present strategy
+            GovernorComparison,  // The highest actor count without and with the quality governor
+            SpawnBenchmark,
+            BlitBenchmark,
+            FixedBlitBenchmark,
+            SimdBenchmark,
+            LayoutBenchmark,
+            BackgroundBenchmark,
+        };
+
+        // Returns the test with the given name, or ActorSweep if there is none.
+        static Test GetTest(const char* name);
+
         struct Timer {
             unsigned actorUpdate;
             unsigned assignPartitions;
+            unsigned collisionCheck;
+            unsigned pendingDeletes;
             unsigned buildCommandBuffer;
+            unsigned finishFrame;
+            unsigned deltaEncode;
             int visibleActors;
+            int frameBytes;
+            int deltaBytes;
+            int collisionPairs;
         };
 
         void UpdateStats();
@@ -34,6 +64,56 @@ namespace hfh3
 
         void LogStats();
 
+        // The distribution of enemies in a test.
+        enum SpawnPattern
+        {
+            Uniform,   // Enemies are spread evenly over the entire stage
+            Clustered, // Enemies are gathered in a few dense groups
+        };
+
+        // Returns a random position following the current spawn pattern.
+        Vector<s16> GetSpawnPosition();
+
+        // Returns the number of variants each actor count is tested with.
+        int GetVariantCount() const;
+
+        // Sets up the spawn pattern, partitioning, rendering mode, present strategy and
+        // governor of the current variant.
+        void ApplyVariant();
+
+        // Runs the selected microbenchmark. Returns false if the test is a sweep.
+        bool RunBenchmark();
+
+        // Spawns an enemy that will be replaced when destroyed.
+        void SpawnTestEnemy();
+
+        // Spawns a player missile at a random location.
+        void SpawnTestMissile();
+
+        // Measures the throughput of spawning and destroying enemies with destruction handlers
+        // and logs the result. Run once before the first test.
+        void RunSpawnBenchmark();
+
+        // Measures the time spent drawing the sprites of the image sheet with each
+        // blit mode, partially clipped at the screen edges, and logs the results.
+        void RunBlitBenchmark();
+
+        // Compares the generic and the fixed size blitters for each group of images
+        // in the sheet, drawn entirely on screen, and logs the results.
+        void RunFixedBlitBenchmark();
+
+        // Measures the throughput of each kernel of util/simd.h against its scalar
+        // version, on rows of a buffer that stays in the cache, and logs the results.
+        void RunSimdBenchmark();
+
+        // Compares drawing random sprites with cold caches from the packed and the
+        // shared image sheet layouts, and logs the results.
+        void RunLayoutBenchmark();
+
+        // Compares drawing a scrolling background from the cached layer and cell by cell,
+        // and logs the time, draw calls and cells rendered per frame.
+        void RunBackgroundBenchmark();
+
         unsigned GetTicks()
         {
             return CTimer::Get()->GetClockTicks();
@@ -41,7 +121,7 @@ namespace hfh3
 
         void InitTicks()
         {
-            current = {0,0,0,0};
+            current = {0,0,0,0,0,0,0,0,0,0,0};
             frameStart = GetTicks();
         }
 
@@ -50,6 +130,29 @@ namespace hfh3
         Timer current;
         Timer sum;
 
+        // Actor pool counters at the start of the current test
+        ActorPool::Statistics poolStart;
+
+        Test test;
         int actorCount;
+
+        // Each actor count is tested with every variant of the test, such as each
+        // combination of spawn pattern and partitioning. The index selects the current one.
+        int variant;
+        SpawnPattern spawnPattern;
+        Array<Vector<s16>> clusterCenters;
+
+        // The view of the player is also encoded as changes to the previous frame,
+        // to compare the size against the frames drawing every sprite.
+        CommandList deltaCommands;
+        SpriteDeltaEncoder deltaSprites;
+
+        // The present strategy, tick rate and governor state before the tests, restored when done
+        int startStrategy;
+        unsigned startTickRate;
+        bool startGovernor;
+
+        // The missed frame count at the start of the current test
+        unsigned missedStart;
     };
 }
@@ -32,21 +32,15 @@ Player::Player(class GameServer& inWorld, int index,
     SetPosition(position);
 }
 
-void Player::Draw(class CommandList& view) 
-{
-    // If the player is invincible, blink the sprite 4 times a second
-    if(!invincibleDelay || (invincibleDelay % 15) < 10)
-    {
-        Mover::Draw(view);
-    }
-}
-
 void Player::Update()
 {
     if(invincibleDelay > 0)
     {
         invincibleDelay--;
     }
+    // If the player is invincible, blink the sprite 4 times a second
+    SetHidden(invincibleDelay && (invincibleDelay % 15) >= 10);
+
     // Update player direction based on input
     SetDirection(input.GetPlayerDirection());
 
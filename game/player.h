@@ -6,11 +6,12 @@ namespace hfh3
     class Player : public Mover
     {
     public:
+        ACTOR_POOL_ALLOCATED(Player)
+
         Player(class GameServer& world, int index, 
                class ImageSheet& imageSheet, class Input& inInput,
                const Vector<s16>& position, const Direction& heading);
 
-        virtual void Draw(class CommandList& view) override;
         virtual void Update() override;
         virtual void OnCollision(class Actor* other) override;
 
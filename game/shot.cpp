@@ -21,6 +21,14 @@ Shot::Shot(class GameServer &inWorld, ImageSheet &imageSheet, ImageSet imageSet,
       owner(inOwner)
 {
     SetPosition(inPosition);
+    if(rotator)
+    {
+        SetShape({0,0,6,6});
+    }
+    else
+    {
+        SetShape({4,4,8,8});
+    }
 }
 
 void Shot::Update()
@@ -34,6 +42,9 @@ void Shot::Update()
         {
             SetImageIndex((GetImageIndex()+1) % GetImageCount());
         }
+
+        // Flash the shot the last 15 frames of its lifetime
+        SetHidden(!(ttl > 15 || ttl % 2));
     }
     else
     {
@@ -41,28 +52,7 @@ void Shot::Update()
     }
 }
 
-void Shot::Draw(class CommandList& commands)
-{
-    // Flash the shot the last 15 frames of its lifetime
-    if ( ttl > 15 || ttl % 2)
-    {
-        Mover::Draw(commands);
-    }
-}
-
 void Shot::OnCollision(class Actor* other)
 {
     Destroy();
-}
-
-Rect<s16> Shot::GetBounds()
-{
-    if(rotator)
-    {
-        return {GetPosition(), {6,6}};
-    }
-    else
-    {
-        return {GetPosition()+Vector<s16>(4,4), {8,8}};
-    }
 }
\ No newline at end of file
@@ -11,14 +11,14 @@ namespace hfh3
     class Shot : public Mover
     {
     public:
+        ACTOR_POOL_ALLOCATED(Shot)
+
         Shot(class GameServer& inWorld, class ImageSheet& imageSheet, ImageSet imageSet,
              const Vector<s16>& inPosition, Direction direction, int speed = 1,
              int inOwner = -1);
 
         virtual void Update() override;
-        virtual void Draw(class CommandList& commands) override;
         virtual void OnCollision(class Actor* other) override;
-        virtual Rect<s16> GetBounds() override;
         
         virtual int GetOwner() const override
         {
@@ -14,28 +14,23 @@ namespace hfh3
              u8 inImageGroup, u8 inImageCount, 
              CollisionMask inCollisionTargetMask, 
              CollisionMask inCollisionSourceMask = CollisionMask::None,
-             const Vector<s16> inSize = {16,16});
-
-      /** After updating all actors, each will get a chance to render itself to screen
-          */
-      virtual void Draw(class CommandList& view) override;
-      virtual Rect<s16> GetBounds() override;
+             const Vector<s8> inSize = {16,16});
 
     protected:
 
         void SetImageIndex(unsigned newCurrent)
         {
-            current = newCurrent;
+            SetImage((GetImage() & 0xF0) | (newCurrent & 0xF));
         }
 
         void SetImageGroup(unsigned newGroup)
         {
-            imageGroup = newGroup;
+            SetImage((newGroup << 4) | (GetImage() & 0xF));
         }
 
         unsigned GetImageIndex() const
         {
-            return current;
+            return GetImage() & 0xF;
         }
 
         unsigned GetImageCount() const
@@ -44,10 +39,6 @@ namespace hfh3
         }
 
     private: 
-        u8 imageGroup;
         u8 imageCount;
-        u8 current;
-
-        Vector<s16> size;
     };
 }
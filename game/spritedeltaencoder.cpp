@@ -0,0 +1,106 @@
+#include "game/spritedeltaencoder.h"
+#include "game/commandlist.h"
+
+#include <assert.h>
+
+using namespace hfh3;
+
+SpriteDeltaEncoder::SpriteDeltaEncoder()
+    : frame(1)
+    , keyframe(true)
+    , commandList(nullptr)
+{
+}
+
+void SpriteDeltaEncoder::Reset()
+{
+    // Skipping a frame number makes all entries look like they were not visible
+    // in the previous frame.
+    frame++;
+    previous.ClearFast();
+    keyframe = true;
+}
+
+void SpriteDeltaEncoder::BeginFrame(CommandList& inCommandList)
+{
+    assert(commandList == nullptr);
+    commandList = &inCommandList;
+    frame++;
+    current.ClearFast();
+
+    if(keyframe)
+    {
+        commandList->ClearSprites();
+        keyframe = false;
+    }
+}
+
+void SpriteDeltaEncoder::AddSprite(u16 id, const Vector<s16>& position, u8 packedImage)
+{
+    assert(commandList != nullptr);
+    if(id >= entries.Size())
+    {
+        int oldSize = entries.Size();
+        Entry* added = entries.Grow(id + 1 - oldSize);
+        for(int i = oldSize; i <= id; i++, added++)
+        {
+            added->frame = 0;
+        }
+    }
+
+    Entry& entry = entries[id];
+    if(entry.frame == frame)
+    {
+        // Never create or move the same sprite twice in a frame
+        return;
+    }
+
+    if(entry.frame != frame - 1)
+    {
+        commandList->CreateSprite(id, position, packedImage);
+    }
+    else
+    {
+        // Ids may be reused by a new actor in the same frame the old one was destroyed,
+        // which simply shows up as a change to the existing sprite.
+        Vector<s16> delta = position - entry.position;
+        if(delta.x != 0 || delta.y != 0)
+        {
+            if(delta.x >= -8 && delta.x < 8 && delta.y >= -8 && delta.y < 8)
+            {
+                commandList->MoveSprite(id, delta);
+            }
+            else
+            {
+                commandList->SetSpritePosition(id, position);
+            }
+        }
+        if(entry.image != packedImage)
+        {
+            commandList->SetSpriteImage(id, packedImage);
+        }
+    }
+
+    entry.position = position;
+    entry.image = packedImage;
+    entry.frame = frame;
+    current.Append(id);
+}
+
+void SpriteDeltaEncoder::EndFrame()
+{
+    assert(commandList != nullptr);
+    for(u16 id : previous)
+    {
+        if(entries[id].frame != frame)
+        {
+            commandList->DestroySprite(id);
+        }
+    }
+    commandList->DrawSprites();
+
+    // The ids visible in this frame are the baseline for the next one
+    previous.ClearFast();
+    previous.AppendRaw(current, current.Size());
+    commandList = nullptr;
+}
@@ -0,0 +1,55 @@
+#pragma once
+#include <circle/types.h>
+
+#include "util/array.h"
+#include "util/vector.h"
+
+namespace hfh3
+{
+    class CommandList;
+
+    /** Encodes the sprites visible to a client as changes to the previous frame sent to it.
+      * Sprites are identified by the stable id of their actor. A sprite that becomes visible
+      * is created on the client, after which only its changed position or image is sent,
+      * and it is destroyed when it leaves the view. Sprites that did not change cost nothing.
+      * The connection to the client delivers every frame in order, so the previous frame
+      * sent is always the one the client holds when applying the next.
+      */
+    class SpriteDeltaEncoder
+    {
+    public:
+        SpriteDeltaEncoder();
+
+        /** Makes the next frame a keyframe, clearing the sprite table on the client
+          * and creating all visible sprites again.
+          */
+        void Reset();
+
+        /** Starts encoding a frame into the command list.
+          */
+        void BeginFrame(CommandList& commandList);
+
+        /** Adds a visible sprite to the frame.
+          */
+        void AddSprite(u16 id, const Vector<s16>& position, u8 packedImage);
+
+        /** Destroys the sprites that are no longer visible and draws the sprite table.
+          */
+        void EndFrame();
+
+    private:
+        struct Entry
+        {
+            Vector<s16> position;
+            u8 image;
+            unsigned frame; // The last frame the sprite was visible in
+        };
+
+        Array<Entry> entries; // Indexed by id
+        Array<u16> previous;  // The ids visible in the previous frame
+        Array<u16> current;   // The ids visible in the frame being encoded
+        unsigned frame;
+        bool keyframe;
+        CommandList* commandList;
+    };
+}
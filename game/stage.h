@@ -25,6 +25,15 @@ namespace hfh3
         {
             return Vector<s16>(vector.x & maskX, vector.y & maskY);
         }
+
+        /** Returns the shortest vector between two points on the stage, given their
+          * difference. Wrapping around the edges makes it at most half the stage size.
+          */
+        Vector<s16> WrapDelta(const Vector<s16>& delta) const
+        {
+            return Vector<s16>(((delta.x + (maskX+1)/2) & maskX) - (maskX+1)/2,
+                               ((delta.y + (maskY+1)/2) & maskY) - (maskY+1)/2);
+        }
         
         s16 GetWidth() { return size.x; }
         s16 GetHeight() { return size.y; }
@@ -4,7 +4,7 @@
 #include "game/world.h"
 #include "util/vector.h"
 #include "util/random.h"
-#include "util/memops.h"
+#include "util/simd.h"
 
 using namespace hfh3;
 
@@ -21,11 +21,12 @@ Starfield::Starfield(class World& inWorld, int inDensity, u64 inSeed)
     , near(nearPixels, nearSize.x, nearSize.y, 255)
     , far(farPixels, farSize.x, farSize.y, -1)
 {
-    memset(nearPixels, 255, nearSize.x * nearSize.y);
-    memset(farPixels, 0, nearSize.x * nearSize.y);
+    Simd::Fill(nearPixels, 255, nearSize.x * nearSize.y);
+    Simd::Fill(farPixels, 0, farSize.x * farSize.y);
     InitImages(inDensity, inSeed);
 }
 #else
+    , maxDensity(inDensity)
     , density(inDensity)
     , seed(inSeed)
 {
@@ -33,6 +34,13 @@ Starfield::Starfield(class World& inWorld, int inDensity, u64 inSeed)
 }
 #endif
 
+void Starfield::SetDensity(int percent)
+{
+#if !CONFIG_PRERENDER_STARFIELD
+    density = maxDensity * percent / 100;
+#endif
+}
+
 #if CONFIG_PRERENDER_STARFIELD
 void Starfield::InitImages(int density, u64 seed)
 #else
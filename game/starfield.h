@@ -21,6 +21,12 @@ namespace hfh3
         Starfield(class World& inWorld, int inDensity=1250, u64 inSeed=999);
 
         void Draw(class View& view);
+
+        /** Draws only the given percentage of the stars. The same stars stay in place.
+          * Has no effect when the star field is prerendered, as drawing it then costs
+          * the same regardless of the number of stars.
+          */
+        void SetDensity(int percent);
     private:
 
 
@@ -37,6 +43,7 @@ namespace hfh3
         Image near;
         Image far;
 #else
+        int maxDensity;
         int density;
         u64 seed;
 #endif
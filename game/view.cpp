@@ -5,6 +5,46 @@
 
 using namespace hfh3;
 
+/** Calls draw with each screen position where an area of the passed in size, placed at
+  * a stage position relative to the view, overlaps the clip rectangle.
+  * The position must already be wrapped to the stage. As the screen is no larger than
+  * the stage, the area can only show up there and one stage width or height before it.
+  */
+template<typename Draw>
+static inline void ForEachCopy(const Vector<s16>& at, const Vector<s16>& size, const Rect<s16>& clip,
+                               const Vector<s16>& stageSize, Draw draw)
+{
+    s16 columns[2];
+    int columnCount = 0;
+    if(at.x < clip.Right() && at.x + size.x > clip.Left())
+    {
+        columns[columnCount++] = at.x;
+    }
+    if(at.x - stageSize.x + size.x > clip.Left())
+    {
+        columns[columnCount++] = at.x - stageSize.x;
+    }
+
+    s16 rows[2];
+    int rowCount = 0;
+    if(at.y < clip.Bottom() && at.y + size.y > clip.Top())
+    {
+        rows[rowCount++] = at.y;
+    }
+    if(at.y - stageSize.y + size.y > clip.Top())
+    {
+        rows[rowCount++] = at.y - stageSize.y;
+    }
+
+    for(int row = 0; row < rowCount; row++)
+    {
+        for(int column = 0; column < columnCount; column++)
+        {
+            draw(Vector<s16>(columns[column], rows[row]));
+        }
+    }
+}
+
 View::View(Stage& inStage,  ScreenManager& inScreen) 
     : stage(inStage)
     , screen(inScreen)
@@ -19,16 +59,21 @@ View::View(Stage& inStage,  ScreenManager& inScreen)
 
 void View::DrawImage(const Vector<s16>& at, const class Image& image)
 {
-    Vector<s16> shifted = at - screenOffset;
-    Vector<s16> wrapped = stage.WrapCoordinate(shifted);
-    shifted %= stage.GetSize();
-
-    // Depending on the size and position of the image relative to the view area,
-    // it can show up in 4 places on the screen
-    screen.DrawImage(shifted, image);
-    screen.DrawImage(wrapped, image);
-    screen.DrawImage(Vector<s16>(wrapped.x,shifted.y), image);
-    screen.DrawImage(Vector<s16>(shifted.x,wrapped.y), image);
+    ForEachCopy(stage.WrapCoordinate(at - screenOffset), image.GetSize(), screen.GetClip(), stage.GetSize(),
+        [&](const Vector<s16>& position) { screen.DrawImage(position, image); });
+}
+
+void View::DrawImages(const Blit* blits, int count)
+{
+    const Rect<s16> clip = screen.GetClip();
+    const Vector<s16> stageSize = stage.GetSize();
+    const Vector<s16> offset = screenOffset;
+    for(const Blit* end = blits + count; blits < end; blits++)
+    {
+        const Image& image = *blits->image;
+        ForEachCopy(stage.WrapCoordinate(blits->position - offset), image.GetSize(), clip, stageSize,
+            [&](const Vector<s16>& position) { screen.DrawImage(position, image); });
+    }
 }
 
 void View::DrawPixel(const Vector<s16>& at, u8 color)
@@ -38,15 +83,7 @@ void View::DrawPixel(const Vector<s16>& at, u8 color)
 
 void View::DrawRect(const Rect<s16>& rect, u8 color)
 {
-    Vector<s16> shifted = rect.origin - screenOffset;
-    Vector<s16> wrapped = stage.WrapCoordinate(shifted);
-    shifted %= stage.GetSize();
-
-    // Depending on the size and position of the rectangle relative to the view area,
-    // it can show up in 4 places on the screen
-    screen.DrawRect(Rect<s16>(shifted, rect.size), color);
-    screen.DrawRect(Rect<s16>(wrapped, rect.size), color);
-    screen.DrawRect(Rect<s16>(Vector<s16>(wrapped.x,shifted.y), rect.size), color);
-    screen.DrawRect(Rect<s16>(Vector<s16>(shifted.x,wrapped.y), rect.size), color);
+    ForEachCopy(stage.WrapCoordinate(rect.origin - screenOffset), rect.size, screen.GetClip(), stage.GetSize(),
+        [&](const Vector<s16>& position) { screen.DrawRect(Rect<s16>(position, rect.size), color); });
 }
 
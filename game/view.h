@@ -53,11 +53,26 @@ namespace hfh3
         }
 
         /** The following methods map a stage coordinate to a screen coordinate
-          * before passing the argumetns to the screen manager
+          * before passing the argumetns to the screen manager.
+          * As the stage wraps around, an image or rectangle can show up in up to four
+          * places on the screen. Only the ones overlapping the clip rectangle are drawn.
           */
         void DrawImage(const Vector<s16>& at, const class Image& image);
         void DrawPixel(const Vector<s16>& at, u8 color);
         void DrawRect(const Rect<s16>& rect, u8 color);
+
+        /** An image to draw at a stage coordinate, used by DrawImages.
+          */
+        struct Blit
+        {
+            Vector<s16> position;
+            const class Image* image;
+        };
+
+        /** Draws a batch of images, in order. Same as calling DrawImage for each of
+          * them, but the view and clip state is only looked up once.
+          */
+        void DrawImages(const Blit* blits, int count);
     private:
         class Stage& stage;
         class ScreenManager& screen;
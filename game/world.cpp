@@ -47,12 +47,23 @@ World::~World()
 
 // Actually execute the scheduled draw commands
 void World::Render()
+{
+    RenderCommands(commands);
+}
+
+void World::RenderCommands(CommandList& list)
 {
     View view = View(stage, screen);
+    background.SetStarDensity(mainLoop.GetQuality().starDensity);
+
+    // If a band height has been set, the frame is drawn one band at a time after
+    // all the commands have been run.
+    screen.BeginBands();
     #if !CONFIG_PRERENDER_STARFIELD
         screen.DrawRect(World::GetBounds(),0);
     #endif
-    commands.Run(view, background, overlay, minimap);
+    list.Run(view, background, overlay, minimap);
+    screen.EndBands();
 }
 
 Rect<s16> World::GetBounds() const
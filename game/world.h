@@ -31,6 +31,9 @@ namespace hfh3
         virtual void Render() override;
         virtual Rect<s16> GetBounds() const override;
 
+        // Draws the frame in the command list passed in
+        void RenderCommands(CommandList& list);
+
         Stage stage;
         class Input& input;
         class Network& network;
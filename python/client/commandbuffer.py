@@ -1,5 +1,6 @@
 import enum
 import struct
+import threading
 from  render.starfield import Starfield
 from  render.background import Background
 from pygame import Rect
@@ -13,11 +14,25 @@ class Opcode(enum.Enum) :
     ClearBackgroundCell = 5
     SetPlayerStat       = 6
     SetMessage          = 7
+    ClearSprites        = 8
+    CreateSprite        = 9
+    MoveSprite          = 10
+    SetSpritePosition   = 11
+    SetSpriteImage      = 12
+    DestroySprite       = 13
+    DrawSprites         = 14
     FrameStart          = 255
 
+FRAME_HEADER = '<Bi'
+FRAME_HEADER_SIZE = struct.calcsize(FRAME_HEADER)
+
 def decode_vectorS12(a,b,c):
     return (a | ((b & 0xf0) <<4), (c << 4) | (b &0xf))
 
+def decode_vectorS4(packed):
+    # Each component is a signed nibble
+    return ((packed >> 4) - ((packed & 0x80) >> 3), (packed & 0xf) - ((packed & 0x8) << 1))
+
 class CommandBuffer:
 
     def __init__(self, screen, sprites):
@@ -28,7 +43,20 @@ class CommandBuffer:
         self.starfield = Starfield(screen, sprites.get_palette(), *self.size)
         self.background = Background(screen, sprites, *self.size)
 
+        # Frames are split out of the received data by the reader thread and
+        # handed to run through a list protected by a lock.
+        self.pending = b''
+        self.frames = []
+        self.lock = threading.Lock()
+
+        # The newest frame run, which is redrawn until a new one arrives.
         self.buffer = b''
+        self.draw = True
+        self.redraw = False
+
+        # The sprite table maintained by the sprite commands, mapping ids to [x, y, image]
+        self.sprite_table = {}
+
         self.commands = {
             Opcode.SetViewOffset       : (self.set_view_offset,  '<3B'),
             Opcode.DrawBackground      : (self.draw_background,  ''),
@@ -38,6 +66,13 @@ class CommandBuffer:
             Opcode.ClearBackgroundCell : (self.clear_background, '<2B'),
             Opcode.SetPlayerStat       : (self.set_player_stat,  '<Bi'),
             Opcode.SetMessage          : (self.set_message,      '<Bhh'),
+            Opcode.ClearSprites        : (self.clear_sprites,    ''),
+            Opcode.CreateSprite        : (self.create_sprite,    '<H3BB'),
+            Opcode.MoveSprite          : (self.move_sprite,      '<HB'),
+            Opcode.SetSpritePosition   : (self.set_sprite_position, '<H3B'),
+            Opcode.SetSpriteImage      : (self.set_sprite_image, '<HB'),
+            Opcode.DestroySprite       : (self.destroy_sprite,   '<H'),
+            Opcode.DrawSprites         : (self.draw_sprites,     ''),
             Opcode.FrameStart          : (self.frame_start,      '<i')
         }
 
@@ -48,12 +83,19 @@ class CommandBuffer:
         self.offset = decode_vectorS12(x,mid,y)
 
     def draw_background(self) :
+        if not self.draw:
+            return
         self.starfield.draw(self.offset)
         self.background.draw(self.offset)
 
     def draw_sprite(self, a, b, c, image) :
+        if not self.draw:
+            return
+        self.blit_sprite(decode_vectorS12(a, b, c), image)
+
+    def blit_sprite(self, position, image) :
         sprite = self.sprites[image >> 4][image & 0xF]
-        x, y = decode_vectorS12(a, b, c)
+        x, y = position
         width, height = self.size
         screen_x = (x - self.offset[0]) % width
         screen_y = (y - self.offset[1]) % height
@@ -80,31 +122,100 @@ class CommandBuffer:
     def set_message(self, message, level, timeout) :
         pass
 
+    # The sprite commands change the table relative to the previous frame,
+    # so they are skipped when redrawing a frame that has already been run.
+    def clear_sprites(self) :
+        if not self.redraw:
+            self.sprite_table.clear()
+
+    def create_sprite(self, id, a, b, c, image) :
+        if not self.redraw:
+            x, y = decode_vectorS12(a, b, c)
+            self.sprite_table[id] = [x, y, image]
+
+    def move_sprite(self, id, delta) :
+        if not self.redraw and id in self.sprite_table:
+            dx, dy = decode_vectorS4(delta)
+            sprite = self.sprite_table[id]
+            sprite[0] += dx
+            sprite[1] += dy
+
+    def set_sprite_position(self, id, a, b, c) :
+        if not self.redraw and id in self.sprite_table:
+            self.sprite_table[id][0:2] = decode_vectorS12(a, b, c)
+
+    def set_sprite_image(self, id, image) :
+        if not self.redraw and id in self.sprite_table:
+            self.sprite_table[id][2] = image
+
+    def destroy_sprite(self, id) :
+        if not self.redraw:
+            self.sprite_table.pop(id, None)
+
+    def draw_sprites(self) :
+        if not self.draw:
+            return
+        for x, y, image in self.sprite_table.values():
+            self.blit_sprite((x, y), image)
+
     def invalid_opcode(self, op) :
         print("Error: invalid opcode", op)
-    
-    def run(self):
+
+    def execute(self, buffer, draw, redraw=False):
+        self.draw = draw
+        self.redraw = redraw
         offset = 0
-        self.screen.set_clip(Rect(0,10,512,470))
-        self.screen.fill(0)
-        while offset < len(self.buffer):
+        while offset < len(buffer):
             try:
                 args = ()
-                op = Opcode(self.buffer[offset])
+                op = Opcode(buffer[offset])
                 offset += 1
-                args = struct.unpack_from(self.commands[op][1], self.buffer, offset)
+                args = struct.unpack_from(self.commands[op][1], buffer, offset)
                 offset += struct.calcsize(self.commands[op][1])
                 self.commands[op][0](*args)
             except ValueError :
-                self.invalid_opcode(self.buffer[offset])
+                self.invalid_opcode(buffer[offset])
                 offset += 1
             except struct.error:
                 pass
+
+    def run(self):
+        with self.lock:
+            frames, self.frames = self.frames, []
+
+        # Only the newest frame needs to be drawn, but the skipped ones may
+        # still contain changes to the sprite table and the background.
+        for frame in frames[:-1]:
+            self.execute(frame, False)
+
+        redraw = not frames
+        if frames:
+            self.buffer = frames[-1]
+
+        self.screen.set_clip(Rect(0,10,512,470))
+        self.screen.fill(0)
+        self.execute(self.buffer, True, redraw)
         self.screen.set_clip(None)
     
     def clear(self):
         self.buffer = b''
 
     def read(self, socket):
-        new_buffer = socket.recv(40960)
-        self.buffer = new_buffer
+        self.pending += socket.recv(40960)
+
+        # Split the received data into complete frames
+        frames = []
+        while len(self.pending) >= FRAME_HEADER_SIZE:
+            op, frame_size = struct.unpack_from(FRAME_HEADER, self.pending)
+            if op != Opcode.FrameStart.value or frame_size < FRAME_HEADER_SIZE:
+                print("Error: invalid frame header", op, frame_size)
+                self.pending = b''
+                break
+            if frame_size > len(self.pending):
+                break
+            frames.append(self.pending[:frame_size])
+            self.pending = self.pending[frame_size:]
+
+        if frames:
+            with self.lock:
+                self.frames.extend(frames)
@@ -0,0 +1,120 @@
+#pragma once
+#include <circle/types.h>
+
+#include "render/image.h"
+#include "util/simd.h"
+
+namespace hfh3
+{
+    /** Selects how a FixedBlitter treats the transparent color of the image.
+      */
+    enum class BlitTransparency
+    {
+        Opaque, // Every pixel is copied
+        Masked, // Pixels of the transparent color are skipped
+    };
+
+    /** Draws images of a size known at compile time that are entirely inside the clip
+      * rectangle. As the loops have constant trip counts and there is no clipping to
+      * handle, they are fully unrolled and the remainder of a row that does not fill
+      * a whole vector is known at compile time.
+      *
+      * Whole rows of 16 pixels are drawn with the vectors of util/simd.h, also when
+      * AVX2 is available, as the sprites are too narrow for wider ones.
+      * If Aligned is set, the source rows must start on a 16 byte boundary, which is
+      * the case for images of packed image sheets that are 16 pixels wide.
+      */
+    template<int Width, int Height, BlitTransparency Mode, bool Aligned>
+    class FixedBlitter
+    {
+    public:
+        static void Draw(u8* dst, int dstStride, const u8* src, int srcStride, u8 transparent)
+        {
+#pragma GCC unroll 16
+            for(int y = 0; y < Height; y++, dst += dstStride, src += srcStride)
+            {
+                DrawRow(dst, src, transparent);
+            }
+        }
+
+    private:
+        static inline __attribute__((always_inline)) void DrawRow(u8* dst, const u8* src, u8 transparent)
+        {
+#if SIMD_VECTOR
+            using Lanes = Simd::Lanes16;
+            static const int vectorWidth = Width - Width % Lanes::width;
+#pragma GCC unroll 16
+            for(int x = 0; x < vectorWidth; x += Lanes::width)
+            {
+                Lanes::Type srcChunk = Aligned ? Lanes::LoadAligned(&src[x]) : Lanes::Load(&src[x]);
+                if(Mode == BlitTransparency::Masked)
+                {
+                    // Keep the destination where the source is transparent
+                    Lanes::Type mask = Lanes::Equal(srcChunk, Lanes::Splat(transparent));
+                    srcChunk = Lanes::Select(mask, Lanes::Load(&dst[x]), srcChunk);
+                }
+                Lanes::Store(&dst[x], srcChunk);
+            }
+#else
+            static const int vectorWidth = 0;
+#endif
+#pragma GCC unroll 16
+            for(int x = vectorWidth; x < Width; x++)
+            {
+                if(Mode == BlitTransparency::Opaque || src[x] != transparent)
+                {
+                    dst[x] = src[x];
+                }
+            }
+        }
+    };
+
+    /** Selects the FixedBlitter for an image of the given size based on its transparency
+      * and alignment.
+      */
+    template<int Width, int Height>
+    inline void DrawFixedSize(u8* dst, int dstStride, const Image& image)
+    {
+        const u8* src = image.GetPixelAddress(0, 0);
+        const int srcStride = image.GetStride();
+        const bool aligned = ((reinterpret_cast<uintptr>(src) | srcStride) & 15) == 0;
+        const int transparent = image.GetTransparent();
+        if(transparent < 0)
+        {
+            if(aligned)
+            {
+                FixedBlitter<Width, Height, BlitTransparency::Opaque, true>::Draw(dst, dstStride, src, srcStride, 0);
+            }
+            else
+            {
+                FixedBlitter<Width, Height, BlitTransparency::Opaque, false>::Draw(dst, dstStride, src, srcStride, 0);
+            }
+        }
+        else
+        {
+            if(aligned)
+            {
+                FixedBlitter<Width, Height, BlitTransparency::Masked, true>::Draw(dst, dstStride, src, srcStride, u8(transparent));
+            }
+            else
+            {
+                FixedBlitter<Width, Height, BlitTransparency::Masked, false>::Draw(dst, dstStride, src, srcStride, u8(transparent));
+            }
+        }
+    }
+
+    /** Draws an image that is entirely inside the clip rectangle with a FixedBlitter,
+      * if there is one for its size. Returns false if the image has to be drawn with
+      * the generic blitter instead.
+      */
+    inline bool DrawFixed(u8* dst, int dstStride, const Image& image)
+    {
+        const Vector<s16>& size = image.GetSize();
+        if(size.x == 16 && size.y == 16)
+        {
+            DrawFixedSize<16, 16>(dst, dstStride, image);
+            return true;
+        }
+        return false;
+    }
+}
@@ -6,10 +6,34 @@ Font* Font::defaultFont = nullptr;
 
 Font::Font(const u8* inData, int inStride, int inHeight, char inOffset)
     : fontData(inData)
+    , rowMasks(nullptr)
     , stride(inStride)
     , cellSize(8, inHeight)
     , offset(inOffset)
 {
+    // Expand the bits of each row of each character to bytes up front, so text
+    // can be drawn a row at a time without testing each pixel.
+    // Invalid characters are drawn as a filled box, which is stored after the valid ones.
+    const int glyphs = stride + 1;
+    rowMasks = new u64[glyphs * cellSize.y];
+    for (int glyph = 0; glyph < glyphs; glyph++)
+    {
+        for (int y = 0; y < cellSize.y; y++)
+        {
+            u8 bits = glyph < stride ? fontData[(stride * y) + glyph] : 0xFF;
+            u8 mask[8];
+            for (int x = 0; x < 8; x++)
+            {
+                mask[x] = (bits & (0x80 >> x)) ? 0xFF : 0;
+            }
+            memcpy(&rowMasks[glyph * cellSize.y + y], mask, sizeof(mask));
+        }
+    }
+}
+
+Font::~Font()
+{
+    delete[] rowMasks;
 }
 
 Font& Font::GetDefault()
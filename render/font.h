@@ -14,6 +14,7 @@ namespace hfh3
     {
     public:
         Font(const u8* inData, int inStride, int inHeight, char inOffset = 0);
+        ~Font();
 
         static Font& GetDefault();
 
@@ -34,6 +35,26 @@ namespace hfh3
             return fontData[(stride * y) + (c - offset)] & mask;
         }
 
+        /** Returns the pixels of a row of a character as bits, with the leftmost
+          * pixel in the most significant bit. */
+        u8 GetRowBits(char c, int y) const
+        {
+            if (c < offset || c-offset > stride)
+                return 0xFF;
+
+            return fontData[(stride * y) + (c - offset)];
+        }
+
+        /** Returns the pixels of a row of a character pre-expanded to a mask of 8 bytes,
+          * which are 0xFF where the pixel is set and 0 elsewhere. The first byte in
+          * memory is the leftmost pixel, so the mask can be stored directly to a row
+          * of pixels. */
+        u64 GetRowMask(char c, int y) const
+        {
+            int glyph = (c < offset || c-offset >= stride) ? stride : c - offset;
+            return rowMasks[glyph * cellSize.y + y];
+        }
+
         int GetHeight() const
         {
             return cellSize.y;
@@ -46,6 +67,7 @@ namespace hfh3
 
     private:
         const u8 *fontData;
+        u64 *rowMasks; // The rows of all characters expanded by GetRowMask, followed by the invalid character
         int stride;
         Vector<s16> cellSize;
         char offset;
@@ -1,5 +1,7 @@
 #include "render/image.h"
 
+#include <assert.h>
+
 using namespace hfh3;
 
 Image::Image(u8* inData, int inWidth, int inHeight, int inTransparent, int inRowStride)
@@ -7,6 +9,8 @@ Image::Image(u8* inData, int inWidth, int inHeight, int inTransparent, int inRow
     , size(inWidth, inHeight)
     , stride(inRowStride)
     , transparent(inTransparent)
+    , spans(nullptr)
+    , rowSpans(nullptr)
 {
     // Assume that if the stride is unspecified, it's equal to the width of
     // the image.
@@ -20,6 +24,56 @@ Image::Image(u8* inData, int inWidth, int inHeight, int inTransparent, int inRow
     }
 }
 
+int Image::CountSpans() const
+{
+    int count = 0;
+    for(int y=0; y<size.y; y++)
+    {
+        const u8* row = GetPixelAddress(0,y);
+        for(int x=0; x<size.x; x++)
+        {
+            // Count the first pixel of each opaque run
+            if(row[x] != transparent && (x == 0 || row[x-1] == transparent))
+            {
+                count++;
+            }
+        }
+    }
+    return count;
+}
+
+void Image::BuildSpans(Span* spanBuffer, u16* rowBuffer)
+{
+    assert(size.x < 256);
+    int count = 0;
+    for(int y=0; y<size.y; y++)
+    {
+        rowBuffer[y] = count;
+        const u8* row = GetPixelAddress(0,y);
+        int x = 0;
+        while(x < size.x)
+        {
+            // Skip the transparent pixels and then find the end of the opaque run
+            while(x < size.x && row[x] == transparent)
+            {
+                x++;
+            }
+            int start = x;
+            while(x < size.x && row[x] != transparent)
+            {
+                x++;
+            }
+            if(x > start)
+            {
+                spanBuffer[count++] = Span {u8(start), u8(x - start)};
+            }
+        }
+    }
+    rowBuffer[size.y] = count;
+    spans = spanBuffer;
+    rowSpans = rowBuffer;
+}
+
 void Image::VerifyTransparency()
 {
     // Verify that the image does contain at least one transparent pixel,
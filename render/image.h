@@ -15,6 +15,14 @@ namespace hfh3
     class Image
     {
     public:
+        /** A run of opaque pixels within a row of the image.
+          */
+        struct Span
+        {
+            u8 start;
+            u8 length;
+        };
+
         Image(u8* inData, int inWidth, int inHeight, int inTransparent=-1, int inRowStride=0);
 
         const Vector<s16>& GetSize() const
@@ -32,6 +40,37 @@ namespace hfh3
             return transparent;
         }
 
+        /** Returns the distance in bytes between the start of two rows.
+          */
+        int GetStride() const
+        {
+            return stride;
+        }
+
+        /** Returns the number of opaque spans in the image.
+          */
+        int CountSpans() const;
+
+        /** Builds the list of opaque spans of each row, so images with transparent pixels
+          * can be drawn by copying only the opaque ones.
+          * The span buffer must have room for CountSpans() entries and the row buffer
+          * for the image height plus one. The memory is owned by the caller.
+          */
+        void BuildSpans(Span* spanBuffer, u16* rowBuffer);
+
+        bool HasSpans() const
+        {
+            return spans != nullptr;
+        }
+
+        /** Returns the spans of a row, ordered from left to right.
+          */
+        const Span* GetRowSpans(int y, int& count) const
+        {
+            count = rowSpans[y+1] - rowSpans[y];
+            return &spans[rowSpans[y]];
+        }
+
     private:
         void VerifyTransparency();
         u8	*imageData;
@@ -39,5 +78,10 @@ namespace hfh3
         int stride;
         int transparent;
 
+        // Opaque spans of all rows, and the index of the first span of each row,
+        // with an extra entry marking the end of the last row. Null if not built.
+        const Span* spans;
+        const u16* rowSpans;
+
     };
 }
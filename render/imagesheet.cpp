@@ -1,10 +1,15 @@
 #include "render/imagesheet.h"
 #include "util/new.h" // for placement new
+#include "config.h"
+
+#include <circle/util.h>
 
 using namespace hfh3;
 
-ImageSheet::ImageSheet(u8* inData, unsigned bufferWidth, unsigned bufferHeight, int imageWidth, int imageHeight, int transparent, unsigned inGroupSize) :
+ImageSheet::ImageSheet(u8* inData, unsigned bufferWidth, unsigned bufferHeight, int imageWidth, int imageHeight, int transparent, unsigned inGroupSize, bool packed) :
     groupSize(inGroupSize)
+    , storage(nullptr)
+    , spanCount(0)
 {
     const unsigned columns = bufferWidth / imageWidth;
     const unsigned rows = bufferHeight / imageHeight;
@@ -27,6 +32,80 @@ ImageSheet::ImageSheet(u8* inData, unsigned bufferWidth, unsigned bufferHeight,
             new(&images[i]) Image(&inData[rowOffset*row + colOffset*col], imageWidth, imageHeight, transparent, bufferWidth);
         }
     }
+
+    Layout(packed);
+}
+
+// Rounds a size or an address up to a multiple of the alignment, which must be a power of two
+static inline uintptr Align(uintptr value, uintptr alignment)
+{
+    return (value + alignment - 1) & ~(alignment - 1);
+}
+
+unsigned ImageSheet::GetBlockSize(const Image& image, bool packed)
+{
+    const Vector<s16>& size = image.GetSize();
+    unsigned blockSize = 0;
+    if(packed)
+    {
+        // Keep the span metadata following the pixels aligned for the u16 row indices
+        blockSize += Align(size.x * size.y, sizeof(u16));
+    }
+#if CONFIG_SPAN_SPRITES
+    // Images without transparent pixels are drawn by copying whole rows and don't need spans
+    if(image.GetTransparent() >= 0)
+    {
+        blockSize += (size.y + 1) * sizeof(u16) + image.CountSpans() * sizeof(Image::Span);
+    }
+#endif
+    return packed ? Align(blockSize, blockAlignment) : blockSize;
+}
+
+void ImageSheet::Layout(bool packed)
+{
+    unsigned totalSize = 0;
+    for(unsigned i=0; i<imageCount; i++)
+    {
+        totalSize += GetBlockSize(images[i], packed);
+    }
+    if(totalSize == 0)
+    {
+        return;
+    }
+
+    storage = new u8[totalSize + blockAlignment - 1];
+    u8* block = reinterpret_cast<u8*>(Align(reinterpret_cast<uintptr>(storage), blockAlignment));
+    for(unsigned i=0; i<imageCount; i++)
+    {
+        Image& image = images[i];
+        const unsigned blockSize = GetBlockSize(image, packed);
+        const Vector<s16> size = image.GetSize();
+        u8* next = block;
+
+        if(packed)
+        {
+            // Copy the rows of the image next to each other and point the image at the copy
+            for(int y=0; y<size.y; y++)
+            {
+                memcpy(next + y*size.x, image.GetPixelAddress(0, y), size.x);
+            }
+            int transparent = image.GetTransparent();
+            image.~Image();
+            new(&image) Image(block, size.x, size.y, transparent);
+            next += Align(size.x * size.y, sizeof(u16));
+        }
+
+#if CONFIG_SPAN_SPRITES
+        if(image.GetTransparent() >= 0)
+        {
+            u16* rowSpans = reinterpret_cast<u16*>(next);
+            Image::Span* spans = reinterpret_cast<Image::Span*>(rowSpans + size.y + 1);
+            image.BuildSpans(spans, rowSpans);
+            spanCount += rowSpans[size.y];
+        }
+#endif
+        block += blockSize;
+    }
 }
 
 ImageSheet::~ImageSheet()
@@ -43,4 +122,7 @@ ImageSheet::~ImageSheet()
         delete[] reinterpret_cast<u8*>(images);
         images = nullptr;
     }
+
+    delete[] storage;
+    storage = nullptr;
 }
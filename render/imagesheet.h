@@ -1,6 +1,7 @@
 #pragma once
 #include <circle/types.h>
 #include "render/image.h"
+#include "config.h"
 
 namespace hfh3
 {
@@ -25,8 +26,11 @@ namespace hfh3
           * @param imageHeight The height of each image in the sheet
           * @param transparent The index of the transparent pixel. Pass -1 if all pixels should be rendered.
           * @param groupSize The number of images in each group.
+          * @param packed If true, the pixels of each image are copied to a separate block of memory
+          *               instead of referring to the sheet. See Layout.
           */
-        ImageSheet(u8* inData, unsigned bufferWidth, unsigned bufferHeight, int imageWidth, int imageHeight, int transparent=-1, unsigned groupSize=1);
+        ImageSheet(u8* inData, unsigned bufferWidth, unsigned bufferHeight, int imageWidth, int imageHeight, int transparent=-1, unsigned groupSize=1,
+                   bool packed=CONFIG_PACKED_SPRITES);
         ~ImageSheet();
 
         /** Returns an array of images representing a group of images.
@@ -52,10 +56,34 @@ namespace hfh3
             return groupSize;
         }
 
+        /** Returns the total number of opaque spans built for the images.
+          */
+        int GetSpanCount() const
+        {
+            return spanCount;
+        }
+
     private:
+        static const int blockAlignment = 16;
+
         u8* GetImageStart(u8* data, int col, int row);
+
+        /** Precomputes the opaque spans of all images with transparent pixels.
+          * If packed is set, the pixels of each image are also copied to a block aligned
+          * on blockAlignment bytes, followed by its spans. A sprite is then drawn from
+          * a few adjacent cache lines, instead of one line of the sheet for each row.
+          */
+        void Layout(bool packed);
+
+        // Returns the number of bytes Layout stores for an image
+        static unsigned GetBlockSize(const Image& image, bool packed);
+
         Image* images;
         unsigned groupSize;
         unsigned imageCount;
+
+        // Storage for the image blocks or spans built by Layout
+        u8* storage;
+        int spanCount;
     };
 }
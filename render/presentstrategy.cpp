@@ -0,0 +1,219 @@
+#include "render/presentstrategy.h"
+
+#include <circle/timer.h>
+#include <circle/util.h>
+#include <assert.h>
+
+using namespace hfh3;
+
+void PresentStrategy::CopyFrame(u8* destination, const u8* source)
+{
+    if (destination != source)
+    {
+        memcpy(destination, source, buffers->GetByteSize());
+    }
+}
+
+void PresentStrategy::Sync(unsigned finishTick)
+{
+    VSync& vsync = *buffers->vsync;
+    vsync.Wait();
+    latency = vsync.GetTick(vsync.GetCount() - 1) - finishTick;
+}
+
+void CopyPresent::Activate(FrameBuffers& inBuffers, const u8* shown)
+{
+    buffers = &inBuffers;
+    active = buffers->renderBuffer;
+    visible = buffers->pages[0];
+    CopyFrame(active, shown);
+    CopyFrame(visible, shown);
+    buffers->Show(0);
+}
+
+unsigned CopyPresent::Present(const Array<Rect<s16>>& dirtyRects)
+{
+    assert(buffers);
+    const int stride = buffers->stride;
+    unsigned copied = 0;
+    for (const Rect<s16>& rect : dirtyRects)
+    {
+        const int offset = rect.Left() + rect.Top() * stride;
+        if (rect.Width() == buffers->size.x)
+        {
+            // Full rows are contiguous in both buffers
+            const unsigned length = rect.Height() * stride;
+            memcpy(visible + offset, active + offset, length);
+            copied += length;
+            continue;
+        }
+
+        for (int y = 0; y < rect.Height(); y++)
+        {
+            memcpy(visible + offset + y * stride, active + offset + y * stride, rect.Width());
+        }
+        copied += rect.Width() * rect.Height();
+    }
+    return copied;
+}
+
+DmaPresent::DmaPresent(bool inParallel)
+    : dma(DMA_CHANNEL_SCREEN)
+    , parallel(inParallel)
+{
+}
+
+unsigned DmaPresent::Present(const Array<Rect<s16>>& dirtyRects)
+{
+    assert(buffers);
+    int top = buffers->size.y;
+    int bottom = 0;
+    for (const Rect<s16>& rect : dirtyRects)
+    {
+        top = rect.Top() < top ? rect.Top() : top;
+        bottom = rect.Bottom() > bottom ? rect.Bottom() : bottom;
+    }
+    if (top >= bottom)
+    {
+        return 0;
+    }
+
+    // Setting up the transfer also cleans the source from the data cache
+    const int offset = top * buffers->stride;
+    const unsigned length = (bottom - top) * buffers->stride;
+    dma.SetupMemCopy(visible + offset, active + offset, length);
+    dma.Start();
+    if (!parallel)
+    {
+        dma.Wait();
+    }
+    return length;
+}
+
+void DmaPresent::WaitForBufferReady()
+{
+    if (parallel)
+    {
+        dma.Wait();
+    }
+}
+
+void PageFlipPresent::Activate(FrameBuffers& inBuffers, const u8* shown)
+{
+    buffers = &inBuffers;
+    const int page = shown == buffers->pages[1] ? 1 : 0;
+    visible = buffers->pages[page];
+    active = buffers->pages[1 - page];
+    CopyFrame(visible, shown);
+    CopyFrame(active, shown);
+    buffers->Show(page);
+}
+
+void PageFlipPresent::PreSync()
+{
+    // The GPU won't switch pages until the vertical sync, so this has to be requested
+    // BEFORE waiting for it. Future draw calls keep going to the page not shown.
+    buffers->Show(active == buffers->pages[1] ? 1 : 0);
+    u8* shown = active;
+    active = visible;
+    visible = shown;
+}
+
+TriplePresent::TriplePresent()
+    : shownPage(0)
+    , queued(-1)
+    , queuedSync(0)
+    , queuedFinish(0)
+    , finishTick(0)
+    , lastShownSync(0)
+    , missedFrames(0)
+{
+}
+
+void TriplePresent::Activate(FrameBuffers& inBuffers, const u8* shown)
+{
+    buffers = &inBuffers;
+    shownPage = 0;
+    for (int page = 0; page < FrameBuffers::PAGE_COUNT; page++)
+    {
+        if (shown == buffers->pages[page])
+        {
+            shownPage = page;
+        }
+    }
+    for (int page = 0; page < FrameBuffers::PAGE_COUNT; page++)
+    {
+        CopyFrame(buffers->pages[page], shown);
+    }
+    buffers->Show(shownPage);
+
+    queued = -1;
+    visible = buffers->pages[shownPage];
+    active = buffers->pages[(shownPage + 1) % FrameBuffers::PAGE_COUNT];
+    lastShownSync = buffers->vsync->GetCount() - 1;
+    missedFrames = buffers->vsync->GetMissed();
+}
+
+void TriplePresent::CheckShown()
+{
+    const VSync& vsync = *buffers->vsync;
+    if (queued < 0 || vsync.GetCount() == queuedSync)
+    {
+        return;
+    }
+
+    // The first vertical sync after queueing the page showed it
+    if (vsync.GetCount() - queuedSync <= VSync::TICK_HISTORY)
+    {
+        latency = vsync.GetTick(queuedSync) - queuedFinish;
+    }
+    missedFrames += queuedSync - lastShownSync - 1;
+    lastShownSync = queuedSync;
+
+    shownPage = queued;
+    queued = -1;
+    visible = buffers->pages[shownPage];
+}
+
+void TriplePresent::Sync(unsigned inFinishTick)
+{
+    finishTick = inFinishTick;
+    CheckShown();
+    if (queued >= 0)
+    {
+        // The other two pages are still shown and queued, so wait for the queued one to
+        // be shown to free up a page for the next frame.
+        Flush();
+    }
+}
+
+void TriplePresent::Flush()
+{
+    if (queued >= 0)
+    {
+        buffers->vsync->Wait();
+        CheckShown();
+    }
+}
+
+unsigned TriplePresent::Present(const Array<Rect<s16>>& dirtyRects)
+{
+    int page = 0;
+    while (buffers->pages[page] != active)
+    {
+        page++;
+    }
+
+    // Request the page first and note the vsync count after, so a vsync in between
+    // can only make the page appear to be shown later than it is. Drawing to the page
+    // that was shown before is then never started too early.
+    buffers->Show(page);
+    queued = page;
+    queuedSync = buffers->vsync->GetCount();
+    queuedFinish = finishTick;
+
+    // Draw the next frame to the page that is neither shown nor queued.
+    // The indices of the three pages add up to 3.
+    active = buffers->pages[3 - shownPage - queued];
+    return 0;
+}
@@ -0,0 +1,192 @@
+#pragma once
+#include <circle/bcmframebuffer.h>
+#include <circle/types.h>
+#include <circle/dmachannel.h>
+#include "util/vector.h"
+#include "util/rect.h"
+#include "util/array.h"
+#include "util/vsync.h"
+
+namespace hfh3
+{
+
+    /** The memory frames are drawn to and shown from, set up by the ScreenManager.
+      */
+    struct FrameBuffers
+    {
+        static const int PAGE_COUNT = 3;
+
+        CBcmFrameBuffer* framebuffer;
+        VSync* vsync;
+        u8* pages[PAGE_COUNT]; // The pages of GPU memory the display can show
+        u8* renderBuffer; // A buffer of the same size in cached CPU memory
+        Vector<s16> size;
+        int stride;
+
+        unsigned GetByteSize() const { return size.y * stride; }
+
+        /** Makes the display show one of the pages, starting with the next vertical sync.
+          */
+        void Show(int page)
+        {
+            if (framebuffer)
+            {
+                framebuffer->SetVirtualOffset(0, page * size.y);
+            }
+        }
+    };
+
+    /** Decides how the frames drawn by the ScreenManager get to the display.
+      * Frames are drawn to the active buffer, and Present is called right after
+      * each vertical sync to show the finished frame.
+      * The strategy in use can be changed between frames with
+      * ScreenManager::SetPresentStrategy.
+      */
+    class PresentStrategy
+    {
+    public:
+        PresentStrategy()
+            : buffers(nullptr)
+            , active(nullptr)
+            , visible(nullptr)
+            , latency(0)
+        {}
+        virtual ~PresentStrategy() {}
+
+        /** Returns a short name for logs. */
+        virtual const char* GetName() const = 0;
+
+        /** Takes over the buffers. shown is the buffer holding the last frame shown,
+          * which the strategy must keep showing. It also copies it to the active buffer,
+          * so areas that are not drawn again in the next frame stay the same.
+          */
+        virtual void Activate(FrameBuffers& inBuffers, const u8* shown) = 0;
+
+        /** Returns the buffer the next frame is drawn to. */
+        u8* GetActive() const { return active; }
+
+        /** Returns the buffer holding the last frame presented. */
+        u8* GetVisible() const { return visible; }
+
+        /** Called before waiting for the vertical sync, to request changes the GPU
+          * applies during it. */
+        virtual void PreSync() {}
+
+        /** Waits until the frame in the active buffer can be presented. The frame was
+          * finished at finishTick. By default this waits for the next vertical sync,
+          * which is also when the frame shows up. */
+        virtual void Sync(unsigned finishTick);
+
+        /** Called right after the vertical sync to show the frame in the active buffer.
+          * Only the dirty areas have changed since the previous frame.
+          * Returns the number of bytes copied. */
+        virtual unsigned Present(const Array<Rect<s16>>& dirtyRects) = 0;
+
+        /** Blocks until the active buffer can be drawn to after Present. */
+        virtual void WaitForBufferReady() {}
+
+        /** Blocks until every frame presented has reached the display. */
+        virtual void Flush() { WaitForBufferReady(); }
+
+        /** See ScreenManager::GetBufferCount. */
+        virtual int GetBufferCount() const { return 1; }
+
+        /** Returns the number of finished frames that are waiting to be shown. */
+        virtual int GetQueueDepth() const { return 0; }
+
+        /** Returns the number of vertical syncs that showed the same frame again. */
+        virtual unsigned GetMissedFrames() const { return buffers->vsync->GetMissed(); }
+
+        /** Returns the clock ticks from finishing the last frame that was shown until
+          * the vertical sync that showed it. */
+        unsigned GetLatency() const { return latency; }
+
+    protected:
+        /** Copies a whole frame between two of the buffers, if they are different. */
+        void CopyFrame(u8* destination, const u8* source);
+
+        FrameBuffers* buffers;
+        u8* active;
+        u8* visible;
+        unsigned latency;
+    };
+
+    /** Draws to the render buffer and copies the dirty areas to the first page with
+      * the CPU after each vertical sync. Needs no hardware support.
+      * Despite the copy, this is faster than drawing to uncached GPU memory.
+      */
+    class CopyPresent : public PresentStrategy
+    {
+    public:
+        virtual const char* GetName() const override { return "memcpy"; }
+        virtual void Activate(FrameBuffers& inBuffers, const u8* shown) override;
+        virtual unsigned Present(const Array<Rect<s16>>& dirtyRects) override;
+    };
+
+    /** Like CopyPresent, but copies the rows spanned by the dirty areas with the DMA
+      * controller, as a single DMA transfer needs a contiguous source.
+      * If parallel is set, Present returns as soon as the transfer has started, so
+      * the game can update while it runs, and WaitForBufferReady waits for it to end.
+      */
+    class DmaPresent : public CopyPresent
+    {
+    public:
+        DmaPresent(bool inParallel);
+
+        virtual const char* GetName() const override { return parallel ? "dma2" : "dma1"; }
+        virtual unsigned Present(const Array<Rect<s16>>& dirtyRects) override;
+        virtual void WaitForBufferReady() override;
+
+    private:
+        CDMAChannel dma;
+        bool parallel;
+    };
+
+    /** Draws directly to the page of GPU memory that is not shown, and has the GPU
+      * switch pages during the vertical sync. Nothing is copied, but drawing to
+      * uncached memory is slower.
+      */
+    class PageFlipPresent : public PresentStrategy
+    {
+    public:
+        virtual const char* GetName() const override { return "pageflip"; }
+        virtual void Activate(FrameBuffers& inBuffers, const u8* shown) override;
+        virtual void PreSync() override;
+        virtual unsigned Present(const Array<Rect<s16>>& dirtyRects) override { return 0; }
+        virtual int GetBufferCount() const override { return 2; }
+    };
+
+    /** Page flipping with three pages of GPU memory. A finished frame is queued to be
+      * shown at the next vertical sync, and the next frame is drawn to the third page
+      * right away. Present only waits when the frame queued before has not been shown
+      * yet, so a late frame costs the time it is late instead of a whole vertical
+      * sync period, at the cost of up to a frame of extra latency.
+      */
+    class TriplePresent : public PresentStrategy
+    {
+    public:
+        TriplePresent();
+
+        virtual const char* GetName() const override { return "triple"; }
+        virtual void Activate(FrameBuffers& inBuffers, const u8* shown) override;
+        virtual void Sync(unsigned finishTick) override;
+        virtual unsigned Present(const Array<Rect<s16>>& dirtyRects) override;
+        virtual int GetBufferCount() const override { return FrameBuffers::PAGE_COUNT; }
+        virtual void Flush() override;
+        virtual int GetQueueDepth() const override { return queued >= 0 ? 1 : 0; }
+        virtual unsigned GetMissedFrames() const override { return missedFrames; }
+
+    private:
+        /** Checks whether the queued page has been shown by a vertical sync since it
+          * was queued, and makes it the visible one if so. */
+        void CheckShown();
+
+        int shownPage;
+        int queued;            // The page waiting to be shown, or -1
+        unsigned queuedSync;   // The vsync count when the page was queued
+        unsigned queuedFinish; // The tick the frame in the queued page was finished at
+        unsigned finishTick;
+        unsigned lastShownSync;
+        unsigned missedFrames;
+    };
+}
@@ -5,13 +5,13 @@
 #include "render/screenmanager.h"
 #include "render/image.h"
 #include "render/font.h"
+#include "render/blitter.h"
 
 #include "util/log.h"
 #include "util/memops.h"
+#include "util/workerpool.h"
 
-#if CONFIG_NEON_RENDER
-#include <arm_neon.h>
-#endif
+#include "util/simd.h"
 
 using namespace hfh3;
 
@@ -24,48 +24,52 @@ static inline unsigned DivRound(unsigned a, unsigned b)
 
 ScreenManager::ScreenManager()
     : framebuffer(nullptr)
-#if CONFIG_DMA_FRAME_COPY
-    , dma(DMA_CHANNEL_SCREEN)
-#endif
-#if CONFIG_GPU_PAGE_FLIPPING
-    , active(0)
-#else
-    , renderBuffer(nullptr)
-#endif
-    , bufferAddress(nullptr)
+    , buffers()
+    , strategy(nullptr)
+    , strategyIndex(0)
+    , activeBuffer(nullptr)
+    , visibleBuffer(nullptr)
     , size(0,0)
     , stride(0)
     , clip()
+    , blitMode(CONFIG_SPAN_SPRITES ? BlitMode::Spans : BlitMode::Masked)
+    , fixedBlitters(CONFIG_FIXED_BLITTERS)
+    , textCaching(CONFIG_TEXT_CACHE)
+    , bandHeight(CONFIG_RENDER_BAND_HEIGHT)
+    , binning(false)
     , frame(0)
     , lastSync(0)
     , lastPresent(0)
 {
-    current = {0,0,0};
+    current = {0,0,0,0,0,0,0};
     ClearTimers();
 }
 
 ScreenManager::~ScreenManager()
 {
-#if CONFIG_GPU_PAGE_FLIPPING == 0
-    delete[] renderBuffer;
-    renderBuffer = nullptr;
-#endif
+    if(strategy)
+    {
+        strategy->Flush();
+    }
+    for(PresentStrategy* entry : strategies)
+    {
+        delete entry;
+    }
+    strategies.Clear();
+    strategy = nullptr;
+
+    delete[] buffers.renderBuffer;
+    buffers.renderBuffer = nullptr;
 
     delete framebuffer;
     framebuffer = nullptr;
-    bufferAddress = nullptr;
+    activeBuffer = visibleBuffer = nullptr;
 }
 
 bool ScreenManager::Initialize()
 {
-#if CONFIG_GPU_PAGE_FLIPPING
-    const unsigned virtualHeight = fbHeight * 2;
-    active = 1;
-#else
-    const unsigned virtualHeight = fbHeight;
-#endif
-
-    framebuffer = new CBcmFrameBuffer(fbWidth, fbHeight, 8, fbWidth, virtualHeight);
+    // Allocate all pages of GPU memory up front, so all present strategies can be used.
+    framebuffer = new CBcmFrameBuffer(fbWidth, fbHeight, 8, fbWidth, fbHeight * FrameBuffers::PAGE_COUNT);
     for(int i = 0; i<256; i++)
     {
         framebuffer->SetPalette32(i, sprites_palette[i]);
@@ -79,7 +83,6 @@ bool ScreenManager::Initialize()
     framebuffer->SetVirtualOffset(0, 0);
     size = Vector<s16>(framebuffer->GetWidth(), framebuffer->GetHeight());
     stride = framebuffer->GetPitch();
-    bufferAddress = reinterpret_cast<u8*>(framebuffer->GetBuffer());
     ClearClip();
 
     if (!vsync.Initialize())
@@ -87,94 +90,122 @@ bool ScreenManager::Initialize()
         return false;
     }
 
-#if CONFIG_GPU_PAGE_FLIPPING == 0
-    renderBuffer = new u8[size.y*stride];
-    Clear();
-#endif
+    buffers.framebuffer = framebuffer;
+    buffers.vsync = &vsync;
+    buffers.pages[0] = reinterpret_cast<u8*>(framebuffer->GetBuffer());
+    for(int page = 1; page < FrameBuffers::PAGE_COUNT; page++)
+    {
+        buffers.pages[page] = buffers.pages[page - 1] + size.y * stride;
+    }
+    buffers.renderBuffer = new u8[size.y*stride];
+    buffers.size = size;
+    buffers.stride = stride;
+    if (!buffers.pages[0])
+    {
+        return false;
+    }
 
-#if CONFIG_DMA_FRAME_COPY
-    dma.SetupMemCopy(bufferAddress, renderBuffer, size.y * stride);
-#endif
+    strategies.Append(new CopyPresent());
+    strategies.Append(new DmaPresent(false));
+    strategies.Append(new DmaPresent(true));
+    strategies.Append(new PageFlipPresent());
+    strategies.Append(new TriplePresent());
+
+    // Start from a cleared frame, which the strategy copies to the other buffers it uses.
+    memset(buffers.renderBuffer, 0, size.y*stride);
+    strategy = strategies[0];
+    strategy->Activate(buffers, buffers.renderBuffer);
+    activeBuffer = strategy->GetActive();
+    visibleBuffer = strategy->GetVisible();
+    for(int i = 0; i < strategies.Size(); i++)
+    {
+        if(strcmp(strategies[i]->GetName(), CONFIG_PRESENT_STRATEGY) == 0)
+        {
+            SetPresentStrategy(i);
+        }
+    }
 
-    return bufferAddress != nullptr;
+    MarkAllDirty();
+    return true;
 }
 
-// Swaps the active and visible frames and waits for vertical sync before returning.
+void ScreenManager::SetPresentStrategy(int index)
+{
+    assert(index >= 0 && index < strategies.Size());
+    if(strategies[index] == strategy)
+    {
+        return;
+    }
+
+    // Let the current strategy finish presenting the last frame, and have the next one
+    // take over showing it.
+    strategy->Flush();
+    const u8* shown = strategy->GetVisible();
+    strategyIndex = index;
+    strategy = strategies[index];
+    strategy->Activate(buffers, shown);
+    activeBuffer = strategy->GetActive();
+    visibleBuffer = strategy->GetVisible();
+}
+
+// Presents the active frame and waits for vertical sync before returning,
+// unless the strategy queues the frame to be shown later.
 void ScreenManager::Present()
 {
     UpdateStatsPreSync();
-#if CONFIG_GPU_PAGE_FLIPPING
-    // Flip the logical and physical frame buffers
-    // The GPU won't do the switch until the vertical sync period, so
-    // we'll have to request it BEFORE we wait for VSync
-    Flip();
-#endif
 
-    WaitForVerticalSync();
+    // Page flipping has to request the switch BEFORE waiting for VSync,
+    // as the GPU won't do it until the vertical sync period.
+    strategy->PreSync();
+
+    strategy->Sync(CTimer::Get()->GetClockTicks());
 
     // Update frame rate statistics, etc.
     UpdateStatsPostSync();
-#if CONFIG_GPU_PAGE_FLIPPING == 0
-    // Copy the logical frame buffer to the physical
-    // This has to happen immediately AFTER waiting for VSYNC so it will
+
+    // Copying has to happen immediately AFTER waiting for VSYNC so it will
     // happen during the vertical blank period.
-    CopyFrameData();
-#endif
+    current.presentBytes = strategy->Present(dirtyRects);
+    dirtyRects.ClearFast();
+    activeBuffer = strategy->GetActive();
+    visibleBuffer = strategy->GetVisible();
+    current.queueDepth = strategy->GetQueueDepth();
+    current.latencyTicks = strategy->GetLatency();
+
     UpdateStatsPostCopy();
 }
 
-#if CONFIG_GPU_PAGE_FLIPPING
-// Swaps the visible frames
-void ScreenManager::Flip()
+void ScreenManager::MarkDirty(const Rect<s16>& rect)
 {
-    if(!framebuffer)
+    Rect<s16> merged = GetScreenRect() & rect;
+    if (!merged.IsValid())
     {
         return;
     }
 
-    // Request the GPU to switch the visible view port to the active screen.
-    // Note that the GPU will not actually perform the switch until during the next
-    // vertical sync.
-    framebuffer->SetVirtualOffset(0, active*GetHeight());
-
-    // Swap the active screen so future draw commands will keep going to the off-screen buffer
-    active = (active + 1) % 2;
-}
-#else
-// Copy the frame data to the screen
-void ScreenManager::CopyFrameData()
-{
-    if(!framebuffer)
+    // Absorb every rect the new one overlaps. The merged rect can grow to overlap
+    // rects it did not overlap before, so start over after each merge.
+    for (int i = 0; i < dirtyRects.Size();)
     {
-        return;
+        if (dirtyRects[i].Overlaps(merged))
+        {
+            merged |= dirtyRects.Pull(i);
+            i = 0;
+        }
+        else
+        {
+            i++;
+        }
     }
-
-    assert(bufferAddress);
-    assert(renderBuffer);
-#if CONFIG_DMA_FRAME_COPY
-    dma.Start();
-#   if !CONFIG_DMA_PARALLEL
-    dma.Wait();
-#   endif
-#else
-    memcpy(bufferAddress, renderBuffer, size.y * stride);
-#endif
-}
-#endif
-
-void ScreenManager::WaitForVerticalSync()
-{
-    vsync.Wait();
+    dirtyRects.Append(merged);
 }
 
 void ScreenManager::WaitForScreenBufferReady()
 {
-#if CONFIG_DMA_PARALLEL
     CTimer *timer = CTimer::Get();
     const unsigned waitStart = timer->GetClockTicks();   
-    dma.Wait();
+    strategy->WaitForBufferReady();
     current.presentTicks = timer->GetClockTicks() - waitStart;
-#endif
 }
 
 void ScreenManager::UpdateStatsPreSync()
@@ -183,12 +214,10 @@ void ScreenManager::UpdateStatsPreSync()
     // Get the current timer tick count
     const unsigned currentTick = timer->GetClockTicks();
     current.gameTicks = currentTick - lastPresent;
-#if CONFIG_DMA_PARALLEL
-    // We have an extra wait during game code when it calls WaitForScreenBufferReady
-    // and have to subtract the current value of current.presentTicks to credit that
-    // time back to the game code.
+    // Strategies that present in parallel wait during game code when it calls
+    // WaitForScreenBufferReady, so subtract the current value of current.presentTicks
+    // to credit that time back to the game code.
     current.gameTicks -= current.presentTicks;
-#endif
 }
 
 
@@ -213,7 +242,7 @@ unsigned ScreenManager::GetTimers(Timer& outSum)
 
 void ScreenManager::ClearTimers()
 {
-    sum = current = prev = {0,0,0};
+    sum = current = prev = {0,0,0,0,0,0,0};
     frame = 0;
 }
 
@@ -225,20 +254,20 @@ void ScreenManager::UpdateStatsPostCopy()
     // Get the current timer tick count
     const unsigned currentTick = timer->GetClockTicks();
 
-#if CONFIG_DMA_PARALLEL
     // current.presentTicks already contains the amount of time
     // spent in WaitForScreenBufferReady.
     current.presentTicks += currentTick - lastSync;
-#else
-    current.presentTicks = currentTick - lastSync;
-#endif
 
     UPDATE_SUM(gameTicks);
     UPDATE_SUM(presentTicks);
     UPDATE_SUM(ticksPerFrame);
+    UPDATE_SUM(presentBytes);
+    UPDATE_SUM(textTicks);
+    UPDATE_SUM(queueDepth);
+    UPDATE_SUM(latencyTicks);
 
     prev = current;
-    current = {0,0,0};
+    current = {0,0,0,0,0,0,0};
 
     // Update current frame number
     frame ++;
@@ -260,6 +289,16 @@ unsigned ScreenManager::GetFlipTimePCT()
     return DivRound(100 * prev.presentTicks, prev.ticksPerFrame);
 }
 
+unsigned ScreenManager::GetLatencyUS()
+{
+    return DivRound(prev.latencyTicks * 1000, CLOCKHZ / 1000);
+}
+
+unsigned ScreenManager::GetTextTimeUS()
+{
+    return DivRound(prev.textTicks * 1000, CLOCKHZ / 1000);
+}
+
 void ScreenManager::SetClip(const Rect<s16>& rect)
 {
     clip = GetScreenRect() & rect;
@@ -272,7 +311,7 @@ void ScreenManager::ClearClip()
 
 void ScreenManager::DrawPixel(const Vector<s16>& at, u8 color)
 {
-    if(!bufferAddress)
+    if(!activeBuffer)
     {
         return;
     }
@@ -280,12 +319,17 @@ void ScreenManager::DrawPixel(const Vector<s16>& at, u8 color)
     {
         return;
     }
+    if(binning)
+    {
+        BinDrawOp(DrawOp {nullptr, Rect<s16>(at, Vector<s16>(1,1)), color, DrawOp::DrawPixelOp}, at.y, at.y+1);
+        return;
+    }
     *GetPixelAddress(at) = color;
 }
 
 void ScreenManager::DrawRect(const Rect<s16>& rect, u8 color)
 {
-    if(!bufferAddress)
+    if(!activeBuffer)
     {
         return;
     }
@@ -295,19 +339,28 @@ void ScreenManager::DrawRect(const Rect<s16>& rect, u8 color)
     {
         return;
     }
+    if(binning)
+    {
+        BinDrawOp(DrawOp {nullptr, clipped, color, DrawOp::DrawRectOp}, clipped.Top(), clipped.Bottom());
+        return;
+    }
+    FillRect(clipped, color);
+}
 
+void ScreenManager::FillRect(const Rect<s16>& clipped, u8 color)
+{
     // If the rectangle fills the entire width of the screen we can draw it with a single memset
     if( clipped.Width() == GetWidth())
     {
         assert(clipped.Left() == 0);
-        memset(GetPixelAddress(clipped.origin), color, stride * clipped.Height());
+        Simd::Fill(GetPixelAddress(clipped.origin), color, stride * clipped.Height());
     }
     // Else, we need to draw each scan line separately
     else
     {
         for (int row = clipped.Top(); row < clipped.Bottom(); row++)
         {
-            memset(GetPixelAddress(clipped.Left(),row), color, clipped.Width());
+            Simd::Fill(GetPixelAddress(clipped.Left(),row), color, clipped.Width());
         }
     }
 }
@@ -327,7 +380,7 @@ Image ScreenManager::GetImageRect(const Rect<s16>& rect, frame_t source)
 
 void ScreenManager::DrawImage(const Vector<s16>& at, const Image& image)
 {
-    if(!bufferAddress)
+    if(!activeBuffer)
     {
         return;
     }
@@ -339,6 +392,23 @@ void ScreenManager::DrawImage(const Vector<s16>& at, const Image& image)
         return;
     }
 
+    if(binning)
+    {
+        // The image is clipped against the band when the op is drawn
+        BinDrawOp(DrawOp {&image, Rect<s16>(at, image.GetSize()), 0, DrawOp::DrawImageOp}, clipped.Top(), clipped.Bottom());
+        return;
+    }
+    DrawImageClipped(at, image, clipped);
+}
+
+void ScreenManager::DrawImageClipped(const Vector<s16>& at, const Image& image, const Rect<s16>& clipped)
+{
+    // Images that are not clipped at all may have a blitter specialized for their size
+    if(fixedBlitters && clipped.size == image.GetSize() && DrawFixed(GetPixelAddress(at), stride, image))
+    {
+        return;
+    }
+
     int image_min_x = Max(clipped.Left() - at.x , 0);
     int image_min_y = Max(clipped.Top() - at.y , 0);
     int image_max_y = image_min_y + clipped.Height();
@@ -352,53 +422,183 @@ void ScreenManager::DrawImage(const Vector<s16>& at, const Image& image)
             memcpy(GetPixelAddress(at.x+image_min_x, at.y+image_y), image.GetPixelAddress(image_min_x, image_y), clipped.Width());
         }
     }
+    // if the opaque runs of the image are known, we only need to copy those
+    else if(blitMode == BlitMode::Spans && image.HasSpans())
+    {
+        DrawImageSpans(at, image, clipped);
+    }
     // else we have to compare each pixel to the transparent value before plotting it
     else
     {
         const int width = clipped.Width();
         const u8 tcolor = (u8)transparent;
-#if CONFIG_NEON_RENDER
-        // The neon intrinsics below copy 16 pixels in one chunk
-        const int neonWidth = (width/sizeof(uint8x16_t))*sizeof(uint8x16_t);
-        const uint8x16_t tvector = vmovq_n_u8(tcolor); // 16x transparent color
-#endif
         for (int image_y = image_min_y; image_y < image_max_y; image_y++)
         {
             u8* dstRow = GetPixelAddress(at.x+image_min_x, at.y+image_y);
             const u8* srcRow = image.GetPixelAddress(image_min_x, image_y);
-            int i=0;
-#if CONFIG_NEON_RENDER
-            for(; i < neonWidth; i+= sizeof(uint8x16_t))
+            if (blitMode == BlitMode::Scalar)
+            {
+                Simd::Scalar::CopyMasked(dstRow, srcRow, width, tcolor);
+            }
+            else
             {
-                // Grab 16 pixels of source and destination data
-                uint8x16_t dstChunk = vld1q_u8(&dstRow[i]);
-                uint8x16_t srcChunk = vld1q_u8(&srcRow[i]);
+                Simd::CopyMasked(dstRow, srcRow, width, tcolor);
+            }
+        }
+    }
+}
 
-                // Compare 16 pixesl of source data against the transparent color
-                uint8x16_t transparent = vceqq_u8(srcChunk, tvector);
+void ScreenManager::DrawImageSpans(const Vector<s16>& at, const Image& image, const Rect<s16>& clipped)
+{
+    // The visible columns of the image
+    const int image_min_x = clipped.Left() - at.x;
+    const int image_max_x = clipped.Right() - at.x;
+
+    for (int row = clipped.Top(); row < clipped.Bottom(); row++)
+    {
+        const int image_y = row - at.y;
+        u8* dstRow = GetPixelAddress(clipped.Left(), row);
+        const u8* srcRow = image.GetPixelAddress(0, image_y);
+
+        int count;
+        const Image::Span* span = image.GetRowSpans(image_y, count);
+        for (; count > 0; count--, span++)
+        {
+            int start = span->start;
+            int end = start + span->length;
 
-                // Select source where the color was not transparent and dst where it was
-                // and the result to memory
-                vst1q_u8(&dstRow[i],vbslq_u8(transparent, dstChunk, srcChunk));
+            // Trim the span to the clipped area
+            if (start < image_min_x)
+            {
+                start = image_min_x;
+            }
+            if (end > image_max_x)
+            {
+                end = image_max_x;
+            }
+            if (start < end)
+            {
+                memcpy(dstRow + start - image_min_x, srcRow + start, end - start);
             }
+        }
+    }
+}
 
-            // Since the clip areay may not be divisible by 16, we iterate through
-            // the remainder one pixel at a time.
-#endif
-            for(; i < width; i++)
+void ScreenManager::BeginBands()
+{
+    if(bandHeight <= 0)
+    {
+        return;
+    }
+    assert(!binning);
+    binning = true;
+    drawOps.ClearFast();
+    entryBands.ClearFast();
+    entryOps.ClearFast();
+}
+
+void ScreenManager::BinDrawOp(const DrawOp& op, int top, int bottom)
+{
+    int index = drawOps.Size();
+    drawOps.Append(op);
+    for(int band = top / bandHeight; band * bandHeight < bottom; band++)
+    {
+        entryBands.Append(band);
+        entryOps.Append(index);
+    }
+}
+
+void ScreenManager::EndBands()
+{
+    if(!binning)
+    {
+        return;
+    }
+    binning = false;
+
+    // Count the entries of each band and turn the counts into the index one
+    // past the last entry of the band.
+    int numBands = (size.y + bandHeight - 1) / bandHeight;
+    int numEntries = entryBands.Size();
+    bandStart.ClearFast();
+    int* start = bandStart.Grow(numBands + 1);
+    memset(start, 0, sizeof(int) * (numBands + 1));
+    const int* bands = entryBands;
+    for(int i = 0; i < numEntries; i++)
+    {
+        start[bands[i]]++;
+    }
+    for(int band = 1; band <= numBands; band++)
+    {
+        start[band] += start[band-1];
+    }
+
+    // Place the entries walking backwards, which keeps the draw order within
+    // each band and leaves bandStart pointing at the first entry of the band.
+    sortedOps.ClearFast();
+    int* sorted = sortedOps.Grow(numEntries);
+    const int* ops = entryOps;
+    for(int i = numEntries - 1; i >= 0; i--)
+    {
+        sorted[--start[bands[i]]] = ops[i];
+    }
+
+    // Draw the bands, spread over the available cores. The bands cover separate
+    // rows of the frame buffer and only read the sorted ops, so they can be drawn
+    // in any order.
+    WorkerPool::Task drawBand = [this](int band) { DrawBand(band); };
+    WorkerPool::Instance().Run(numBands, drawBand);
+}
+
+void ScreenManager::DrawBand(int band)
+{
+    const int* start = bandStart;
+    if(start[band] == start[band+1])
+    {
+        return;
+    }
+
+    // Limit output to the current band. The clip is kept local, as other bands
+    // may be drawn at the same time.
+    const Rect<s16> bandClip = clip & Rect<s16>(0, band * bandHeight, size.x, bandHeight);
+    const int* sorted = sortedOps;
+    const DrawOp* drawOp = drawOps;
+    for(int i = start[band]; i < start[band+1]; i++)
+    {
+        const DrawOp& op = drawOp[sorted[i]];
+        switch(op.type)
+        {
+        case DrawOp::DrawImageOp:
+            {
+                Rect<s16> clipped = bandClip & op.rect;
+                if(clipped.IsValid())
+                {
+                    DrawImageClipped(op.rect.origin, *op.image, clipped);
+                }
+            }
+            break;
+        case DrawOp::DrawRectOp:
             {
-                if (srcRow[i] != tcolor)
+                Rect<s16> clipped = bandClip & op.rect;
+                if(clipped.IsValid())
                 {
-                    dstRow[i] = srcRow[i];
+                    FillRect(clipped, op.color);
                 }
             }
+            break;
+        case DrawOp::DrawPixelOp:
+            if(bandClip.Contains(op.rect.origin))
+            {
+                *GetPixelAddress(op.rect.origin) = op.color;
+            }
+            break;
         }
     }
 }
 
 void ScreenManager::DrawChar(const Vector<s16>& at, char c, u8 color, const Font& font)
 {
-    if(!bufferAddress)
+    if(!activeBuffer)
     {
         return;
     }
@@ -412,35 +612,50 @@ void ScreenManager::DrawChar(const Vector<s16>& at, char c, u8 color, const Font
     int cell_min_x = Max(clipped.Left() - at.x , 0);
     int cell_min_y = Max(clipped.Top() - at.y , 0);
     int cell_max_y = cell_min_y + clipped.Height();
-    int cell_max_x = cell_min_x + clipped.Width();
+    int cell_width = clipped.Width();
     for (int cell_y = cell_min_y; cell_y < cell_max_y; cell_y++)
     {
         u8* dst = GetPixelAddress(clipped.Left(), at.y+cell_y);
-        for(int cell_x = cell_min_x; cell_x < cell_max_x; cell_x++)
+        u8 bits = font.GetRowBits(c, cell_y);
+        // Whole rows of a glyph are expanded 8 pixels at a time
+        if (cell_width == 8)
         {
-            if (font.GetPixel(c, cell_x, cell_y))
-            {
-                *dst = color;
-            }
-            dst++;
+            Simd::ExpandBits(dst, bits, color);
+        }
+        else
+        {
+            Simd::Scalar::ExpandBits(dst, bits, cell_min_x, cell_width, color);
         }
     }
 }
 
 void ScreenManager::DrawString(const Vector<s16>& at, const char* string, u8 color, const Font& font)
 {
-    Vector<s16> current = at;
-    for(int i=0; string[i]; i++)
+    CTimer *timer = CTimer::Get();
+    const unsigned start = timer->GetClockTicks();
+
+    const Image* image = (textCaching && !binning) ? textCache.Get(string, color, font) : nullptr;
+    if(image)
     {
-        if(string[i] == '\n')
-        {
-            current.x = at.x;
-            current.y += font.GetHeight();
-        }
-        else
+        DrawImage(at, *image);
+    }
+    else
+    {
+        Vector<s16> position = at;
+        for(int i=0; string[i]; i++)
         {
-            DrawChar(current, string[i], color, font);
-            current.x += font.GetSize(string[i]).x;
+            if(string[i] == '\n')
+            {
+                position.x = at.x;
+                position.y += font.GetHeight();
+            }
+            else
+            {
+                DrawChar(position, string[i], color, font);
+                position.x += font.GetSize(string[i]).x;
+            }
         }
     }
+
+    current.textTicks += timer->GetClockTicks() - start;
 }
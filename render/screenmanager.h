@@ -4,14 +4,12 @@
 #include "util/vector.h"
 #include "util/rect.h"
 #include "util/vsync.h"
+#include "util/array.h"
+#include "render/textcache.h"
+#include "render/presentstrategy.h"
 #include "config.h"
 
 
-#if CONFIG_DMA_FRAME_COPY
-#   include <circle/dmachannel.h>
-#endif
-
-
 namespace hfh3
 {
 
@@ -38,8 +36,62 @@ namespace hfh3
           unsigned ticksPerFrame;
           unsigned gameTicks;
           unsigned presentTicks;
+          unsigned presentBytes;
+          unsigned textTicks;
+          unsigned queueDepth;
+          unsigned latencyTicks;
+        };
+
+        /** Selects how images with transparent pixels are drawn.
+          * Masked compares each pixel against the transparent color, 16 at a time
+          * when CONFIG_SIMD_RENDER is set, while Scalar always compares one at a time.
+          * Spans copies the precomputed opaque runs of images that have them, and
+          * falls back to Masked for other images.
+          */
+        enum class BlitMode
+        {
+            Masked,
+            Scalar,
+            Spans,
         };
 
+        void SetBlitMode(BlitMode mode) { blitMode = mode; }
+        BlitMode GetBlitMode() const { return blitMode; }
+
+        /** Selects whether images entirely inside the clip rectangle are drawn with the
+          * blitters specialized for their size in render/blitter.h, when there is one.
+          * Images that are partially clipped are always drawn according to the BlitMode.
+          */
+        void SetFixedBlitters(bool enable) { fixedBlitters = enable; }
+        bool GetFixedBlitters() const { return fixedBlitters; }
+
+        /** Selects whether DrawString draws strings from the TextCache with a single blit,
+          * or draws each character directly. Strings drawn between BeginBands and EndBands
+          * are always drawn directly, as cached images may be reused before EndBands.
+          */
+        void SetTextCache(bool enable) { textCaching = enable; }
+        bool GetTextCache() const { return textCaching; }
+        const TextCache::Statistics& GetTextCacheStatistics() const { return textCache.GetStatistics(); }
+        void ClearTextCacheStatistics() { textCache.ClearStatistics(); }
+
+        /** Sets the height of the horizontal bands used by BeginBands.
+          * Pass 0 to make BeginBands and EndBands do nothing, so everything is drawn directly.
+          */
+        void SetBandHeight(int height) { bandHeight = height; }
+        int GetBandHeight() const { return bandHeight; }
+
+        /** Starts collecting calls to DrawImage, DrawRect and DrawPixel instead of drawing
+          * them immediately. Each call is binned into the bands of the screen it covers.
+          * The images passed in must stay valid until EndBands is called.
+          */
+        void BeginBands();
+
+        /** Draws the collected calls one band at a time, in the order they were made,
+          * so each band of the frame buffer stays in the cache while it is being drawn.
+          * The bands are shared between the cores of the WorkerPool.
+          */
+        void EndBands();
+
         bool Initialize();
 
         void DrawImage(const Vector<s16>& at, const class Image& image);
@@ -70,6 +122,29 @@ namespace hfh3
         const Rect<s16>& GetClip() const { return clip; }
         void ClearClip();
 
+        /** Marks an area of the current frame as changed.
+          * Present strategies that copy frames only copy the areas marked since the
+          * previous frame to the screen, so anything drawn outside them is not shown.
+          */
+        void MarkDirty(const Rect<s16>& rect);
+        void MarkAllDirty() { MarkDirty(GetScreenRect()); }
+
+        /** Returns the number of frames an area has to be drawn again after it changes
+          * for the change to reach every buffer that can be shown. This is 2 with page
+          * flipping, as the other frame still has the old content.
+          */
+        int GetBufferCount() const { return strategy ? strategy->GetBufferCount() : 1; }
+
+        /** Selects how frames get to the display, from the strategies in the order
+          * listed in render/presentstrategy.h that are available in this build.
+          * The switch happens immediately, keeping the last frame shown on screen,
+          * so it must be called before anything is drawn to the next frame.
+          */
+        void SetPresentStrategy(int index);
+        int GetPresentStrategy() const { return strategyIndex; }
+        int GetPresentStrategyCount() const { return strategies.Size(); }
+        const char* GetPresentStrategyName(int index) const { return strategies[index]->GetName(); }
+
         /** Present the working image buffer
           * Use this to show the current frame after rendering.
           */
@@ -89,10 +164,17 @@ namespace hfh3
 
         /** Return the amount of CPU time spent copying the current frame to
           * the GPU in percent of frame time.
-          * If CONFIG_GPU_PAGE_FLIPPING is 1 this will be zero as
+          * With page flipping this will be close to zero as
           * no extra copying is done. */
         unsigned GetFlipTimePCT();
 
+        /** Return the number of bytes copied to the frame buffer for the previous frame.
+          * With page flipping this will be zero. */
+        unsigned GetPresentBytes() { return prev.presentBytes; }
+
+        /** Return the time spent in DrawString during the previous frame in microseconds. */
+        unsigned GetTextTimeUS();
+
         /** Clears the timers and the frame coutner*/
         void ClearTimers();
 
@@ -100,15 +182,26 @@ namespace hfh3
           * last reset and the values in the passed in references. */
         unsigned GetTimers(Timer& outSum);
 
+        /** Return the timers of the previous frame. */
+        const Timer& GetLastFrameTimer() const { return prev; }
+
 
         /** Return the number of frames missed due to too much time spent between
           * calls to Present
           */
         unsigned GetMissedFrames() 
         { 
-          return vsync.GetMissed(); 
+          return strategy ? strategy->GetMissedFrames() : vsync.GetMissed(); 
         }
 
+        /** Return the number of finished frames waiting to be shown after the previous
+          * frame. This can only be non-zero with triple buffering. */
+        unsigned GetQueueDepth() { return prev.queueDepth; }
+
+        /** Return the time from finishing a frame until it was shown, for the last frame
+          * shown, in microseconds. */
+        unsigned GetLatencyUS();
+
     private:
         static const unsigned fbWidth = 640;
         static const unsigned fbHeight = 400;
@@ -116,16 +209,8 @@ namespace hfh3
         // Defined in the header to inline it.
         u8* GetPixelAddress(int x, int y, frame_t frame = ACTIVE)
         {
-#if CONFIG_GPU_PAGE_FLIPPING
-            // The frame buffer is twice as tall as the visible area.
-            // Offset the y coordinate based on the currently active
-            // frame.
-            int frame_offset = size.y * (frame == ACTIVE ? active : ((active + 1) % 2));
-            return &bufferAddress[x + (y+frame_offset)*stride];
-#else
-            u8* buffer = (frame == ACTIVE ? renderBuffer : bufferAddress);
+            u8* buffer = (frame == ACTIVE ? activeBuffer : visibleBuffer);
             return &buffer[x + y*stride];
-#endif
         }
 
         u8* GetPixelAddress(const Vector<s16>& at, frame_t frame = ACTIVE)
@@ -133,22 +218,44 @@ namespace hfh3
             return GetPixelAddress(at.x, at.y, frame);
         }
 
-#if CONFIG_GPU_PAGE_FLIPPING
-        /** Implements swapping of the active and visible frame.
-          * Called by Present()
+        /** Draws the opaque spans of an image that fall inside the clipped rectangle.
+          * The rectangle is in screen coordinates.
           */
-        void Flip();
-#else
-        /** Presents the render buffer by copying the contents to
-          * the frame buffer
+        void DrawImageSpans(const Vector<s16>& at, const class Image& image, const Rect<s16>& clipped);
+
+        /** Draws the part of an image inside the clipped rectangle, which must be valid
+          * and inside the image. Does not touch any member state, so it can be called
+          * for different bands at the same time.
           */
-        void CopyFrameData();
-#endif
+        void DrawImageClipped(const Vector<s16>& at, const class Image& image, const Rect<s16>& clipped);
 
-        /** Used by Present() to ensure the game is in sync with
-          * the screen frame rate.
+        /** Fills a rectangle that has already been clipped to the screen.
           */
-        void WaitForVerticalSync();
+        void FillRect(const Rect<s16>& clipped, u8 color);
+
+        // A draw call collected between BeginBands and EndBands
+        struct DrawOp
+        {
+            enum Type : u8
+            {
+                DrawImageOp,
+                DrawRectOp,
+                DrawPixelOp,
+            };
+            const class Image* image;
+            Rect<s16> rect; // Position and size in screen coordinates, already clipped for Rect and Pixel
+            u8 color;
+            Type type;
+        };
+
+        /** Adds a draw call to the bands overlapping the rows passed in.
+          */
+        void BinDrawOp(const DrawOp& op, int top, int bottom);
+
+        /** Replays the draw calls binned into a band, clipped to the band.
+          * Called by EndBands on any of the cores of the worker pool.
+          */
+        void DrawBand(int band);
 
         /** Bookkeeping methods used to calculate the current FPS,
           * which should be equal to the physical screen update rate
@@ -158,18 +265,33 @@ namespace hfh3
         void UpdateStatsPostCopy();
 
         CBcmFrameBuffer	*framebuffer;
-#if CONFIG_DMA_FRAME_COPY
-        CDMAChannel dma;
-#endif
-#if CONFIG_GPU_PAGE_FLIPPING
-        int active; // Stores the currently active screen
-#else
-        u8* renderBuffer;
-#endif
-        u8* bufferAddress;
+        FrameBuffers buffers;
+        Array<PresentStrategy*> strategies;
+        PresentStrategy* strategy;
+        int strategyIndex;
+        u8* activeBuffer;  // The buffer frames are drawn to, from the strategy
+        u8* visibleBuffer; // The buffer with the last frame presented
         Vector<s16> size;
         int stride;
         Rect<s16> clip;
+        BlitMode blitMode;
+        bool fixedBlitters;
+        bool textCaching;
+        TextCache textCache;
+
+        // Areas marked by MarkDirty since the last Present. Overlapping areas are merged
+        // into their bounding rectangle, so no pixel is copied twice.
+        Array<Rect<s16>> dirtyRects;
+
+        // State for band rendering. The draw calls are sorted by band with a counting
+        // sort, so there are no per band lists to maintain.
+        int bandHeight;
+        bool binning;
+        Array<DrawOp> drawOps;
+        Array<int> entryBands; // The band of each entry
+        Array<int> entryOps;   // The index in drawOps of each entry
+        Array<int> sortedOps;  // The entries ordered by band
+        Array<int> bandStart;  // Index of the first sorted entry of each band, plus one past the last band
 
         unsigned frame;
         unsigned lastSync;
@@ -0,0 +1,145 @@
+#include "render/textcache.h"
+#include "render/font.h"
+#include "util/simd.h"
+
+#include <circle/util.h>
+
+using namespace hfh3;
+
+TextCache::Entry::Entry()
+    : hash(0)
+    , font(nullptr)
+    , color(0)
+    , lastUsed(0)
+    , pixels(nullptr)
+    , capacity(0)
+    , image(nullptr, 0, 0)
+{
+    text[0] = '\0';
+}
+
+TextCache::TextCache()
+    : useCounter(0)
+    , statistics({0, 0})
+{
+}
+
+TextCache::~TextCache()
+{
+    for (Entry& entry : entries)
+    {
+        delete[] entry.pixels;
+        entry.pixels = nullptr;
+    }
+}
+
+void TextCache::Clear()
+{
+    for (Entry& entry : entries)
+    {
+        entry.lastUsed = 0;
+    }
+}
+
+const Image* TextCache::Get(const char* string, u8 color, const Font& font)
+{
+    // FNV-1a hash of the string, so most entries can be rejected without comparing strings
+    u32 hash = 2166136261u;
+    int length = 0;
+    for (; string[length]; length++)
+    {
+        if (length == MAX_LENGTH)
+        {
+            return nullptr;
+        }
+        hash = (hash ^ u8(string[length])) * 16777619u;
+    }
+
+    Entry* victim = &entries[0];
+    for (Entry& entry : entries)
+    {
+        if (entry.lastUsed && entry.hash == hash && entry.color == color && entry.font == &font
+            && strcmp(entry.text, string) == 0)
+        {
+            statistics.hits++;
+            entry.lastUsed = ++useCounter;
+            return &entry.image;
+        }
+        if (entry.lastUsed < victim->lastUsed)
+        {
+            victim = &entry;
+        }
+    }
+
+    statistics.misses++;
+    memcpy(victim->text, string, length + 1);
+    victim->hash = hash;
+    victim->color = color;
+    victim->font = &font;
+    victim->lastUsed = ++useCounter;
+    Render(*victim, string, length);
+    return &victim->image;
+}
+
+void TextCache::Render(Entry& entry, const char* string, int length)
+{
+    const Font& font = *entry.font;
+    const int cellWidth = font.GetSize(' ').x;
+    const int cellHeight = font.GetHeight();
+
+    // Measure the longest line and the number of lines
+    int columns = 0;
+    int rows = 1;
+    for (int i = 0, column = 0; i < length; i++)
+    {
+        if (string[i] == '\n')
+        {
+            rows++;
+            column = 0;
+        }
+        else if (++column > columns)
+        {
+            columns = column;
+        }
+    }
+
+    const int width = columns * cellWidth;
+    const int height = rows * cellHeight;
+    if (entry.capacity < width * height)
+    {
+        delete[] entry.pixels;
+        entry.capacity = width * height;
+        entry.pixels = new u8[entry.capacity];
+    }
+
+    // Use any color other than the text color for the background
+    const u8 transparent = entry.color == 255 ? 0 : 255;
+    const u64 background = transparent * 0x0101010101010101ULL;
+    const u64 foreground = entry.color * 0x0101010101010101ULL;
+    Simd::Fill(entry.pixels, transparent, width * height);
+
+    u8* line = entry.pixels;
+    int x = 0;
+    for (int i = 0; i < length; i++)
+    {
+        if (string[i] == '\n')
+        {
+            line += width * cellHeight;
+            x = 0;
+            continue;
+        }
+
+        // Each row of a character is written as a single 8 byte store. The builtin
+        // is used as memcpy is not inlined when compiling with -ffreestanding.
+        u8* dst = line + x;
+        for (int y = 0; y < cellHeight; y++, dst += width)
+        {
+            u64 mask = font.GetRowMask(string[i], y);
+            u64 pixels = (foreground & mask) | (background & ~mask);
+            __builtin_memcpy(dst, &pixels, sizeof(pixels));
+        }
+        x += cellWidth;
+    }
+
+    entry.image = Image(entry.pixels, width, height, transparent, width);
+}
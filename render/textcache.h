@@ -0,0 +1,64 @@
+#pragma once
+#include <circle/types.h>
+#include "render/image.h"
+
+namespace hfh3
+{
+
+    /** A small cache of strings rendered into images with a transparent background.
+      * Drawing a string that has been drawn recently in the same color and font is
+      * then a single masked blit instead of one blit per character. When all entries
+      * are taken, the least recently used one is rendered over.
+      */
+    class TextCache
+    {
+    public:
+        static const int ENTRIES = 32;
+        static const int MAX_LENGTH = 95; // Longer strings are not cached
+
+        struct Statistics
+        {
+            unsigned hits;
+            unsigned misses;
+        };
+
+        TextCache();
+        ~TextCache();
+
+        /** Returns an image of the string drawn in a color, rendering it if it is not
+          * in the cache already. Lines are separated by '\n'. Returns nullptr if the
+          * string is too long to cache.
+          * The image is valid until the entry is reused by a later call to Get.
+          */
+        const Image* Get(const char* string, u8 color, const class Font& font);
+
+        /** Empties the cache, but keeps the memory of the entries for reuse. */
+        void Clear();
+
+        const Statistics& GetStatistics() const { return statistics; }
+        void ClearStatistics() { statistics = {0, 0}; }
+
+    private:
+        struct Entry
+        {
+            Entry();
+
+            char text[MAX_LENGTH + 1];
+            u32 hash;
+            const class Font* font;
+            u8 color;
+            unsigned lastUsed; // The value of useCounter when last returned. 0 if empty
+            u8* pixels;
+            int capacity;      // The number of bytes allocated for pixels
+            Image image;
+        };
+
+        /** Draws the string into the pixels of an entry and sets up its image.
+          */
+        void Render(Entry& entry, const char* string, int length);
+
+        Entry entries[ENTRIES];
+        unsigned useCounter;
+        Statistics statistics;
+    };
+}
@@ -11,6 +11,7 @@
 #include "render/font.h"
 #include "game/gameserver.h"
 #include "game/gameclient.h"
+#include "game/lockstepserver.h"
 #include "game/perftester.h"
 
 
@@ -53,7 +54,9 @@ void GameMenu::InitMenu()
     entries.Append();
     entries.Append("Multiplayer:",                   82, 0);
     entries.Append("Start Server",                   22, 0, [&](){StartHost(true);});
-    entries.Append("Connect to Server",              22, 0, [&](){StartClient();});
+    entries.Append("Connect to Server",              22, 0, [&](){StartClient(false);});
+    entries.Append("Start Lockstep Server",          22, 0, [&](){StartLockstepHost();});
+    entries.Append("Join Lockstep Server",           22, 0, [&](){StartClient(true);});
     entries.Append();
     entries.Append("Performance:",                   82, 0);
     entries.Append("Run Performance Test",           22, 0, [&](){StartPerfTest();});
@@ -74,7 +77,7 @@ void GameMenu::SetupAbortToMainMenu()
     abortAction = [&](){InitMenu();};
 }
 
-void GameMenu::StartClient()
+void GameMenu::StartClient(bool lockstep)
 {
     DEBUG("GameMenu::StartClient");
     spotter = new Spotter([=](){
@@ -89,7 +92,7 @@ void GameMenu::StartClient()
             ipv4_address_t address = host.GetIpAddress();
             entries.Append(host.GetIpString(), 22, 0, [=]()
             {
-                SelectServer(address);
+                SelectServer(address, lockstep);
             });
         }); 
         
@@ -152,7 +155,26 @@ void GameMenu::StartHost(bool multiplayer)
     });
 }
 
-void GameMenu::SelectServer(ipv4_address_t address)
+void GameMenu::StartLockstepHost()
+{
+    entries.Clear();
+    entries.Append("Waiting for lockstep peer...", 80, 0);
+    SelectFirst();
+
+    new Async([=]()
+    {
+        auto server = mainLoop.CreateClient<LockstepServer>(input, network);
+        server->SetDestructionHandler([=](){Resume(); InitMenu();});
+        {
+            Beacon beacon; // Announce our presence to the local network
+            server->Host(); // Wait for connection
+        }
+        server->LoadLevel();
+        Pause();
+    });
+}
+
+void GameMenu::SelectServer(ipv4_address_t address, bool lockstep)
 {
     if(spotter)
     {
@@ -166,10 +188,21 @@ void GameMenu::SelectServer(ipv4_address_t address)
 
     new Async([=]()
     {
-        auto client = mainLoop.CreateClient<GameClient>(input, network);
-        client->SetDestructionHandler([=](){Resume(); InitMenu();});
+        if(lockstep)
+        {
+            auto peer = mainLoop.CreateClient<LockstepServer>(input, network);
+            peer->SetDestructionHandler([=](){Resume(); InitMenu();});
 
-        client->Connect(address);
+            peer->Join(address);
+            peer->LoadLevel();
+        }
+        else
+        {
+            auto client = mainLoop.CreateClient<GameClient>(input, network);
+            client->SetDestructionHandler([=](){Resume(); InitMenu();});
+
+            client->Connect(address);
+        }
         Pause();
     });
 
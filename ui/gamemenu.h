@@ -16,11 +16,12 @@ namespace hfh3
     private:
         void InitMenu();
 
-        void StartClient();
+        void StartClient(bool lockstep);
         void StartHost(bool multiplayer);
+        void StartLockstepHost();
         void StartPerfTest();
 
-        void SelectServer(ipv4_address_t address);
+        void SelectServer(ipv4_address_t address, bool lockstep);
         void SetupAbortToMainMenu();
 
         class Spotter* spotter;
@@ -5,16 +5,29 @@
 #include "input/input.h"
 
 #include "render/font.h"
+#include "util/workerpool.h"
+#include "config.h"
 
 using namespace hfh3;
 
 
 MainLoop::MainLoop(ScreenManager& inScreen)
-    : frame(0)
-    , current({0,0,0})
-    , sum({0,0,0})
+    : tickRate(0)
+    , tickLength(0)
+    , lastClock(0)
+    , accumulated(0)
+    , tickFraction(TICK_FRACTION_ONE)
+    , frame(0)
+    , current({0,0,0,0,0,0,0,0})
+    , sum({0,0,0,0,0,0,0,0})
+    , activeClients(0)
+    , pipelined(CONFIG_PIPELINED_MAIN_LOOP)
+    , stageRunning(false)
     , screen(inScreen)
-{}
+{
+    SetTickRate(CONFIG_TICK_RATE);
+    updateStage = [this]() { UpdateStage(); };
+}
 
 MainLoop::~MainLoop()
 {
@@ -27,16 +40,42 @@ MainLoop::~MainLoop()
 
 void MainLoop::DestroyClient(IUpdatable* client)
 {
+    // The clients in the update stage may still be in use on the other core
+    if(stageRunning)
+    {
+        client->active = false;
+        client->destroyPending = true;
+        return;
+    }
+
     auto found = clients.FindFirst([=](IUpdatable* entry){ return client == entry; });
     assert(found);
     found.Remove();
     delete client;
 }
 
+void MainLoop::SetTickRate(unsigned ticksPerSecond)
+{
+    tickRate = ticksPerSecond;
+    tickLength = tickRate > 0 ? CLOCKHZ / tickRate : 0;
+    tickFraction = TICK_FRACTION_ONE;
+
+    // Start counting from now, so the time spent before does not have to be caught up
+    lastClock = CTimer::Get()->GetClockTicks();
+    accumulated = tickLength;
+}
+
 void MainLoop::Run()
 {
     while(true)
     {
+        if(pipelined)
+        {
+            RunPipelined();
+            continue;
+        }
+        current = {0,0,0,0,0,0,0,0};
+        current.ticks = AdvanceClock();
         Update();
         screen.WaitForScreenBufferReady();
         Render();
@@ -46,18 +85,140 @@ void MainLoop::Run()
 
 }
 
+void MainLoop::RunPipelined()
+{
+    CTimer *timer = CTimer::Get();
+    current = {0,0,0,0,0,0,0,0};
+    current.ticks = AdvanceClock();
+
+    // The stage works on its own list of clients, so clients can be created and
+    // destroyed on this core while it runs.
+    stageClients.ClearFast();
+    for(IUpdatable* client : clients)
+    {
+        if(client->active && client->pipelineUpdate)
+        {
+            stageClients.Append(client);
+        }
+    }
+
+    const unsigned stageStart = timer->GetClockTicks();
+    stageRunning = true;
+    if(!stageClients.IsEmpty())
+    {
+        WorkerPool::Instance().Start(updateStage);
+    }
+
+    Update();
+    screen.WaitForScreenBufferReady();
+    Render();
+    screen.Present();
+
+    const unsigned waitStart = timer->GetClockTicks();
+    WorkerPool::Instance().Wait();
+    stageRunning = false;
+    current.stageRender = waitStart - stageStart;
+    current.stageWait = timer->GetClockTicks() - waitStart;
+
+    // Hand the frame built by the stage over to be rendered next
+    for(IUpdatable* client : stageClients)
+    {
+        if(!client->destroyPending)
+        {
+            client->Swap();
+        }
+    }
+    DestroyPendingClients();
+    PostRender();
+}
+
+void MainLoop::UpdateStage()
+{
+    CTimer *timer = CTimer::Get();
+    const unsigned stageStart = timer->GetClockTicks();
+    for(unsigned tick = 0; tick < current.ticks; tick++)
+    {
+        for(IUpdatable* client : stageClients)
+        {
+            if(!client->destroyPending)
+            {
+                client->Update();
+            }
+        }
+    }
+    for(IUpdatable* client : stageClients)
+    {
+        if(!client->destroyPending)
+        {
+            client->PrepareFrame();
+        }
+    }
+    current.stageUpdate = timer->GetClockTicks() - stageStart;
+}
+
+void MainLoop::DestroyPendingClients()
+{
+    // Search from the start each time, as destructors may destroy other clients
+    while(auto found = clients.FindFirst([](IUpdatable* entry){ return entry->destroyPending; }))
+    {
+        IUpdatable* client = *found;
+        found.Remove();
+        delete client;
+    }
+}
+
+unsigned MainLoop::AdvanceClock()
+{
+    if(tickRate == 0)
+    {
+        return 1;
+    }
+
+    const unsigned now = CTimer::Get()->GetClockTicks();
+    accumulated += now - lastClock;
+    lastClock = now;
+
+    unsigned ticks = accumulated / tickLength;
+    accumulated -= ticks * tickLength;
+    if(ticks > CONFIG_MAX_CATCHUP_TICKS)
+    {
+        current.droppedTicks = ticks - CONFIG_MAX_CATCHUP_TICKS;
+        ticks = CONFIG_MAX_CATCHUP_TICKS;
+    }
+
+    tickFraction = accumulated * TICK_FRACTION_ONE / tickLength;
+    return ticks;
+}
+
 void MainLoop::Update()
 {
-    current = {0,0,0};
     CTimer *timer = CTimer::Get();
     const unsigned updateStart = timer->GetClockTicks();
+
+    // While the update stage runs, the pipelined clients are left to it
+    auto updatesHere = [this](IUpdatable* client)
+    {
+        return client->active && !(stageRunning && client->pipelineUpdate);
+    };
+
+    for(unsigned tick = 0; tick < current.ticks; tick++)
+    {
+        for(IUpdatable* client : clients)
+        {
+            if(updatesHere(client))
+            {
+                screen.SetClip(client->GetBounds());
+                client->Update();
+                screen.ClearClip();
+            }
+        }
+    }
     for(IUpdatable* client : clients)
     {
-        if(client->active)
+        if(updatesHere(client))
         {
-            screen.SetClip(client->GetBounds());
-            client->Update();
-            screen.ClearClip();
+            client->PrepareFrame();
+            client->Swap();
         }
     }
     current.update = timer->GetClockTicks() - updateStart;
@@ -67,13 +228,38 @@ void MainLoop::Render()
 {
     CTimer *timer = CTimer::Get();
     const unsigned renderStart = timer->GetClockTicks();
+
+    // When clients come and go, what they drew may be left on the screen, so redraw everything.
+    uintptr signature = 0;
+    for(IUpdatable* client : clients)
+    {
+        if(client->active)
+        {
+            signature = signature * 31 + reinterpret_cast<uintptr>(client);
+        }
+    }
+    if(signature != activeClients)
+    {
+        activeClients = signature;
+        screen.MarkAllDirty();
+        for(IUpdatable* client : clients)
+        {
+            client->Invalidate();
+        }
+    }
+
     for(IUpdatable* client : clients)
     {
         if(client->active)
         {
-            screen.SetClip(client->GetBounds());
+            Rect<s16> bounds = client->GetBounds();
+            screen.SetClip(bounds);
             client->Render();
             screen.ClearClip();
+            if(!client->tracksDirtyRegions)
+            {
+                screen.MarkDirty(bounds);
+            }
         }
     }
     current.render = timer->GetClockTicks() - renderStart;
@@ -95,13 +281,23 @@ void MainLoop::PostRender()
     sum.update += current.update;
     sum.render += current.render;
     sum.postRender += current.postRender;
+    sum.ticks += current.ticks;
+    sum.droppedTicks += current.droppedTicks;
+    sum.stageUpdate += current.stageUpdate;
+    sum.stageRender += current.stageRender;
+    sum.stageWait += current.stageWait;
     frame++;
+
+    // Time spent waiting for the update stage delays the frame as much as work on this core
+    const ScreenManager::Timer& screenTimer = screen.GetLastFrameTimer();
+    governor.AddFrame(current.update + current.render + current.postRender + current.stageWait + screenTimer.presentTicks,
+                      screenTimer.ticksPerFrame, screen.GetMissedFrames());
 }
 
 void MainLoop::ClearTimers()
 {
     frame = 0;
-    sum = {0,0,0};
+    sum = {0,0,0,0,0,0,0,0};
 }
 
 unsigned MainLoop::GetTimers(Timer& outSum)
@@ -1,16 +1,22 @@
 #pragma once
 #include "render/screenmanager.h"
+#include "ui/qualitygovernor.h"
 #include "util/direction.h"
 #include "util/callback.h"
 #include "util/list.h"
+#include "util/array.h"
 #include "circle/types.h"
 #include "circle/net/ipaddress.h"
 
 namespace hfh3
 {
 
-    /** The main loop class calls Update on all main loop clients every frame
-      * and handles refreshing the screen.
+    /** The main loop class calls Update on all main loop clients for every simulation
+      * tick and Render for every displayed frame, and handles refreshing the screen.
+      * Ticks run at a fixed rate, so a frame may run several of them or none at all.
+      *
+      * In pipelined mode, the clients that set pipelineUpdate are updated for the next
+      * frame on another core of the WorkerPool while the current frame is rendered.
       */
     class MainLoop
     {
@@ -22,15 +28,19 @@ namespace hfh3
         void Run();
 
         /** IUpdatable should be implemented by all clients of MainLoop.
-          * MainLoop will loop through all of its clients each frame and calls Update() on them.
+          * MainLoop will loop through all of its clients each tick and calls Update() on them,
+          * and calls Render() and PostRender() on them each frame.
           */
         class IUpdatable
         {
         public:
             IUpdatable(MainLoop& inMainLoop) 
                 : active(true)
+                , tracksDirtyRegions(false)
+                , pipelineUpdate(false)
                 , mainLoop(inMainLoop)
                 , screen(mainLoop.GetScreenManager())
+                , destroyPending(false)
             {}
 
 
@@ -42,6 +52,12 @@ namespace hfh3
                 return screen.GetScreenRect();
             }
 
+            /** Called when the screen area of the client may have been drawn over,
+              * such as when other clients are created, destroyed, paused or resumed.
+              * Clients that set tracksDirtyRegions must draw all of their area again.
+              */
+            virtual void Invalidate() {}
+
             template<typename T>
             void SetDestructionHandler(T callable)
             {
@@ -61,20 +77,61 @@ namespace hfh3
             virtual void Render() {};
             virtual void PostRender() {};
 
+            /** Called once per frame after the ticks of the frame have been run, on the
+              * same core as Update. Clients drawing state that the ticks change build what
+              * Render draws here, once per frame however many ticks were run.
+              */
+            virtual void PrepareFrame() {};
+
+            /** Called before Render when neither Update nor Render is running, to hand
+              * what PrepareFrame built over to Render.
+              */
+            virtual void Swap() {};
+
             volatile bool active;
 
+            /** Set by clients that only draw what has changed and mark it with
+              * ScreenManager::MarkDirty themselves. For all other clients, MainLoop
+              * marks their whole bounds dirty after Render.
+              * Their bounds must not overlap clients drawn before them that redraw every frame.
+              */
+            bool tracksDirtyRegions;
+
+            /** Set by clients that can run Update and PrepareFrame on another core while
+              * Render runs. Their Update must only pass changes to what Render draws on
+              * through Swap, and must not use the screen or network sockets, which belong
+              * to the main core. Clients paused or resumed while the update stage runs
+              * take part from the next frame.
+              */
+            bool pipelineUpdate;
+
             MainLoop& mainLoop;
             ScreenManager& screen;
             Callback<void()> destructionHandler;
             friend MainLoop;
+
+        private:
+            // Set when DestroyClient is called while the update stage is running
+            volatile bool destroyPending;
         };
 
         struct Timer {
           unsigned update;
           unsigned render;
           unsigned postRender;
+          unsigned ticks;        // Simulation ticks run
+          unsigned droppedTicks; // Ticks skipped as they exceeded CONFIG_MAX_CATCHUP_TICKS
+
+          // Only set in pipelined mode, where update and render only cover the clients
+          // updated on the main core.
+          unsigned stageUpdate;  // Update and PrepareFrame of the pipelined clients, on the other core
+          unsigned stageRender;  // From starting the update stage until waiting for it, on the main core
+          unsigned stageWait;    // Waiting for the update stage to finish
         };
 
+        // GetTickFraction returns fractions of a tick in units of 1/TICK_FRACTION_ONE.
+        static const unsigned TICK_FRACTION_ONE = 256;
+
 
         template<typename T, typename ...Args>
         T* CreateClient(Args&& ...args)
@@ -95,13 +152,62 @@ namespace hfh3
             return client;
         }
 
+        /** Destroys a client. While the update stage is running, the client is paused
+          * and destroyed once the stage has finished.
+          */
         void DestroyClient(IUpdatable* client);
 
+        /** Selects whether the update stage of the clients that set pipelineUpdate runs
+          * on another core, overlapped with rendering the previous frame. This shows what
+          * they draw one frame later. Takes effect from the next frame.
+          */
+        void SetPipelined(bool enable)
+        {
+            pipelined = enable;
+        }
+
+        bool IsPipelined() const
+        {
+            return pipelined;
+        }
+
         ScreenManager& GetScreenManager()
         {
             return screen;
         }
 
+        /** Sets the number of simulation ticks per second. 0 runs exactly one tick
+          * per displayed frame, however long it takes.
+          */
+        void SetTickRate(unsigned ticksPerSecond);
+
+        unsigned GetTickRate() const
+        {
+            return tickRate;
+        }
+
+        /** Returns how far the time of the frame being rendered is past the last tick,
+          * in units of 1/TICK_FRACTION_ONE of a tick. Clients draw moving objects at
+          * this fraction of the way from their state before the last tick to the state
+          * after it. Always TICK_FRACTION_ONE when the tick rate is 0.
+          */
+        unsigned GetTickFraction() const
+        {
+            return tickFraction;
+        }
+
+        QualityGovernor& GetGovernor()
+        {
+            return governor;
+        }
+
+        /** Returns how much optional work clients should do, as set by the governor.
+          */
+        const QualityGovernor::Quality& GetQuality() const
+        {
+            return governor.GetQuality();
+        }
+
         /** Clears the timers and the frame coutner*/
         void ClearTimers();
 
@@ -111,12 +217,44 @@ namespace hfh3
 
     private:
 
+        /** Returns the number of ticks to run for the current frame based on the
+          * time elapsed since the previous one, and updates the tick fraction.
+          */
+        unsigned AdvanceClock();
+
         void Update();
         void Render();
         void PostRender();
 
+        /** Runs one frame in pipelined mode. The update stage for the next frame is
+          * started on another core, then the other clients are updated and the current
+          * frame is rendered and presented on this core before joining the stage.
+          */
+        void RunPipelined();
+
+        // Runs the ticks and PrepareFrame of the clients in stageClients
+        void UpdateStage();
+
+        // Deletes the clients destroyed while the update stage was running
+        void DestroyPendingClients();
+
+        unsigned tickRate;
+        unsigned tickLength;  // Clock ticks per simulation tick
+        unsigned lastClock;   // Clock ticks when AdvanceClock last ran
+        unsigned accumulated; // Clock ticks elapsed that no simulation tick has been run for yet
+        unsigned tickFraction;
+
         unsigned frame;
         Timer current, sum;
+        QualityGovernor governor;
+
+        // Identifies the set of active clients drawn in the previous frame
+        uintptr activeClients;
+
+        bool pipelined;
+        bool stageRunning;
+        Array<IUpdatable*> stageClients; // The clients updated by the running update stage
+        Callback<void()> updateStage;
 
         List<IUpdatable*> clients;
         ScreenManager& screen;
@@ -17,8 +17,16 @@ MiniMap::MiniMap(MainLoop& mainLoop, const Vector<s16>& worldSize, s16 scaleDown
     , size(worldSize / scale)
     , pixels(new u8[size.x*size.y])
     , image(pixels, size.x, size.y, 255, size.x)
+    , textRedraw(0)
+    , mapRedraw(0)
+    , textChanged(false)
+    , mapChanged(false)
+    , textIdle(0)
+    , mapIdle(0)
 {
+    tracksDirtyRegions = true;
     Clear();
+    Invalidate();
 }
 
 MiniMap::~MiniMap()
@@ -29,6 +37,12 @@ MiniMap::~MiniMap()
 void MiniMap::Clear(u8 color)
 {
     memset(pixels, color, size.x*size.y);
+    mapRedraw = screen.GetBufferCount();
+}
+
+void MiniMap::Invalidate()
+{
+    textRedraw = mapRedraw = screen.GetBufferCount();
 }
 
 void MiniMap::Update()
@@ -36,12 +50,59 @@ void MiniMap::Update()
 }
 
 void MiniMap::Render()
+{
+    // The text is above the map, which is in the lower right corner of the screen.
+    Rect<s16> bounds = GetBounds();
+    Vector<s16> pos = screen.GetSize()-size;
+    const QualityGovernor::Quality& quality = mainLoop.GetQuality();
+
+    // Under load, redrawing changes only starts every few frames. Once started, it
+    // continues in the following frames until the change has reached all buffers.
+    textIdle++;
+    mapIdle++;
+    if (textChanged && textIdle >= quality.hudInterval)
+    {
+        textChanged = false;
+        textIdle = 0;
+        textRedraw = screen.GetBufferCount();
+    }
+
+    for (int i = 0; i<2; i++)
+    {
+        if (player_position[i]/scale != shownPosition[i])
+        {
+            mapChanged = true;
+        }
+    }
+    if (mapChanged && mapIdle >= quality.minimapInterval)
+    {
+        mapChanged = false;
+        mapIdle = 0;
+        for (int i = 0; i<2; i++)
+        {
+            shownPosition[i] = player_position[i]/scale;
+        }
+        mapRedraw = screen.GetBufferCount();
+    }
+
+    if (textRedraw > 0)
+    {
+        textRedraw--;
+        RenderText(Rect<s16>(bounds.origin, Vector<s16>(size.x, pos.y - bounds.Top())));
+    }
+    if (mapRedraw > 0)
+    {
+        mapRedraw--;
+        RenderMap(pos);
+    }
+}
+
+void MiniMap::RenderText(const Rect<s16>& area)
 {
     CString tmp;
-    Vector<s16> screenSize = screen.GetSize();
-    Vector<s16> pos = screenSize-size;
-    Vector<s16> linePos (pos.x+2, 12);
+    Vector<s16> linePos (area.Left()+2, area.Top()+2);
 
+    screen.SetClip(area);
     screen.Clear(2);
     for (int i = 0; i<2; i++)
     {
@@ -60,10 +121,18 @@ void MiniMap::Render()
         screen.DrawString(linePos, tmp, PLAYER_COLOR[i], Font::GetDefault());
         linePos.y += 20;
     }
+    screen.SetClip(GetBounds());
+    screen.MarkDirty(area);
+}
 
-    screen.DrawImage(pos, image);
-    screen.DrawPixel(pos + player_position[0]/scale, PLAYER_COLOR[0]);
-    screen.DrawPixel(pos + player_position[1]/scale, PLAYER_COLOR[1]);
+void MiniMap::RenderMap(const Vector<s16>& at)
+{
+    Rect<s16> area(at, size);
+    screen.DrawRect(area, 2);
+    screen.DrawImage(at, image);
+    screen.DrawPixel(at + shownPosition[0], PLAYER_COLOR[0]);
+    screen.DrawPixel(at + shownPosition[1], PLAYER_COLOR[1]);
+    screen.MarkDirty(area);
 }
 
 Rect<s16> MiniMap::GetBounds() const
@@ -74,7 +143,12 @@ Rect<s16> MiniMap::GetBounds() const
 
 void MiniMap::Plot(const Vector<u8>& grid_point, u8 color)
 {
-    pixels[grid_point.y*size.x + grid_point.x] = color;
+    u8& pixel = pixels[grid_point.y*size.x + grid_point.x];
+    if (pixel != color)
+    {
+        pixel = color;
+        mapChanged = true;
+    }
 }
 
 void MiniMap::SetPlayerPosition(u8 player, const Vector<s16>& position)
@@ -86,12 +160,19 @@ void MiniMap::SetPlayerPosition(u8 player, const Vector<s16>& position)
 void MiniMap::SetPlayerLives(u8 player, int lives)
 {
     assert(player < 2);
-    player_lives[player] = lives;
+    if (player_lives[player] != lives)
+    {
+        player_lives[player] = lives;
+        textChanged = true;
+    }
 }
 
 void MiniMap::SetPlayerScore(u8 player, int score)
 {
     assert(player < 2);
-    player_score[player] = score;
-
+    if (player_score[player] != score)
+    {
+        player_score[player] = score;
+        textChanged = true;
+    }
 }
@@ -16,6 +16,7 @@ namespace hfh3
         virtual ~MiniMap();
         
         virtual Rect<s16> GetBounds() const override;
+        virtual void Invalidate() override;
 
         void Clear(u8 color = 143);
         void Plot(const Vector<u8>& at, u8 color);
@@ -28,6 +29,9 @@ namespace hfh3
         virtual void Render() override;
     
     private:
+        void RenderText(const Rect<s16>& area);
+        void RenderMap(const Vector<s16>& at);
+
         s16 scale;
         Vector<s16> size;
         Vector<s16> player_position[2];
@@ -35,5 +39,16 @@ namespace hfh3
         int player_score[2];
         u8* pixels;
         Image image;
+
+        // Frames left to draw the text and the map for changes to reach all buffers.
+        int textRedraw;
+        int mapRedraw;
+
+        // Changes not drawn yet, and the frames since drawing them last started.
+        bool textChanged;
+        bool mapChanged;
+        int textIdle;
+        int mapIdle;
+        Vector<s16> shownPosition[2]; // Player positions on the map as last drawn
     };
 }
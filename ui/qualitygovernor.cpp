@@ -0,0 +1,118 @@
+#include "ui/qualitygovernor.h"
+#include "util/log.h"
+#include "config.h"
+
+#include <assert.h>
+
+using namespace hfh3;
+
+static const unsigned WINDOW_FRAMES = 30; // Number of frames the load is evaluated over
+static const unsigned HIGH_LOAD = 90;     // Percentage of the frame time to lower the quality above
+static const unsigned LOW_LOAD = 70;      // Percentage of the frame time to raise the quality below
+static const int CALM_WINDOWS = 4;        // Windows in a row under LOW_LOAD before raising the quality
+
+// The cheapest reductions to notice come first.
+static const QualityGovernor::Quality LEVELS[QualityGovernor::LEVEL_COUNT] =
+{
+    //stars  minimap  hud  explosions  spawn delay
+    { 100,    1,       1,   1,          1 },
+    { 100,    1,       4,   1,          1 },
+    { 100,    4,       4,   1,          1 },
+    {  50,    4,       8,   1,          1 },
+    {  50,    8,       8,   2,          1 },
+    {  25,    8,      15,   2,          2 },
+    {  25,   15,      30,   0,          2 },
+    {   0,   30,      30,   0,          4 },
+};
+
+const QualityGovernor::Quality QualityGovernor::FULL_QUALITY = LEVELS[0];
+
+QualityGovernor::QualityGovernor()
+    : enabled(CONFIG_QUALITY_GOVERNOR)
+    , level(0)
+    , frames(0)
+    , workTicks(0)
+    , frameTicks(0)
+    , missedStart(0)
+    , calmWindows(0)
+{
+}
+
+void QualityGovernor::SetEnabled(bool enable)
+{
+    if (!enable && level != 0)
+    {
+        INFO("Quality governor disabled, back to full quality");
+        level = 0;
+    }
+    enabled = enable;
+    frames = 0;
+    calmWindows = 0;
+}
+
+const QualityGovernor::Quality& QualityGovernor::GetQuality() const
+{
+    return LEVELS[level];
+}
+
+void QualityGovernor::AddFrame(unsigned inWorkTicks, unsigned inFrameTicks, unsigned missedFrames)
+{
+    if (!enabled)
+    {
+        return;
+    }
+
+    if (frames == 0)
+    {
+        workTicks = frameTicks = 0;
+        missedStart = missedFrames;
+    }
+    frames++;
+    workTicks += inWorkTicks;
+    frameTicks += inFrameTicks;
+    if (frames < WINDOW_FRAMES)
+    {
+        return;
+    }
+    frames = 0;
+
+    // A frame that missed its vertical sync took several periods, so the budget of
+    // each frame is the time between two vertical syncs rather than frameTicks.
+    // The missed frame count is cleared when switching present strategies.
+    unsigned missed = missedFrames >= missedStart ? missedFrames - missedStart : 0;
+    unsigned budget = frameTicks / (WINDOW_FRAMES + missed) * WINDOW_FRAMES;
+    if (budget == 0)
+    {
+        return;
+    }
+    unsigned load = workTicks / (budget / 100 + 1);
+
+    if ((missed > 0 || load > HIGH_LOAD) && level < LEVEL_COUNT - 1)
+    {
+        calmWindows = 0;
+        SetLevel(level + 1, load, missed);
+    }
+    else if (load < LOW_LOAD && missed == 0 && level > 0)
+    {
+        if (++calmWindows >= CALM_WINDOWS)
+        {
+            calmWindows = 0;
+            SetLevel(level - 1, load, missed);
+        }
+    }
+    else
+    {
+        calmWindows = 0;
+    }
+}
+
+void QualityGovernor::SetLevel(int newLevel, unsigned load, unsigned missed)
+{
+    assert(newLevel >= 0 && newLevel < LEVEL_COUNT);
+    const Quality& quality = LEVELS[newLevel];
+    INFO("Quality level %d -> %d (load %u%%, %u missed): stars %d%%, minimap every %d, text every %d, explosions 1/%d, spawn delay x%d",
+        level, newLevel, load, missed,
+        quality.starDensity, quality.minimapInterval, quality.hudInterval,
+        quality.explosionInterval, quality.spawnDelayScale);
+    level = newLevel;
+}
@@ -0,0 +1,63 @@
+#pragma once
+#include <circle/types.h>
+
+namespace hfh3
+{
+
+    /** Keeps the work of each frame within the time between vertical syncs by scaling
+      * down optional work, one step at a time, before frames start being missed.
+      * MainLoop feeds it the time spent on every frame and owns the current settings,
+      * which the clients doing the optional work check.
+      *
+      * The load is evaluated over windows of frames. A window over the high mark or
+      * with missed frames lowers the quality a step right away, while it is only raised
+      * again after several windows in a row under the low mark. The gap between the
+      * marks keeps it from switching back and forth. Every change is logged.
+      */
+    class QualityGovernor
+    {
+    public:
+        /** The amount of optional work to do. */
+        struct Quality
+        {
+            int starDensity;       // Percentage of the stars drawn in the star field
+            int minimapInterval;   // Start redrawing the mini map at most every this many frames
+            int hudInterval;       // Start redrawing changed text at most every this many frames
+            int explosionInterval; // Spawn one of every this many effect explosions, none if 0
+            int spawnDelayScale;   // Multiplies the delay between enemy spawns from bases
+        };
+
+        // Level 0 does all of the work, each level after it less.
+        static const int LEVEL_COUNT = 8;
+
+        static const Quality FULL_QUALITY;
+
+        QualityGovernor();
+
+        /** When disabled, the quality is reset to full and stays there. */
+        void SetEnabled(bool enable);
+        bool IsEnabled() const { return enabled; }
+
+        int GetLevel() const { return level; }
+        const Quality& GetQuality() const;
+
+        /** Called once per frame with the clock ticks spent on it, the clock ticks
+          * from its vertical sync to the previous one and the running count of
+          * missed frames.
+          */
+        void AddFrame(unsigned workTicks, unsigned frameTicks, unsigned missedFrames);
+
+    private:
+        void SetLevel(int newLevel, unsigned load, unsigned missed);
+
+        bool enabled;
+        int level;
+
+        // Sums over the current window
+        unsigned frames;
+        unsigned workTicks;
+        unsigned frameTicks;
+        unsigned missedStart; // The missed frame count at the start of the window
+        int calmWindows;      // Windows in a row under the low mark
+    };
+}
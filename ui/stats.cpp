@@ -11,7 +11,11 @@ using namespace hfh3;
 
 Stats::Stats(MainLoop& mainLoop)
     : MainLoop::IUpdatable(mainLoop)
+    , redrawFrames(0)
+    , idleFrames(0)
 {
+    tracksDirtyRegions = true;
+    Invalidate();
 }
 
 Stats::~Stats()
@@ -24,17 +28,51 @@ void Stats::Update()
 }
 
 void Stats::Render()
+{
+    // Under load, the message is only updated every few frames. A change that is
+    // being drawn is still drawn to all buffers in the following frames.
+    if (++idleFrames >= mainLoop.GetQuality().hudInterval)
+    {
+        idleFrames = 0;
+        Format();
+    }
+    if (redrawFrames == 0)
+    {
+        return;
+    }
+    redrawFrames--;
+
+    screen.Clear(10);
+    screen.DrawString({1,1}, shown, 0, Font::GetDefault());
+    screen.MarkDirty(GetBounds());
+}
+
+void Stats::Format()
 {
     CString message;
-    message.Format("FPS: %u. Missed: %d. Render:%3u%% Copy:%3u%%",
+    // Short labels, so all of it fits in the 80 columns of the screen
+    message.Format("FPS:%u Miss:%d Render:%3u%% Copy:%3u%% %3uK Text:%4uus Q:%u Lat:%2ums %s",
         screen.GetFPS(),
         screen.GetMissedFrames(),
         screen.GetGameTimePCT(),
-        screen.GetFlipTimePCT()
+        screen.GetFlipTimePCT(),
+        screen.GetPresentBytes() / 1024,
+        screen.GetTextTimeUS(),
+        screen.GetQueueDepth(),
+        (screen.GetLatencyUS() + 500) / 1000,
+        screen.GetPresentStrategyName(screen.GetPresentStrategy())
     );
 
-    screen.Clear(10);
-    screen.DrawString({1,1}, message, 0, Font::GetDefault());
+    if (message.Compare(shown) != 0)
+    {
+        shown = message;
+        redrawFrames = screen.GetBufferCount();
+    }
+}
+
+void Stats::Invalidate()
+{
+    redrawFrames = screen.GetBufferCount();
 }
 
 Rect<s16> Stats::GetBounds() const
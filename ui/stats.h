@@ -1,5 +1,6 @@
 #pragma once
 #include "ui/mainloop.h"
+#include <circle/string.h>
 
 namespace hfh3
 {
@@ -16,9 +17,15 @@ namespace hfh3
         virtual void Update() override;
         virtual void Render() override;
         virtual Rect<s16> GetBounds() const override;
+        virtual void Invalidate() override;
     
     private:
+        // Formats the message, and starts drawing it if it has changed.
+        void Format();
 
+        CString shown;    // The message currently on screen
+        int redrawFrames; // Frames left to draw the message for it to reach all buffers
+        int idleFrames;   // Frames since the message was last formatted
 
     };
 }
@@ -0,0 +1,49 @@
+#include "util/arena.h"
+
+#include <circle/alloc.h>
+#include <assert.h>
+
+using namespace hfh3;
+
+Arena::Arena(int inBlockSize)
+    : blockSize(inBlockSize)
+    , currentBlock(-1)
+    , offset(inBlockSize)
+{
+    assert(blockSize % alignment == 0);
+}
+
+Arena::~Arena()
+{
+    for(u8* block : blocks)
+    {
+        free(block);
+    }
+}
+
+void* Arena::Allocate(int size)
+{
+    size = (size + alignment - 1) & ~(alignment - 1);
+    assert(size <= blockSize);
+
+    if(offset + size > blockSize)
+    {
+        // Move on to the next block, only going to the heap if all blocks allocated so far are in use
+        currentBlock++;
+        if(currentBlock == blocks.Size())
+        {
+            blocks.Append(static_cast<u8*>(malloc(blockSize)));
+        }
+        offset = 0;
+    }
+
+    void* result = blocks[currentBlock] + offset;
+    offset += size;
+    return result;
+}
+
+void Arena::Reset()
+{
+    currentBlock = -1;
+    offset = blockSize;
+}
@@ -0,0 +1,50 @@
+#pragma once
+#include <circle/types.h>
+
+#include "util/array.h"
+
+namespace hfh3
+{
+    /** Bump allocator handing out memory from a list of fixed size blocks.
+      * Memory is never returned to the arena piece by piece. Instead Reset
+      * rewinds it to the start of the first block in constant time, keeping
+      * the blocks around so later allocations don't have to go to the heap again.
+      */
+    class Arena
+    {
+    public:
+        static const int alignment = 8;
+
+        Arena(int inBlockSize);
+        ~Arena();
+
+        /** Returns size bytes of memory, aligned to the arena alignment.
+          * The size may not exceed the block size.
+          */
+        void* Allocate(int size);
+
+        /** Makes all memory handed out by the arena available again.
+          * Any objects still living in the arena must not be used after this.
+          */
+        void Reset();
+
+        /** The number of blocks that have been allocated from the heap
+          * during the lifetime of the arena.
+          */
+        unsigned GetBlockAllocations() const
+        {
+            return blocks.Size();
+        }
+
+        int GetBlockSize() const
+        {
+            return blockSize;
+        }
+
+    private:
+        const int blockSize;
+        Array<u8*> blocks;
+        int currentBlock;
+        int offset;
+    };
+}
@@ -55,6 +55,21 @@ namespace hfh3
             count = 0;
         }
 
+        /** Exchanges the contents of two arrays without copying any elements.
+          */
+        void Swap(Array<T>& other)
+        {
+            T* otherData = other.data;
+            int otherReserved = other.reserved;
+            int otherCount = other.count;
+            other.data = data;
+            other.reserved = reserved;
+            other.count = count;
+            data = otherData;
+            reserved = otherReserved;
+            count = otherCount;
+        }
+
         /** Ensure the underlying array can hold at least num items
           * If the array is already larger than num, it will use the array count instead.
           */
@@ -136,15 +151,29 @@ namespace hfh3
             new (&data[count]) T();
         }
 
-        Iterator AppendRaw(const T* src, int num)
+        /** Increases the size of the array by num elements and returns a pointer
+          * to the first new element. The new elements are left uninitialized, so
+          * this should only be used for plain data types.
+          * The returned pointer is only valid until the array is resized again.
+          */
+        T* Grow(int num)
         {
-            int old_count = count;
-            count += num;
-            if(reserved < count)
+            int new_count = count + num;
+            if(reserved < new_count)
             {
-                Reserve(count>=MIN_RESERVE ? count : MIN_RESERVE);
+                // Grow the reserved space geometrically so repeated calls
+                // are amortized constant time.
+                int doubled = reserved>=MIN_RESERVE ? reserved*2 : MIN_RESERVE;
+                Reserve(new_count > doubled ? new_count : doubled);
             }
-            T* dest = &data[old_count];
+            T* dest = &data[count];
+            count = new_count;
+            return dest;
+        }
+
+        Iterator AppendRaw(const T* src, int num)
+        {
+            T* dest = Grow(num);
             memcpy(dest, src, num*sizeof(T));
             return Iterator(dest);
         }
@@ -1,87 +1,235 @@
 #pragma once
+#include <circle/types.h>
+
+#include "util/new.h"
+#include "config.h"
+#include <type_traits>
 
 namespace hfh3
 {
-    /** A partial replacement of std::function<...> as we don't have access to the STL 
+    /** A partial replacement of std::function<...> as we don't have access to the STL
       * on a barebone environment.
-      * This implementation is a simplified version of the GCC standard library's 
+      * This implementation is a simplified version of the GCC standard library's
       * implementation of std::function.
       * (https://gcc.gnu.org/svn/gcc/trunk/libstdc++-v3/include/std/functional?p=268513)
+      *
+      * Functors of up to InlineSize bytes are stored inside the callback object itself,
+      * so assigning a lambda with a small capture does not allocate any memory.
+      * Larger functors are copied to the heap.
       */
-    template<typename>
+    template<typename, int InlineSize = CONFIG_CALLBACK_INLINE_SIZE>
     class Callback;
 
     /** The actual implementation is specified as a partial template specialization, so
       * callbacks can be declared as Callback<return_type(arg1_type, arg2_type, ... etc)>
       */
-    template<typename Ret, typename ... Args>
-    class Callback<Ret(Args...)>
+    template<int InlineSize, typename Ret, typename ... Args>
+    class Callback<Ret(Args...), InlineSize>
     {
+        // Used to keep the functor constructor and assignment operator from
+        // being used when copying or moving other callbacks.
+        template<typename Functor>
+        using EnableIfFunctor = typename std::enable_if<
+            !std::is_same<typename std::decay<Functor>::type, Callback>::value>::type;
+
         public:
 
-        Callback() 
-            : wrapped(nullptr)
+        Callback()
+            : invoker(nullptr)
+            , manager(nullptr)
         {
         }
 
-        template<typename Functor>
-        Callback(Functor functor) 
-            : wrapped(new ConcreteWrapper<Functor>(functor))
+        Callback(const Callback& other)
+            : invoker(other.invoker)
+            , manager(other.manager)
+        {
+            if(manager)
+            {
+                manager(Copy, storage, const_cast<Storage&>(other.storage));
+            }
+        }
+
+        Callback(Callback&& other)
+            : invoker(other.invoker)
+            , manager(other.manager)
+        {
+            if(manager)
+            {
+                manager(Move, storage, other.storage);
+                other.invoker = nullptr;
+                other.manager = nullptr;
+            }
+        }
+
+        template<typename Functor, typename = EnableIfFunctor<Functor>>
+        Callback(Functor functor)
+            : invoker(nullptr)
+            , manager(nullptr)
         {
+            Assign(functor);
         }
 
         ~Callback()
         {
-            if(wrapped)
+            Reset();
+        }
+
+        Callback& operator=(const Callback& other)
+        {
+            if(this != &other)
             {
-                delete wrapped;
+                Callback copy(other);
+                *this = static_cast<Callback&&>(copy);
             }
+            return *this;
         }
 
-        template<typename Functor>
-        Callback& operator=(Functor functor)
+        Callback& operator=(Callback&& other)
         {
-            if(wrapped)
+            if(this != &other)
             {
-                delete wrapped;
+                Reset();
+                if(other.manager)
+                {
+                    invoker = other.invoker;
+                    manager = other.manager;
+                    manager(Move, storage, other.storage);
+                    other.invoker = nullptr;
+                    other.manager = nullptr;
+                }
             }
-            wrapped = new ConcreteWrapper<Functor>(functor);
+            return *this;
+        }
+
+        template<typename Functor, typename = EnableIfFunctor<Functor>>
+        Callback& operator=(Functor functor)
+        {
+            Reset();
+            Assign(functor);
             return *this;
         }
 
         Ret operator()(Args... args)
         {
-            return (*wrapped)(args...);
+            return invoker(storage, args...);
         }
 
-        operator bool() const 
+        operator bool() const
         {
-            return wrapped != nullptr;
+            return manager != nullptr;
+        }
+
+        /** Destroys the stored functor, leaving the callback empty.
+          */
+        void Reset()
+        {
+            if(manager)
+            {
+                manager(Destroy, storage, storage);
+                invoker = nullptr;
+                manager = nullptr;
+            }
+        }
+
+        /** Returns true if a functor of the given type will be stored without allocating memory.
+          */
+        template<typename Functor>
+        static constexpr bool IsStoredInline()
+        {
+            return sizeof(Functor) <= InlineSize && alignof(Functor) <= alignof(Storage);
         }
 
         private:
 
-        struct AbstractWrapper 
+        union Storage
+        {
+            void* heap;
+            u64 align;
+            unsigned char buffer[InlineSize > 0 ? InlineSize : 1];
+        };
+
+        enum Operation
         {
-            virtual Ret operator()(Args... args);
-            virtual ~AbstractWrapper() {}
+            Copy,    // Copy construct the functor in source to destination
+            Move,    // Move the functor in source to destination, leaving source empty
+            Destroy, // Destroy the functor in destination
         };
 
         template<typename Functor>
-        struct ConcreteWrapper : AbstractWrapper
+        static Functor* Get(Storage& storage)
         {
-            ConcreteWrapper(Functor inFunctor) 
-                : functor(inFunctor)
-            {}
+            if(IsStoredInline<Functor>())
+            {
+                return reinterpret_cast<Functor*>(storage.buffer);
+            }
+            return static_cast<Functor*>(storage.heap);
+        }
 
-            virtual Ret operator()(Args... args) override
+        template<typename Functor>
+        static Ret Invoke(Storage& storage, Args... args)
+        {
+            return (*Get<Functor>(storage))(args...);
+        }
+
+        template<typename Functor>
+        static void Manage(Operation operation, Storage& destination, Storage& source)
+        {
+            const bool storedInline = IsStoredInline<Functor>();
+            switch(operation)
             {
-                return functor(args...);
+            case Copy:
+                if(storedInline)
+                {
+                    new(destination.buffer) Functor(*Get<Functor>(source));
+                }
+                else
+                {
+                    destination.heap = new Functor(*Get<Functor>(source));
+                }
+                break;
+            case Move:
+                if(storedInline)
+                {
+                    new(destination.buffer) Functor(static_cast<Functor&&>(*Get<Functor>(source)));
+                    Get<Functor>(source)->~Functor();
+                }
+                else
+                {
+                    // Only the pointer has to be moved for heap allocated functors
+                    destination.heap = source.heap;
+                }
+                break;
+            case Destroy:
+                if(storedInline)
+                {
+                    Get<Functor>(destination)->~Functor();
+                }
+                else
+                {
+                    delete Get<Functor>(destination);
+                }
+                break;
             }
+        }
 
-            Functor functor;
-        };
+        template<typename Functor>
+        void Assign(Functor& functor)
+        {
+            if(IsStoredInline<Functor>())
+            {
+                new(storage.buffer) Functor(static_cast<Functor&&>(functor));
+            }
+            else
+            {
+                storage.heap = new Functor(static_cast<Functor&&>(functor));
+            }
+            invoker = &Invoke<Functor>;
+            manager = &Manage<Functor>;
+        }
 
-        AbstractWrapper* wrapped;
+        Storage storage;
+        Ret (*invoker)(Storage& storage, Args... args);
+        void (*manager)(Operation operation, Storage& destination, Storage& source);
     };
 }
\ No newline at end of file
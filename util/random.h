@@ -23,6 +23,14 @@ namespace hfh3
         }
 
         void Reset(u64 inSeed);
+
+        /** Returns the current state of the generator. Passing it to Reset
+          * on another instance makes it generate the same sequence.
+          */
+        u64 GetSeed() const
+        {
+            return seed;
+        }
     private:
         u64 seed;
         static const u64 multiplier = 0x5deece66d;
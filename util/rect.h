@@ -156,6 +156,28 @@ namespace hfh3
             return (*this = (*this & other));
         }
 
+        /** Returns the smallest rectangle containing both rectangles.
+          * Invalid rectangles are ignored.
+          */
+        Rect<T> operator|(const Rect<T>& other) const
+        {
+            if (!IsValid())
+            {
+                return other;
+            }
+            if (!other.IsValid())
+            {
+                return *this;
+            }
+            return FromCorners(Min(origin, other.origin), Max(Extent(), other.Extent()));
+        }
+
+        /** Mutating version of the union operator above */
+        Rect<T>& operator|=(const Rect<T>& other)
+        {
+            return (*this = (*this | other));
+        }
+
         /** Returns a new rect extended by N on each edge, moving the origin by
           * N units up and left and the bottom edge by the same amount in the
           * opposite direction.
@@ -135,5 +135,31 @@ namespace hfh3
         Serialize(serializer, value.size);
     }
 
+    /** Writes a native scalar value directly to a byte buffer using the same
+      * encoding as Serialize and returns a pointer to the byte following it.
+      * Use these instead of an ISerializer in code where the cost of the
+      * virtual calls matter.
+      */
+    template<typename T>
+    std::enable_if_t<std::is_arithmetic<T>::value || std::is_enum<T>::value, u8*>
+    Encode(u8* dest, T value)
+    {
+        value = SerialEndian(value);
+        memcpy(dest, &value, sizeof(T));
+        return dest + sizeof(T);
+    }
+
+    /** Reads a native scalar value from a byte buffer written by Encode and
+      * returns a pointer to the byte following it.
+      */
+    template<typename T>
+    std::enable_if_t<std::is_arithmetic<T>::value || std::is_enum<T>::value, const u8*>
+    Decode(const u8* src, T& value)
+    {
+        memcpy(&value, src, sizeof(T));
+        value = SerialEndian(value);
+        return src + sizeof(T);
+    }
+
 }
 
@@ -0,0 +1,292 @@
+#pragma once
+#include <circle/types.h>
+#include "config.h"
+
+// Select the vector instruction set from the target the code is compiled for, so the
+// same kernels are vectorized when building for a PC as well.
+#if CONFIG_SIMD_RENDER && defined(__ARM_NEON)
+#   include <arm_neon.h>
+#   define SIMD_NEON 1
+#elif CONFIG_SIMD_RENDER && defined(__AVX2__)
+#   include <immintrin.h>
+#   define SIMD_SSE2 1
+#   define SIMD_AVX2 1
+#elif CONFIG_SIMD_RENDER && defined(__SSE2__)
+#   include <emmintrin.h>
+#   define SIMD_SSE2 1
+#endif
+
+#if defined(SIMD_NEON) || defined(SIMD_SSE2)
+#   define SIMD_VECTOR 1
+#else
+#   define SIMD_VECTOR 0
+#endif
+
+namespace hfh3
+{
+    /** A small layer of byte vector operations and the render kernels built on them.
+      * The operations are implemented with NEON on ARM and with SSE2 or AVX2 on x86.
+      * If none of them is available, or CONFIG_SIMD_RENDER is 0, the kernels fall back
+      * to the scalar implementations in Simd::Scalar.
+      *
+      * Note that Circle does not save the vector registers when handling interrupts,
+      * so none of this may be used in interrupt handlers.
+      */
+    namespace Simd
+    {
+#if defined(SIMD_NEON)
+        static const char* const backendName = "neon";
+#elif defined(SIMD_AVX2)
+        static const char* const backendName = "avx2";
+#elif defined(SIMD_SSE2)
+        static const char* const backendName = "sse2";
+#else
+        static const char* const backendName = "scalar";
+#endif
+
+#if SIMD_VECTOR
+        /** Operations on 16 bytes at a time. Masks returned by Equal have all bits of
+          * a lane set where the comparison is true, and Select picks the lanes of
+          * a where the mask is set and of b elsewhere.
+          */
+        struct Lanes16
+        {
+            static const int width = 16;
+#   if defined(SIMD_NEON)
+            using Type = uint8x16_t;
+            static inline Type Load(const u8* p) { return vld1q_u8(p); }
+            static inline Type LoadAligned(const u8* p) { return vld1q_u8(static_cast<const u8*>(__builtin_assume_aligned(p, 16))); }
+            static inline void Store(u8* p, Type v) { vst1q_u8(p, v); }
+            static inline void StoreAligned(u8* p, Type v) { vst1q_u8(static_cast<u8*>(__builtin_assume_aligned(p, 16)), v); }
+            static inline Type Splat(u8 value) { return vmovq_n_u8(value); }
+            static inline Type Equal(Type a, Type b) { return vceqq_u8(a, b); }
+            static inline Type Select(Type mask, Type a, Type b) { return vbslq_u8(mask, a, b); }
+#   else
+            using Type = __m128i;
+            static inline Type Load(const u8* p) { return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p)); }
+            static inline Type LoadAligned(const u8* p) { return _mm_load_si128(reinterpret_cast<const __m128i*>(p)); }
+            static inline void Store(u8* p, Type v) { _mm_storeu_si128(reinterpret_cast<__m128i*>(p), v); }
+            static inline void StoreAligned(u8* p, Type v) { _mm_store_si128(reinterpret_cast<__m128i*>(p), v); }
+            static inline Type Splat(u8 value) { return _mm_set1_epi8(char(value)); }
+            static inline Type Equal(Type a, Type b) { return _mm_cmpeq_epi8(a, b); }
+            static inline Type Select(Type mask, Type a, Type b) { return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b)); }
+#   endif
+        };
+
+#   if defined(SIMD_AVX2)
+        /** The same operations as Lanes16 on 32 bytes at a time.
+          */
+        struct Lanes32
+        {
+            static const int width = 32;
+            using Type = __m256i;
+            static inline Type Load(const u8* p) { return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p)); }
+            static inline Type LoadAligned(const u8* p) { return _mm256_load_si256(reinterpret_cast<const __m256i*>(p)); }
+            static inline void Store(u8* p, Type v) { _mm256_storeu_si256(reinterpret_cast<__m256i*>(p), v); }
+            static inline void StoreAligned(u8* p, Type v) { _mm256_store_si256(reinterpret_cast<__m256i*>(p), v); }
+            static inline Type Splat(u8 value) { return _mm256_set1_epi8(char(value)); }
+            static inline Type Equal(Type a, Type b) { return _mm256_cmpeq_epi8(a, b); }
+            static inline Type Select(Type mask, Type a, Type b) { return _mm256_blendv_epi8(b, a, mask); }
+        };
+
+        // The widest vector available
+        using Wide = Lanes32;
+#   else
+        using Wide = Lanes16;
+#   endif
+#endif
+
+        /** Reference implementations of the kernels, one byte or word at a time.
+          * Used for rows shorter than a vector, and to compare against in benchmarks.
+          */
+        namespace Scalar
+        {
+            inline void Fill(u8* dst, u8 value, size_t length)
+            {
+                // Repeat value 8 times in a 64 bit unsigned integer.
+                u64 fill = value * 0x0101010101010101ULL;
+
+                // Set any initial unaligned bytes first
+                while ((reinterpret_cast<uintptr>(dst) & 0x7) && length)
+                {
+                    *dst++ = value;
+                    length--;
+                }
+
+                // Now write 8 bytes at a time
+                u64* aligned = reinterpret_cast<u64*>(dst);
+                for (; length >= 8; length -= 8)
+                {
+                    *aligned++ = fill;
+                }
+
+                // Set any remaining bytes
+                dst = reinterpret_cast<u8*>(aligned);
+                while (length--)
+                {
+                    *dst++ = value;
+                }
+            }
+
+            inline void Copy(u8* dst, const u8* src, size_t length)
+            {
+                while (length--)
+                {
+                    *dst++ = *src++;
+                }
+            }
+
+            inline void CopyMasked(u8* dst, const u8* src, size_t length, u8 transparent)
+            {
+                for (size_t i = 0; i < length; i++)
+                {
+                    if (src[i] != transparent)
+                    {
+                        dst[i] = src[i];
+                    }
+                }
+            }
+
+            inline void ExpandBits(u8* dst, u8 bits, int first, int count, u8 color)
+            {
+                for (int x = first; x < first + count; x++, dst++)
+                {
+                    if (bits & (0x80 >> x))
+                    {
+                        *dst = color;
+                    }
+                }
+            }
+
+            inline void Lookup(u8* dst, const u8* src, size_t length, const u8* table)
+            {
+                for (; length >= 4; length -= 4, dst += 4, src += 4)
+                {
+                    dst[0] = table[src[0]];
+                    dst[1] = table[src[1]];
+                    dst[2] = table[src[2]];
+                    dst[3] = table[src[3]];
+                }
+                while (length--)
+                {
+                    *dst++ = table[*src++];
+                }
+            }
+        }
+
+#if SIMD_VECTOR
+        /** Copies the pixels of whole vectors of src that are not transparent to dst.
+          * Returns the number of bytes handled.
+          */
+        template<typename Lanes>
+        inline size_t CopyMaskedVectors(u8* dst, const u8* src, size_t length, u8 transparent)
+        {
+            const typename Lanes::Type key = Lanes::Splat(transparent);
+            size_t i = 0;
+            for (; i + Lanes::width <= length; i += Lanes::width)
+            {
+                typename Lanes::Type source = Lanes::Load(&src[i]);
+                typename Lanes::Type mask = Lanes::Equal(source, key);
+                Lanes::Store(&dst[i], Lanes::Select(mask, Lanes::Load(&dst[i]), source));
+            }
+            return i;
+        }
+#endif
+
+        /** Sets length bytes of dst to value.
+          */
+        inline void Fill(u8* dst, u8 value, size_t length)
+        {
+#if SIMD_VECTOR
+            if (length >= size_t(Wide::width))
+            {
+                // Store a first unaligned vector and continue from the next aligned
+                // address. The last vector overlaps the ones before it, so there is
+                // no remainder to handle one byte at a time.
+                const Wide::Type fill = Wide::Splat(value);
+                u8* end = dst + length;
+                Wide::Store(dst, fill);
+                u8* aligned = reinterpret_cast<u8*>((reinterpret_cast<uintptr>(dst) + Wide::width) & ~uintptr(Wide::width - 1));
+                for (; aligned + Wide::width <= end; aligned += Wide::width)
+                {
+                    Wide::StoreAligned(aligned, fill);
+                }
+                Wide::Store(end - Wide::width, fill);
+                return;
+            }
+#endif
+            Scalar::Fill(dst, value, length);
+        }
+
+        /** Copies length bytes from src to dst. The ranges must not overlap.
+          */
+        inline void Copy(u8* dst, const u8* src, size_t length)
+        {
+#if SIMD_VECTOR
+            if (length >= size_t(Wide::width))
+            {
+                size_t i = 0;
+                for (; i + Wide::width <= length; i += Wide::width)
+                {
+                    Wide::Store(&dst[i], Wide::Load(&src[i]));
+                }
+                // The last vector overlaps the bytes already copied
+                Wide::Store(&dst[length - Wide::width], Wide::Load(&src[length - Wide::width]));
+                return;
+            }
+#endif
+            Scalar::Copy(dst, src, length);
+        }
+
+        /** Copies the bytes of src that are not equal to transparent to dst.
+          */
+        inline void CopyMasked(u8* dst, const u8* src, size_t length, u8 transparent)
+        {
+            size_t done = 0;
+#if SIMD_VECTOR
+#   if defined(SIMD_AVX2)
+            done = CopyMaskedVectors<Lanes32>(dst, src, length, transparent);
+#   endif
+            done += CopyMaskedVectors<Lanes16>(dst + done, src + done, length - done, transparent);
+            if (done < length && length >= size_t(Lanes16::width))
+            {
+                // Finish with a vector overlapping the bytes already done. Copying them
+                // again gives the same result, as transparent bytes are left as they are.
+                CopyMaskedVectors<Lanes16>(dst + length - Lanes16::width, src + length - Lanes16::width, Lanes16::width, transparent);
+                return;
+            }
+#endif
+            Scalar::CopyMasked(dst + done, src + done, length - done, transparent);
+        }
+
+        /** Sets the 8 bytes of dst to color where the corresponding bit of bits is set,
+          * starting with the most significant bit.
+          */
+        inline void ExpandBits(u8* dst, u8 bits, u8 color)
+        {
+#if defined(SIMD_NEON)
+            static const u8 masks[8] = { 0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01 };
+            uint8x8_t set = vtst_u8(vmov_n_u8(bits), vld1_u8(masks));
+            vst1_u8(dst, vbsl_u8(set, vmov_n_u8(color), vld1_u8(dst)));
+#elif defined(SIMD_SSE2)
+            const __m128i masks = _mm_setr_epi8(char(0x80), 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01, 0, 0, 0, 0, 0, 0, 0, 0);
+            __m128i set = _mm_cmpeq_epi8(_mm_and_si128(_mm_set1_epi8(char(bits)), masks), masks);
+            __m128i pixels = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(dst));
+            pixels = _mm_or_si128(_mm_and_si128(set, _mm_set1_epi8(char(color))), _mm_andnot_si128(set, pixels));
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(dst), pixels);
+#else
+            Scalar::ExpandBits(dst, bits, 0, 8, color);
+#endif
+        }
+
+        /** Replaces each byte of src with the entry of a 256 entry table, such as
+          * a palette, and writes the result to dst.
+          * None of the backends can look up bytes in a table this large in a single
+          * instruction, so this is the unrolled scalar version for all of them.
+          */
+        inline void Lookup(u8* dst, const u8* src, size_t length, const u8* table)
+        {
+            Scalar::Lookup(dst, src, length, table);
+        }
+    }
+}
@@ -0,0 +1,102 @@
+#pragma once
+#include <circle/types.h>
+
+#include "util/arena.h"
+#include <assert.h>
+
+namespace hfh3
+{
+    /** Allocator for objects of a single size.
+      * Freed objects are kept in a free list and reused by later allocations.
+      * When the free list is empty, new objects are carved out of chunks taken
+      * from an arena. Since the chunks belong to the arena, Reset only has to forget
+      * the free list and the current chunk, and all memory is reclaimed when the
+      * arena itself is reset.
+      */
+    class Slab
+    {
+    public:
+        static const int objectsPerChunk = 64;
+
+        Slab()
+            : objectSize(0)
+            , arena(nullptr)
+            , freeList(nullptr)
+            , next(nullptr)
+            , end(nullptr)
+            , allocations(0)
+            , frees(0)
+            , chunks(0)
+        {}
+
+        void Init(int inObjectSize, Arena* inArena)
+        {
+            assert(objectSize == 0);
+            // Freed objects have to be able to hold the link to the next free object
+            objectSize = (inObjectSize + Arena::alignment - 1) & ~(Arena::alignment - 1);
+            arena = inArena;
+            assert(objectSize * objectsPerChunk <= arena->GetBlockSize());
+        }
+
+        void* Allocate()
+        {
+            allocations++;
+            if(freeList)
+            {
+                FreeObject* result = freeList;
+                freeList = result->next;
+                return result;
+            }
+
+            if(next == end)
+            {
+                next = static_cast<u8*>(arena->Allocate(objectSize * objectsPerChunk));
+                end = next + objectSize * objectsPerChunk;
+                chunks++;
+            }
+            void* result = next;
+            next += objectSize;
+            return result;
+        }
+
+        void Free(void* memory)
+        {
+            frees++;
+            FreeObject* object = static_cast<FreeObject*>(memory);
+            object->next = freeList;
+            freeList = object;
+        }
+
+        /** Forgets about all objects allocated from the slab without touching them.
+          * Should be followed by a reset of the arena the slab is using.
+          */
+        void Reset()
+        {
+            freeList = nullptr;
+            next = end = nullptr;
+        }
+
+        int GetObjectSize() const { return objectSize; }
+
+        // Lifetime statistics
+        unsigned GetAllocations() const { return allocations; }
+        unsigned GetFrees() const { return frees; }
+        unsigned GetChunks() const { return chunks; }
+
+    private:
+        struct FreeObject
+        {
+            FreeObject* next;
+        };
+
+        int objectSize;
+        Arena* arena;
+        FreeObject* freeList;
+        u8* next; // Next unused object in the current chunk
+        u8* end;  // End of the current chunk
+
+        unsigned allocations;
+        unsigned frees;
+        unsigned chunks;
+    };
+}
@@ -3,6 +3,7 @@
 #include <circle/memio.h>
 #include <circle/sched/scheduler.h>
 #include <circle/synchronize.h>
+#include <circle/timer.h>
 
 #include "util/vsync.h"
 #include "util/log.h"
@@ -16,6 +17,8 @@ const uintptr  ARM_SMI_CS =(ARM_IO_BASE + 0x600000);
 VSync::VSync()
     : syncEvent(false)
     , missedFrames(0)
+    , count(0)
+    , ticks()
 {}
 
 bool VSync::Initialize()
@@ -54,6 +57,10 @@ void VSync::VsyncInt()
     // Clear the SMI interrupt status
     write32(ARM_SMI_CS, 0);
 
+    // Record the time before counting the interrupt, so it can be read as soon as the count changes
+    ticks[count % TICK_HISTORY] = CTimer::Get()->GetClockTicks();
+    count = count + 1;
+
     // Wake up the screen manager task if it's waiting
     #ifdef HFH3_PATCH // We need the patched version of Circle in order to detect whether a task was waiting
     if(!syncEvent.Set())
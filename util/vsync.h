@@ -36,6 +36,17 @@ namespace hfh3
           */
         unsigned GetMissed() { return missedFrames; }
 
+        /** Returns the number of vsync interrupts received since initialization.
+          */
+        unsigned GetCount() const { return count; }
+
+        /** Returns the time in clock ticks of a vsync interrupt, identified by the value
+          * GetCount() had just before it. Only the last TICK_HISTORY interrupts are kept.
+          */
+        unsigned GetTick(unsigned index) const { return ticks[index % TICK_HISTORY]; }
+
+        static const unsigned TICK_HISTORY = 4;
+
     private:
 
         /** The interrupt service routine that handles the SMI interrupt
@@ -55,5 +66,7 @@ namespace hfh3
         // The following two are accessed from interrupt context and are marked
         // as volatile to prevent the compiler from optimizing access to them.
         volatile unsigned missedFrames;
+        volatile unsigned count;
+        volatile unsigned ticks[TICK_HISTORY];
     };
 }
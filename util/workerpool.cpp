@@ -0,0 +1,188 @@
+#include "util/workerpool.h"
+#include "util/log.h"
+
+#include <assert.h>
+
+#if WORKER_POOL_CORES
+#   include <circle/memory.h>
+#endif
+
+using namespace hfh3;
+
+WorkerPool WorkerPool::instance;
+
+WorkerPool& WorkerPool::Instance()
+{
+    return instance;
+}
+
+WorkerPool::WorkerPool()
+#if WORKER_POOL_CORES
+    : cores(nullptr)
+    , workerCount(1)
+#else
+    : workerCount(1)
+#endif
+    , activeWorkers(1)
+    , task(nullptr)
+    , taskCount(0)
+    , generation(0)
+    , nextTask(0)
+    , finished(0)
+    , background(nullptr)
+    , backgroundBusy(false)
+    , backgroundSequence(0)
+    , backgroundDone(0)
+    , backgroundJoined(0)
+    , resumeGeneration(0)
+{
+}
+
+bool WorkerPool::Initialize()
+{
+#if WORKER_POOL_CORES
+    assert(cores == nullptr);
+    workerCount = CORES < maxWorkers ? CORES : maxWorkers;
+    cores = new Cores(*this);
+    if(!cores->Initialize())
+    {
+        ERROR("Failed to start the secondary cores");
+        workerCount = 1;
+        return false;
+    }
+#endif
+    activeWorkers = workerCount;
+    INFO("Worker pool started with %d workers", workerCount);
+    return true;
+}
+
+void WorkerPool::SetActiveWorkers(int count)
+{
+    assert(count >= 1);
+    activeWorkers = count < workerCount ? count : workerCount;
+}
+
+void WorkerPool::Run(int taskCount, Task& inTask)
+{
+    task = &inTask;
+    this->taskCount = taskCount;
+    nextTask = 0;
+    finished = 0;
+
+    // The release store publishes the batch before the workers can see the new generation
+    __atomic_store_n(&generation, generation + 1, __ATOMIC_RELEASE);
+
+    RunTasks();
+
+    // Wait for the other workers to finish their last task. The worker running
+    // the background task does not take part.
+    const int others = workerCount - 1 - (backgroundBusy ? 1 : 0);
+    while(__atomic_load_n(&finished, __ATOMIC_ACQUIRE) < others)
+    {
+    }
+    task = nullptr;
+}
+
+void WorkerPool::Start(BackgroundTask& inTask)
+{
+    assert(!backgroundBusy);
+    if(workerCount < 2)
+    {
+        inTask();
+        return;
+    }
+
+    background = &inTask;
+    backgroundBusy = true;
+    __atomic_store_n(&backgroundSequence, backgroundSequence + 1, __ATOMIC_RELEASE);
+}
+
+void WorkerPool::Wait()
+{
+    if(!backgroundBusy)
+    {
+        return;
+    }
+
+    const unsigned sequence = backgroundSequence;
+    while(__atomic_load_n(&backgroundDone, __ATOMIC_ACQUIRE) != sequence)
+    {
+    }
+
+    // No batch is running here, so the worker can wait for the next one to start
+    resumeGeneration = generation;
+    __atomic_store_n(&backgroundJoined, sequence, __ATOMIC_RELEASE);
+    backgroundBusy = false;
+    background = nullptr;
+}
+
+unsigned WorkerPool::RunBackground(unsigned sequence)
+{
+    (*background)();
+    __atomic_store_n(&backgroundDone, sequence, __ATOMIC_RELEASE);
+
+    while(__atomic_load_n(&backgroundJoined, __ATOMIC_ACQUIRE) != sequence)
+    {
+    }
+    return resumeGeneration;
+}
+
+void WorkerPool::RunTasks()
+{
+    int index;
+    while((index = __atomic_fetch_add(&nextTask, 1, __ATOMIC_ACQ_REL)) < taskCount)
+    {
+        (*task)(index);
+    }
+}
+
+void WorkerPool::WorkerMain(int index)
+{
+    const bool runsBackground = index == workerCount - 1;
+    unsigned seen = 0;
+    unsigned backgroundSeen = 0;
+    while(true)
+    {
+        // Wait for the next batch, or on the last worker, a background task
+        while(__atomic_load_n(&generation, __ATOMIC_ACQUIRE) == seen)
+        {
+            if(runsBackground && __atomic_load_n(&backgroundSequence, __ATOMIC_ACQUIRE) != backgroundSeen)
+            {
+                break;
+            }
+        }
+
+        if(runsBackground && backgroundSequence != backgroundSeen)
+        {
+            backgroundSeen = backgroundSequence;
+            seen = RunBackground(backgroundSeen);
+            continue;
+        }
+        seen = generation;
+
+        if(index < activeWorkers)
+        {
+            RunTasks();
+        }
+
+        // Releasing makes the results visible before the batch is reported as done
+        __atomic_fetch_add(&finished, 1, __ATOMIC_RELEASE);
+    }
+}
+
+#if WORKER_POOL_CORES
+WorkerPool::Cores::Cores(WorkerPool& inPool)
+    : CMultiCoreSupport(CMemorySystem::Get())
+    , pool(inPool)
+{
+}
+
+void WorkerPool::Cores::Run(unsigned core)
+{
+    // Core 0 returns to run the application, the others serve the pool
+    if(core != 0)
+    {
+        pool.WorkerMain(core);
+    }
+}
+#endif
@@ -0,0 +1,129 @@
+#pragma once
+#include <circle/types.h>
+#include <circle/sysconfig.h>
+
+#include "util/callback.h"
+
+#if defined(ARM_ALLOW_MULTI_CORE)
+#   include <circle/multicore.h>
+#   define WORKER_POOL_CORES 1
+#endif
+
+namespace hfh3
+{
+    /** Runs batches of independent tasks on all CPU cores.
+      * The calling core takes part in running the tasks, and Run returns once all
+      * of them have finished. Tasks are handed out one at a time, so cores that
+      * finish early pick up the remaining ones.
+      *
+      * When Circle is built with ARM_ALLOW_MULTI_CORE, the secondary cores are
+      * started through CMultiCoreSupport and wait for work in a loop. Otherwise,
+      * all tasks are run on the calling core.
+      */
+    class WorkerPool
+    {
+    public:
+        static const int maxWorkers = 4;
+
+        using Task = Callback<void(int)>;
+
+        static WorkerPool& Instance();
+
+        /** Starts the additional workers. Has to be called once at start up, before
+          * the first call to Run. Returns false if the workers could not be started.
+          */
+        bool Initialize();
+
+        /** Returns the number of workers available, including the calling core.
+          */
+        int GetWorkerCount() const
+        {
+            return workerCount;
+        }
+
+        /** Limits the number of workers taking part in Run, for measuring how the
+          * work scales with the number of cores.
+          */
+        void SetActiveWorkers(int count);
+
+        int GetActiveWorkers() const
+        {
+            return activeWorkers;
+        }
+
+        /** Calls task with each index from 0 to taskCount-1, spread over the active workers.
+          * Tasks must not modify state shared with other tasks.
+          */
+        void Run(int taskCount, Task& task);
+
+        using BackgroundTask = Callback<void()>;
+
+        /** Starts a task on the last worker and returns without waiting for it. While it
+          * runs, Run spreads batches over the other workers only. Wait has to be called
+          * before starting another one. With a single worker, the task is run by Start.
+          */
+        void Start(BackgroundTask& task);
+
+        /** Waits for the task passed to Start to finish. Does nothing if none was started.
+          */
+        void Wait();
+
+        /** Returns true between Start and Wait.
+          */
+        bool IsBackgroundBusy() const
+        {
+            return backgroundBusy;
+        }
+
+    private:
+        WorkerPool();
+        WorkerPool(const WorkerPool&) = delete;
+
+        // Runs tasks until there are none left in the current batch
+        void RunTasks();
+
+        // The loop run by the additional workers, with indexes starting at 1
+        void WorkerMain(int index);
+
+        // Runs the background task on the last worker. Returns the generation of
+        // the next batch the worker should wait for.
+        unsigned RunBackground(unsigned sequence);
+
+#if WORKER_POOL_CORES
+        class Cores : public CMultiCoreSupport
+        {
+        public:
+            Cores(WorkerPool& inPool);
+            virtual void Run(unsigned core) override;
+        private:
+            WorkerPool& pool;
+        };
+        Cores* cores;
+#endif
+
+        int workerCount;
+        int activeWorkers;
+
+        // The current batch. Written by the calling core before the generation
+        // is incremented, and only read by the workers after that.
+        Task* task;
+        int taskCount;
+
+        volatile unsigned generation; // Incremented to start a new batch
+        volatile int nextTask;        // The index of the next task to hand out
+        volatile int finished;        // The number of additional workers done with the batch
+
+        // The background task. Written by the calling core before the sequence is
+        // incremented. The worker reports when it is done, and after Wait has seen
+        // that, takes up the batches from the generation Wait passes back to it,
+        // so it never joins a batch that does not count on it.
+        BackgroundTask* background;
+        bool backgroundBusy;                    // Only used by the calling core
+        volatile unsigned backgroundSequence;   // Incremented to start a task
+        volatile unsigned backgroundDone;       // The sequence of the last task finished
+        volatile unsigned backgroundJoined;     // The sequence of the last task Wait returned from
+        volatile unsigned resumeGeneration;
+
+        static WorkerPool instance;
+    };
+}